@@ -1,6 +1,14 @@
 #include "app_context.h"
 #include "config.h" // For FONT_SIZE, UI_FONT_SIZE, PROJECT_NAME_STR, COMPANY_NAME_STR, ENABLE_GAME_LOGS
 #include "file_paths.h" // <--- ADDED FOR fopen_unicode_path
+#include "line_index.h" // For LineIndexFree
+#include "block_table.h" // For BlockTableFree
+#include "text_processing.h" // For GlyphMetricsCacheFree, WordWidthCacheFree
+#include "glyph_cache.h" // For GlyphCacheFree
+#include "stats_handler.h" // For InputLatencyStatsFree
+#include "rendering.h"     // For RenderFreeLineTextures
+#include "frame_profiler.h" // For FrameProfilerShutdown
+#include "replacement_rules.h" // For ReplacementRulesFree
 #include <SDL2/SDL_filesystem.h> // For SDL_GetPrefPath
 #include <string.h> // For memset
 #include <math.h>   // For roundf
@@ -60,7 +68,11 @@ bool InitializeApp(AppContext *appCtx, const char* title) {
         TTF_Quit(); SDL_Quit(); return false;
     }
 
+#if LOW_LATENCY_MODE
+    appCtx->ren = SDL_CreateRenderer(appCtx->win, -1, SDL_RENDERER_ACCELERATED); // Paced by the main loop instead of VSYNC
+#else
     appCtx->ren = SDL_CreateRenderer(appCtx->win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+#endif
     if (!appCtx->ren) {
         if(appCtx->log_file_handle) fprintf(appCtx->log_file_handle, "SDL_CreateRenderer error: %s\n", SDL_GetError());
         fprintf(stderr, "SDL_CreateRenderer error: %s\n", SDL_GetError());
@@ -208,6 +220,11 @@ bool InitializeApp(AppContext *appCtx, const char* title) {
                 scaled_line_h_px, appCtx->scale_y_factor, appCtx->line_h);
     }
 
+    if (!GlyphCacheInit(appCtx)) {
+        fprintf(stderr, "WARNING: Failed to initialize the glyph atlas; text glyphs will not be drawn.\n");
+        if(appCtx->log_file_handle) fprintf(appCtx->log_file_handle, "WARNING: GlyphCacheInit failed.\n");
+    }
+
     for (int c = 32; c < 127; c++) {
         int scaled_adv_px;
         if (TTF_GlyphMetrics(appCtx->font, (Uint16)c, NULL, NULL, NULL, NULL, &scaled_adv_px) != 0) {
@@ -217,41 +234,55 @@ bool InitializeApp(AppContext *appCtx, const char* title) {
         if (scaled_adv_px <= 0 && appCtx->scale_x_factor > 0.01f) scaled_adv_px = (int)(1 * appCtx->scale_x_factor);
         else if (scaled_adv_px <=0) scaled_adv_px = FONT_SIZE/2;
 
-        appCtx->glyph_adv_cache[c] = (appCtx->scale_x_factor > 0.01f) ? (int)roundf((float)scaled_adv_px / appCtx->scale_x_factor) : (FONT_SIZE / 2);
-        if (appCtx->glyph_adv_cache[c] <= 0 && scaled_adv_px > 0) appCtx->glyph_adv_cache[c] = 1;
-        else if (appCtx->glyph_adv_cache[c] <= 0) appCtx->glyph_adv_cache[c] = FONT_SIZE / 2 > 1 ? FONT_SIZE / 2 : 1;
-
-        for (int col_idx = COL_TEXT; col_idx <= COL_INCORRECT; col_idx++) {
-            SDL_Surface *surf = TTF_RenderGlyph_Blended(appCtx->font, (Uint16)c, appCtx->palette[col_idx]);
-            if (!surf) continue;
-
-            if (c == 'H' && col_idx == COL_TEXT && appCtx->log_file_handle) {
-                fprintf(appCtx->log_file_handle, "DEBUG: Main Font Glyph 'H' metrics: surf->w=%d, surf->h=%d (target_vdpi=%u, scale_y_factor=%.2f, FONT_SIZE_logical=%d)\n",
-                        surf->w, surf->h,
-                        (unsigned int)(72 * appCtx->scale_y_factor),
-                        appCtx->scale_y_factor,
-                        FONT_SIZE);
-            }
+        GlyphMetrics *ascii_metrics = &appCtx->glyph_metrics[c];
+        ascii_metrics->advance = (appCtx->scale_x_factor > 0.01f) ? (int)roundf((float)scaled_adv_px / appCtx->scale_x_factor) : (FONT_SIZE / 2);
+        if (ascii_metrics->advance <= 0 && scaled_adv_px > 0) ascii_metrics->advance = 1;
+        else if (ascii_metrics->advance <= 0) ascii_metrics->advance = FONT_SIZE / 2 > 1 ? FONT_SIZE / 2 : 1;
+
+        // One white glyph per character; the palette color is applied per draw through vertex colors
+        SDL_Surface *surf = TTF_RenderGlyph_Blended(appCtx->font, (Uint16)c, (SDL_Color){255, 255, 255, 255});
+        if (!surf) continue;
+
+        if (c == 'H' && appCtx->log_file_handle) {
+            fprintf(appCtx->log_file_handle, "DEBUG: Main Font Glyph 'H' metrics: surf->w=%d, surf->h=%d (target_vdpi=%u, scale_y_factor=%.2f, FONT_SIZE_logical=%d)\n",
+                    surf->w, surf->h,
+                    (unsigned int)(72 * appCtx->scale_y_factor),
+                    appCtx->scale_y_factor,
+                    FONT_SIZE);
+        }
 
-            appCtx->glyph_w_cache[col_idx][c] = (appCtx->scale_x_factor > 0.01f && surf->w > 0) ? (int)roundf((float)surf->w / appCtx->scale_x_factor) : surf->w;
-            appCtx->glyph_h_cache[col_idx][c] = (appCtx->scale_y_factor > 0.01f && surf->h > 0) ? (int)roundf((float)surf->h / appCtx->scale_y_factor) : surf->h;
-            if (surf->w > 0 && appCtx->glyph_w_cache[col_idx][c] <= 0) appCtx->glyph_w_cache[col_idx][c] = 1;
-            if (surf->h > 0 && appCtx->glyph_h_cache[col_idx][c] <= 0) appCtx->glyph_h_cache[col_idx][c] = 1;
+        ascii_metrics->w = (appCtx->scale_x_factor > 0.01f && surf->w > 0) ? (int)roundf((float)surf->w / appCtx->scale_x_factor) : surf->w;
+        ascii_metrics->h = (appCtx->scale_y_factor > 0.01f && surf->h > 0) ? (int)roundf((float)surf->h / appCtx->scale_y_factor) : surf->h;
+        if (surf->w > 0 && ascii_metrics->w <= 0) ascii_metrics->w = 1;
+        if (surf->h > 0 && ascii_metrics->h <= 0) ascii_metrics->h = 1;
 
-            appCtx->glyph_tex_cache[col_idx][c] = SDL_CreateTextureFromSurface(appCtx->ren, surf);
-            if (!appCtx->glyph_tex_cache[col_idx][c] && appCtx->log_file_handle) {
-                 fprintf(appCtx->log_file_handle, "Warning: Failed to create texture for glyph %c (ASCII %d) color %d. SDL Error: %s\n", c, c, col_idx, SDL_GetError());
-            }
-            SDL_FreeSurface(surf);
+        if (!GlyphCacheAddAsciiSurface(appCtx, c, surf) && appCtx->log_file_handle) {
+             fprintf(appCtx->log_file_handle, "Warning: Failed to add glyph %c (ASCII %d) to the atlas. SDL Error: %s\n", c, c, SDL_GetError());
         }
+        SDL_FreeSurface(surf);
     }
-    appCtx->space_advance_width = appCtx->glyph_adv_cache[' '];
+    appCtx->space_advance_width = appCtx->glyph_metrics[' '].advance;
     if (appCtx->space_advance_width <= 0) appCtx->space_advance_width = (int)(FONT_SIZE / 3.0f);
     if (appCtx->space_advance_width <= 0) appCtx->space_advance_width = 1;
 
     appCtx->tab_width_pixels = (appCtx->space_advance_width > 0) ? (TAB_SIZE_IN_SPACES * appCtx->space_advance_width) : (int)(TAB_SIZE_IN_SPACES * (FONT_SIZE / 3.0f));
     if (appCtx->tab_width_pixels <= 0) appCtx->tab_width_pixels = TAB_SIZE_IN_SPACES;
 
+    // Fixed-width font: layout counts characters instead of measuring them (see layout_logic.c)
+    appCtx->monospace_advance = 0;
+    if (TTF_FontFaceIsFixedWidth(appCtx->font) > 0) {
+        bool ascii_advances_equal = true;
+        for (int c = 32; c < 127; c++) {
+            if (appCtx->glyph_metrics[c].advance != appCtx->space_advance_width) { ascii_advances_equal = false; break; }
+        }
+        if (ascii_advances_equal) appCtx->monospace_advance = appCtx->space_advance_width;
+    }
+    if (appCtx->log_file_handle) {
+        fprintf(appCtx->log_file_handle, "Main font is %s; monospace layout %s (advance %d).\n",
+                TTF_FontFaceIsFixedWidth(appCtx->font) > 0 ? "fixed-width" : "proportional",
+                appCtx->monospace_advance > 0 ? "on" : "off", appCtx->monospace_advance);
+    }
+
     appCtx->typing_started = false;
     appCtx->start_time_ms = 0;
     appCtx->time_at_pause_ms = 0;
@@ -261,6 +292,20 @@ bool InitializeApp(AppContext *appCtx, const char* title) {
     appCtx->total_errors_committed_for_accuracy = 0;
     appCtx->first_visible_abs_line_num = 0;
     appCtx->predictive_scroll_triggered_this_input_idx = false;
+
+    Uint32 window_flags = SDL_GetWindowFlags(appCtx->win);
+    appCtx->window_minimized = (window_flags & SDL_WINDOW_MINIMIZED) != 0;
+    appCtx->window_has_focus = (window_flags & SDL_WINDOW_INPUT_FOCUS) != 0;
+    appCtx->needs_redraw = true; // First frame
+
+    SDL_DisplayMode display_mode;
+    int refresh_rate_hz = 60; // If the driver does not report a rate
+    if (SDL_GetWindowDisplayMode(appCtx->win, &display_mode) == 0 && display_mode.refresh_rate > 0) {
+        refresh_rate_hz = display_mode.refresh_rate;
+    }
+    appCtx->frame_interval_ms = 1000 / (Uint32)refresh_rate_hz;
+    if (appCtx->log_file_handle) fprintf(appCtx->log_file_handle, "Display refresh rate: %d Hz. Low-latency mode: %s.\n",
+                                         refresh_rate_hz, LOW_LATENCY_MODE ? "on" : "off");
     appCtx->y_offset_due_to_prediction_for_current_idx = 0;
 
     if(appCtx->log_file_handle) {
@@ -275,12 +320,44 @@ void CleanupApp(AppContext *appCtx) {
 
     if(appCtx->log_file_handle) fprintf(appCtx->log_file_handle, "Cleaning up application context...\n");
 
-    for (int c = 32; c < 127; c++) {
-        for (int col = COL_TEXT; col <= COL_INCORRECT; col++) {
-            if (appCtx->glyph_tex_cache[col][c]) {
-                SDL_DestroyTexture(appCtx->glyph_tex_cache[col][c]);
-                appCtx->glyph_tex_cache[col][c] = NULL;
-            }
+    LineIndexFree(&appCtx->line_index);
+    BlockTableFree(&appCtx->block_table);
+    InputLatencyStatsFree(&appCtx->input_latency);
+    FrameProfilerShutdown(appCtx);
+    ReplacementRulesFree(&appCtx->replacement_rules);
+
+    if(appCtx->log_file_handle) {
+        fprintf(appCtx->log_file_handle, "Glyph metrics cache: %zu codepoints, %llu hits, %llu misses.\n",
+                appCtx->glyph_metrics_cache.count,
+                (unsigned long long)appCtx->glyph_metrics_cache.hits,
+                (unsigned long long)appCtx->glyph_metrics_cache.misses);
+    }
+    GlyphMetricsCacheFree(&appCtx->glyph_metrics_cache);
+
+    if(appCtx->log_file_handle) {
+        Uint64 word_lookups = appCtx->word_width_cache.hits + appCtx->word_width_cache.misses;
+        fprintf(appCtx->log_file_handle, "Word width cache: %zu words, %llu hits, %llu misses (%.1f%% hit rate).\n",
+                appCtx->word_width_cache.count,
+                (unsigned long long)appCtx->word_width_cache.hits,
+                (unsigned long long)appCtx->word_width_cache.misses,
+                word_lookups ? 100.0 * (double)appCtx->word_width_cache.hits / (double)word_lookups : 0.0);
+    }
+    WordWidthCacheFree(&appCtx->word_width_cache);
+
+    if(appCtx->log_file_handle) {
+        fprintf(appCtx->log_file_handle, "Glyph atlas: %d pages, %llu hits, %llu misses, %llu page evictions.\n",
+                appCtx->glyph_texture_cache.page_count,
+                (unsigned long long)appCtx->glyph_texture_cache.hits,
+                (unsigned long long)appCtx->glyph_texture_cache.misses,
+                (unsigned long long)appCtx->glyph_texture_cache.evictions);
+    }
+    GlyphCacheFree(&appCtx->glyph_texture_cache); // Before the renderer is destroyed
+    RenderFreeLineTextures(appCtx);
+
+    for (int slot = 0; slot < UI_TEXT_SLOT_COUNT; slot++) {
+        if (appCtx->ui_text_cache[slot].texture) {
+            SDL_DestroyTexture(appCtx->ui_text_cache[slot].texture);
+            appCtx->ui_text_cache[slot].texture = NULL;
         }
     }
 
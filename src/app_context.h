@@ -7,6 +7,258 @@
 #include <stdio.h> // For FILE*
 #include "config.h" // For N_COLORS
 
+// Word-wrap walker state at a block boundary.
+// Laying out from such a state reproduces exactly what a walk from byte 0 would produce.
+typedef struct {
+    size_t byte_offset; // Offset of the next block to lay out
+    int abs_line_num;   // Absolute line the pen is on
+    int pen_x;          // Logical X of the pen on that line
+} LayoutPenState;
+
+// Lazily built index of line starts (see line_index.c).
+// Each entry is a resumable pen state at a block that begins a line at TEXT_AREA_X;
+// entries are sorted by both byte_offset and abs_line_num.
+typedef struct {
+    LayoutPenState *line_starts;
+    size_t count;
+    size_t capacity;
+    LayoutPenState frontier;  // Walker state where indexing stopped
+    bool frontier_at_end;     // The whole text has been indexed
+    const char *indexed_text; // Text the index was built for (reset if it changes)
+    size_t indexed_text_len;
+} LineIndex;
+
+// Blocks of the text (words, runs of spaces, tabs, line breaks) as a struct of arrays (see block_table.c).
+// Tokenized once, in batches ahead of the layout walker; block i covers [offsets[i], offsets[i + 1]).
+typedef struct {
+    size_t *offsets;          // count + 1 entries; offsets[count] is where the next block will start
+    int *widths;              // Pixel width (0 for tabs and line breaks: a tab's width depends on the pen)
+    Uint8 *kinds;             // BLOCK_KIND_* bits
+    size_t count;
+    size_t capacity;
+    size_t lookup_hint;       // Block after the last one looked up, so sequential walks skip the search
+    bool at_end;              // The whole text has been tokenized
+    const char *table_text;   // Text the table was built for (reset if it changes)
+    size_t table_text_len;
+} BlockTable;
+
+// Bulk counts over a byte span (see text_stats.c). Scans accumulate, so a span can be extended piece by piece.
+typedef struct {
+    size_t byte_count;      // Bytes scanned so far
+    size_t codepoint_count; // Bytes that are not UTF-8 continuation bytes (10xxxxxx)
+    size_t word_count;      // Runs of bytes other than ' ', '\n' and '\t'
+    size_t newline_count;
+    size_t line_count;      // newline_count + 1 for a non-empty span
+    bool ends_in_word;      // The last byte belongs to a word that the next piece may continue
+} TextStats;
+
+// One typographic replacement: "from" (matched on raw input bytes) becomes "to"
+typedef struct {
+    char from[REPLACEMENT_RULE_MAX_BYTES];
+    char to[REPLACEMENT_RULE_MAX_BYTES];
+    Uint8 from_len;
+    Uint8 to_len;
+} ReplacementRule;
+
+// Replacement rules compiled into a byte-level trie DFA (see replacement_rules.c).
+// Bytes are mapped to classes first; state 0 is dead, state 1 is the root.
+typedef struct {
+    ReplacementRule rules[REPLACEMENT_RULES_MAX];
+    int rule_count;
+    Uint8 byte_class[256];
+    int class_count;
+    Uint16 *transitions;     // [state * class_count + class] -> next state
+    Sint16 *accept_rule;     // Per state: rule whose "from" ends there, or -1
+    bool *has_children;      // Per state: a longer "from" may still match
+    int state_count;
+    bool starts_rule[256];   // First bytes of all rules
+    bool starts_growing_rule[256]; // First bytes of rules whose "to" is longer than "from"
+    char ascii_stop_byte;    // The printable ASCII byte that starts rules, or ' ' if none
+    bool several_ascii_starts; // More than one printable ASCII byte starts a rule
+} ReplacementRules;
+
+// Logical metrics of a single glyph
+typedef struct {
+    int advance;
+    int w;
+    int h;
+} GlyphMetrics;
+
+// Flat open-addressing cache of glyph metrics for codepoints outside the ASCII caches (see text_processing.c).
+// Linear probing over a power-of-two table; a slot with codepoint 0 is empty, and a negative advance marks a
+// codepoint the font has no metrics for.
+typedef struct {
+    Uint32 *codepoints;
+    GlyphMetrics *metrics;
+    size_t capacity;
+    size_t count;
+    Uint64 hits;   // Lookups answered from the cache
+    Uint64 misses; // Lookups that had to call TTF_GlyphMetrics32
+} GlyphMetricsCache;
+
+// One memoized word width, keyed by the word's bytes
+typedef struct {
+    Uint32 hash;    // Of the bytes; 0 for an empty slot
+    int width;      // Logical pixel width
+    Uint8 len;
+    char bytes[WORD_WIDTH_CACHE_MAX_WORD_BYTES];
+} WordWidthEntry;
+
+// Flat open-addressing cache of word widths (see text_processing.c), so a word that recurs is measured once.
+// Widths hold for the loaded font (size and DPI); free the cache when it changes.
+typedef struct {
+    WordWidthEntry *entries;
+    size_t capacity;
+    size_t count;
+    Uint64 hits;   // Words whose width came from the cache
+    Uint64 misses; // Words measured character by character (longer words are not counted)
+} WordWidthCache;
+
+// One white glyph image in the atlas, linked into a hash chain
+typedef struct {
+    Uint32 codepoint;
+    int page;      // Atlas page holding the glyph, -1 if the slot is free, -2 if the codepoint has no glyph
+    SDL_Rect src;  // Hi-res pixel rect of the glyph on its page
+    int hash_next; // Next entry in the same bucket (or in the free list), -1 for none
+} GlyphTextureEntry;
+
+// One queued glyph draw: hi-res source rect on a page, logical destination rect, modulation color
+typedef struct {
+    SDL_Rect src;
+    SDL_Rect dst;
+    SDL_Color color;
+} GlyphQuad;
+
+// One atlas texture, packed in shelves, with the quads queued for it this frame
+typedef struct {
+    SDL_Texture *texture;
+    int shelf_count;
+    int shelf_y[GLYPH_ATLAS_MAX_SHELVES];
+    int shelf_h[GLYPH_ATLAS_MAX_SHELVES];
+    int shelf_x[GLYPH_ATLAS_MAX_SHELVES]; // Next free X on each shelf
+    int next_shelf_y;                     // Top of the unused area below the last shelf
+    bool pinned;                          // Holds prebuilt ASCII glyphs, never evicted
+    Uint64 last_used_tick;                // For choosing the least recently used page
+    GlyphQuad *quads;                     // Pending batch for this frame
+    int quad_count;
+    int quad_capacity;
+} GlyphAtlasPage;
+
+// Glyph atlas for all text glyphs (see glyph_cache.c).
+// Glyphs are stored once, in white, and tinted per draw. ASCII glyphs are packed once at startup;
+// other codepoints are added on first use, and when the texture budget is reached the least
+// recently used page is cleared and reused.
+typedef struct {
+    GlyphTextureEntry *entries;
+    int entry_count;     // Entries ever allocated (used + free)
+    int entry_capacity;
+    int *buckets;        // GLYPH_TEXTURE_CACHE_BUCKETS chain heads, -1 for empty
+    int free_head;       // Recycled entries, chained through hash_next
+    GlyphAtlasPage pages[GLYPH_ATLAS_MAX_PAGES];
+    int page_count;
+    int page_size;       // Width and height of every page in hi-res pixels
+    int ascii_entries[128]; // Direct lookup for prebuilt ASCII glyphs, -1 if missing
+    Uint64 tick;
+    bool geometry_unsupported; // SDL_RenderGeometry failed once; draw with SDL_RenderCopy instead
+#if SDL_VERSION_ATLEAST(2,0,18)
+    SDL_Vertex *batch_vertices; // Scratch for GlyphCacheFlushDraws: 4 vertices and 6 indices per quad
+    int *batch_indices;
+    int batch_capacity;         // In quads
+#endif
+    Uint64 hits;
+    Uint64 misses;
+    Uint64 evictions;    // Pages cleared to make room
+} GlyphTextureCache;
+
+// Slots of the UI text cache, one per label drawn above the text
+enum {
+    UI_TEXT_TIMER,
+    UI_TEXT_WPM,
+    UI_TEXT_ACCURACY,
+    UI_TEXT_WORDS,
+    UI_TEXT_SLOT_COUNT
+};
+
+// One UI label texture, re-rendered only when its string or color changes
+typedef struct {
+    char text[40];
+    SDL_Color color;
+    SDL_Texture *texture; // Hi-res, NULL until first drawn
+    int scaled_w;         // Texture size in scaled pixels
+    int scaled_h;
+    int logical_w;        // Size in logical units
+    int logical_h;
+} UiTextCacheEntry;
+
+// Keystroke-to-present latency (SDL event timestamp to the SDL_RenderPresent that shows it)
+typedef struct {
+    Uint32 pending_timestamps[INPUT_LATENCY_PENDING_MAX]; // Keystrokes not yet presented
+    int pending_count;
+    Uint32 *samples_ms; // One sample per presented keystroke
+    size_t sample_count;
+    size_t sample_capacity;
+} InputLatencyStats;
+
+// Stages of the main loop timed by the frame profiler
+enum {
+    PROFILE_STAGE_UNTRACKED = -1, // Time that is part of the frame total only
+    PROFILE_STAGE_EVENTS,
+    PROFILE_STAGE_TIMER,
+    PROFILE_STAGE_LIVE_STATS,
+    PROFILE_STAGE_CURSOR_LAYOUT,
+    PROFILE_STAGE_SCROLL,
+    PROFILE_STAGE_TEXT,
+    PROFILE_STAGE_PRESENT,
+    PROFILE_STAGE_COUNT
+};
+
+typedef struct {
+    bool overlay_visible;
+    FILE *csv_file;             // NULL if it could not be opened
+    Uint64 frame_start_counter; // SDL performance counter values
+    Uint64 last_mark_counter;
+    double stage_ms[PROFILE_STAGE_COUNT]; // Current frame
+    float history_ms[PROFILE_STAGE_COUNT + 1][FRAME_PROFILER_HISTORY]; // Rolling window; the last row is the whole frame
+    int history_count;
+    int history_next;
+    Uint64 frame_number;
+} FrameProfiler;
+
+// One visible glyph, collected during layout and drawn into the texture of its line
+typedef struct {
+    SDL_Rect dst;         // Logical, x from the window edge, y from the top of the line
+    Uint32 codepoint;     // Looked up in the glyph cache only when the glyph is (re)drawn
+    SDL_Color color;
+    size_t byte_offset;   // Position in the text, for dirty-range checks
+    size_t byte_len;
+} LineGlyph;
+
+// A render-target texture holding one wrapped line of the text
+typedef struct {
+    SDL_Texture *texture;
+    bool valid;           // Texture content matches abs_line_num and the input state
+    int abs_line_num;
+    size_t start_offset;  // Bytes of the glyphs drawn into it
+    size_t end_offset;
+    Uint64 last_used_frame;
+} LineTextureSlot;
+
+typedef struct {
+    LineTextureSlot slots[LINE_TEXTURE_CACHE_SLOTS];
+    int texture_w;        // Hi-res size of every line texture
+    int texture_h;
+    const char *cached_text; // Text the slots were drawn from
+    size_t cached_text_len;
+    size_t dirty_begin;   // Input bytes whose typed/correct state changed since the last frame
+    size_t dirty_end;     // (empty when dirty_begin >= dirty_end)
+    bool targets_unsupported; // Draw straight to the screen instead
+    LineGlyph *glyphs;    // Glyphs of the visible lines, in line order
+    int glyph_count;
+    int glyph_capacity;
+    int line_glyph_start[DISPLAY_LINES + 1]; // Glyphs of viewport line v are [start[v], start[v + 1])
+    Uint64 frame;
+} LineTextureCache;
+
 typedef struct {
     SDL_Window *win;
     SDL_Renderer *ren;
@@ -16,15 +268,19 @@ typedef struct {
     int line_h; // Logical height of a single text line
     int ui_line_h;
 
-    // Glyph cache for ASCII characters (32-126)
+    // Metrics cache for ASCII characters (32-126); their images live in glyph_texture_cache
     // Textures are hi-res, metrics are logical
-    SDL_Texture *glyph_tex_cache[N_COLORS][128];
-    int glyph_adv_cache[128]; // Logical advance width (advance)
-    int glyph_w_cache[N_COLORS][128]; // Logical glyph width
-    int glyph_h_cache[N_COLORS][128]; // Logical glyph height
+    GlyphMetrics glyph_metrics[128];
+    GlyphMetricsCache glyph_metrics_cache; // Metrics for all other codepoints, filled on first use
+    WordWidthCache word_width_cache;       // Widths of words already measured
+    GlyphTextureCache glyph_texture_cache; // Atlas pages for all glyph images, bounded by GLYPH_TEXTURE_CACHE_BUDGET_BYTES
+
+    UiTextCacheEntry ui_text_cache[UI_TEXT_SLOT_COUNT]; // Timer and live stats labels
+    LineTextureCache line_texture_cache; // Visible text lines, redrawn only where input changed them
 
     int space_advance_width; // Logical advance width for space
     int tab_width_pixels;    // Logical tab width in pixels
+    int monospace_advance;   // Logical advance of every character if the font is fixed-width, else 0 (see InitializeApp)
 
     // Program state
     bool typing_started;
@@ -39,9 +295,24 @@ typedef struct {
     bool l_cmd_modifier_held; // Specifically for macOS
     bool r_cmd_modifier_held; // Specifically for macOS
 
+    ReplacementRules replacement_rules; // Applied by the preprocessor (PreprocessState.rules)
+
     // Statistics
     unsigned long long total_keystrokes_for_accuracy;
     unsigned long long total_errors_committed_for_accuracy;
+    TextStats text_summary;       // Of the text loaded so far (see TextLoaderPoll)
+    bool text_load_finished;      // text_summary covers the whole text, which no longer moves or grows
+    bool text_is_ascii;           // The text loaded so far has no byte >= 0x80 (layout and rendering take their ASCII loops)
+    TextStats typed_input_stats;  // Of input_buffer[0..byte_count), extended as typing goes on
+
+    // Redraw scheduling (the main loop sleeps until input or a deadline, and draws only when needed)
+    bool needs_redraw;      // Visible state changed since the last present
+    bool window_minimized;
+    bool window_has_focus;
+    Uint32 frame_interval_ms; // Display refresh period (frame pacing in LOW_LATENCY_MODE)
+    Uint32 last_present_ms;
+    InputLatencyStats input_latency;
+    FrameProfiler frame_profiler;
 
     // For logging
     FILE *log_file_handle;
@@ -50,6 +321,8 @@ typedef struct {
     int first_visible_abs_line_num;
     bool predictive_scroll_triggered_this_input_idx;
     int y_offset_due_to_prediction_for_current_idx;
+    LineIndex line_index; // Line start checkpoints shared by layout and rendering
+    BlockTable block_table; // Pre-measured blocks read by the word-wrap walker
 
     // HiDPI scaling factors
     float scale_x_factor;
@@ -0,0 +1,132 @@
+#include "block_table.h"
+#include "text_processing.h" // For TextBlockInfo, get_next_text_block_func
+#include "config.h"          // For TEXT_AREA_X, BLOCK_TABLE_BATCH_BLOCKS
+#include <stdlib.h>          // For realloc, free
+#include <string.h>          // For memset
+
+// Blocks do not depend on where the pen is (only a tab's width does, and it is left to the walker), so each
+// block is decoded and measured once per text instead of on every walk over it, including the peek at the
+// block after a word. The walker then reads offsets, widths and kinds from flat arrays.
+
+void BlockTableReset(BlockTable *table) {
+    if (!table) return;
+    table->count = 0;
+    table->lookup_hint = 0;
+    table->at_end = false;
+    table->table_text = NULL;
+    table->table_text_len = 0;
+}
+
+void BlockTableFree(BlockTable *table) {
+    if (!table) return;
+    free(table->offsets);
+    free(table->widths);
+    free(table->kinds);
+    memset(table, 0, sizeof(BlockTable));
+}
+
+void BlockTableTextExtended(BlockTable *table, const char *text_to_type, size_t final_text_len) {
+    if (!table || !table->table_text || final_text_len < table->table_text_len) return; // Rebuilt on the next lookup
+    table->table_text = text_to_type;
+    table->table_text_len = final_text_len;
+    if (table->count == 0 || table->offsets[table->count] < final_text_len) table->at_end = false; // Resumes where the old text ended
+}
+
+// Grows all three arrays; the capacity only changes once every one of them has room
+static bool block_table_grow(BlockTable *table) {
+    size_t new_capacity = table->capacity ? table->capacity * 2 : BLOCK_TABLE_BATCH_BLOCKS;
+    size_t *new_offsets = (size_t*)realloc(table->offsets, (new_capacity + 1) * sizeof(size_t));
+    if (!new_offsets) return false;
+    table->offsets = new_offsets;
+    int *new_widths = (int*)realloc(table->widths, new_capacity * sizeof(int));
+    if (!new_widths) return false;
+    table->widths = new_widths;
+    Uint8 *new_kinds = (Uint8*)realloc(table->kinds, new_capacity * sizeof(Uint8));
+    if (!new_kinds) return false;
+    table->kinds = new_kinds;
+    table->capacity = new_capacity;
+    return true;
+}
+
+// Makes sure the table belongs to this text and has its first offset
+static bool block_table_prepare(AppContext *appCtx, const char *text_to_type, size_t final_text_len) {
+    BlockTable *table = &appCtx->block_table;
+    if (!appCtx->font) return false; // Widths need the font
+    if (table->table_text != text_to_type || table->table_text_len != final_text_len || !table->offsets) {
+        BlockTableReset(table);
+        if (!table->offsets && !block_table_grow(table)) return false;
+        table->table_text = text_to_type;
+        table->table_text_len = final_text_len;
+        table->offsets[0] = 0;
+        table->at_end = (final_text_len == 0);
+    }
+    return true;
+}
+
+// Tokenizes blocks until there are more than min_count and they reach past min_offset, then one batch more
+// so that walks rarely stop here (or until the text ends)
+static void block_table_tokenize(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                                 size_t min_count, size_t min_offset) {
+    BlockTable *table = &appCtx->block_table;
+    const char *p_end = text_to_type + final_text_len;
+    size_t batch_end = 0; // Set once the requested blocks are there
+
+    while (!table->at_end) {
+        if (batch_end == 0 && table->count > min_count && table->offsets[table->count] > min_offset) {
+            batch_end = table->count + BLOCK_TABLE_BATCH_BLOCKS;
+        }
+        if (batch_end != 0 && table->count >= batch_end) break;
+        if (table->count == table->capacity && !block_table_grow(table)) return;
+
+        const char *p_block = text_to_type + table->offsets[table->count];
+        const char *p_iter = p_block;
+        TextBlockInfo block = get_next_text_block_func(appCtx, &p_iter, p_end, TEXT_AREA_X);
+        if (p_iter <= p_block) p_iter = p_block + 1; // Ensure advancement
+
+        Uint8 kind = 0;
+        if (block.is_newline) kind = BLOCK_KIND_NEWLINE;
+        else if (block.is_tab) kind = BLOCK_KIND_TAB;
+        else if (block.is_word) kind = BLOCK_KIND_WORD;
+        else if (block.num_bytes > 0 && *p_block == ' ') kind = BLOCK_KIND_SPACES;
+        if (block.is_monospace) kind |= BLOCK_KIND_MONOSPACE;
+
+        table->widths[table->count] = (kind & (BLOCK_KIND_TAB | BLOCK_KIND_NEWLINE)) ? 0 : block.pixel_width;
+        table->kinds[table->count] = kind;
+        table->count++;
+        table->offsets[table->count] = (size_t)(p_iter - text_to_type);
+        if (table->offsets[table->count] >= final_text_len) table->at_end = true;
+    }
+}
+
+bool BlockTableFind(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                    size_t byte_offset, size_t *out_block_index) {
+    if (!appCtx || !text_to_type || !out_block_index || byte_offset >= final_text_len) return false;
+    if (!block_table_prepare(appCtx, text_to_type, final_text_len)) return false;
+
+    BlockTable *table = &appCtx->block_table;
+    size_t block_index;
+    if (table->lookup_hint < table->count && table->offsets[table->lookup_hint] == byte_offset) {
+        block_index = table->lookup_hint;
+    } else {
+        if (byte_offset >= table->offsets[table->count]) {
+            block_table_tokenize(appCtx, text_to_type, final_text_len, 0, byte_offset); // Past the tokenized part
+            if (byte_offset >= table->offsets[table->count]) return false;
+        }
+        // Last block starting at or before byte_offset
+        size_t lo = 0, hi = table->count;
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (table->offsets[mid] <= byte_offset) lo = mid; else hi = mid;
+        }
+        if (table->offsets[lo] != byte_offset) return false;
+        block_index = lo;
+    }
+
+    // The walker peeks at the block after a word
+    if (block_index + 1 >= table->count) block_table_tokenize(appCtx, text_to_type, final_text_len, block_index + 1, 0);
+    if (block_index >= table->count) return false;
+
+    table->lookup_hint = block_index + 1;
+    *out_block_index = block_index;
+    return true;
+}
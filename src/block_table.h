@@ -0,0 +1,27 @@
+#ifndef BLOCK_TABLE_H
+#define BLOCK_TABLE_H
+
+#include "app_context.h" // For BlockTable
+
+// Kind bits of a block; an invalid byte has none
+enum {
+    BLOCK_KIND_WORD      = 1 << 0,
+    BLOCK_KIND_SPACES    = 1 << 1, // Run of ' '
+    BLOCK_KIND_TAB       = 1 << 2,
+    BLOCK_KIND_NEWLINE   = 1 << 3,
+    BLOCK_KIND_MONOSPACE = 1 << 4  // Every character advances by appCtx->monospace_advance
+};
+
+// Drops all blocks (e.g. when the text or the font metrics change)
+void BlockTableReset(BlockTable *table);
+void BlockTableFree(BlockTable *table);
+// The text grew at its end (and may have moved). Blocks are kept: the old text must end with a whole block
+// (e.g. after a space or line break, see text_loader.c).
+void BlockTableTextExtended(BlockTable *table, const char *text_to_type, size_t final_text_len);
+
+// Finds the block that starts at byte_offset, tokenizing up to it and the block after it if needed.
+// Returns false if no block starts there or the table cannot be built (no font, out of memory).
+bool BlockTableFind(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                    size_t byte_offset, size_t *out_block_index);
+
+#endif // BLOCK_TABLE_H
@@ -6,7 +6,6 @@
 #define WINDOW_H     200 // 256 for 5 lines
 #define FONT_SIZE    28
 #define UI_FONT_SIZE 30
-#define MAX_TEXT_LEN (5 * 1024 * 1024) // Maximum length of raw text
 
 #ifndef TEXT_FILE_PATH_BASENAME
 #define TEXT_FILE_PATH_BASENAME "text.txt"
@@ -14,6 +13,12 @@
 #ifndef STATS_FILE_BASENAME
 #define STATS_FILE_BASENAME "stats.txt"
 #endif
+#ifndef RULES_FILE_BASENAME
+#define RULES_FILE_BASENAME "replacements.txt" // Optional typographic replacement rules
+#endif
+#ifndef PROGRESS_FILE_BASENAME
+#define PROGRESS_FILE_BASENAME "progress.txt" // Checkpoint of how far text.txt has been typed
+#endif
 
 // These definitions will be replaced by values from CMake if specified there.
 #ifndef PROJECT_NAME_STR
@@ -29,11 +34,58 @@
 #define DISPLAY_LINES 3 // Number of text lines displayed simultaneously
 #define CURSOR_TARGET_VIEWPORT_LINE 1 // On which viewport line (0-indexed) the cursor should be
 #define TAB_SIZE_IN_SPACES 4 // Number of spaces for a single tab character
+#define CURSOR_BLINK_INTERVAL_MS 500 // Cursor blink half-period
+#define GLYPH_METRICS_CACHE_INITIAL_CAPACITY 256 // Slots in the non-ASCII glyph metrics cache (power of two, doubles at 70% load)
+#define WORD_WIDTH_CACHE_INITIAL_CAPACITY 1024 // Slots in the word width cache (power of two, doubles at 70% load)
+#define WORD_WIDTH_CACHE_MAX_CAPACITY (128 * 1024) // The cache stops growing here (32 bytes per slot); further words are just measured
+#define WORD_WIDTH_CACHE_MAX_WORD_BYTES 23 // Longest word whose width is cached (keeps a slot at 32 bytes)
+#define GLYPH_TEXTURE_CACHE_BUDGET_BYTES (16 * 1024 * 1024) // Texture memory for glyph atlas pages before LRU page eviction
+#define GLYPH_TEXTURE_CACHE_BUCKETS 1024 // Hash buckets of the glyph texture cache (power of two)
+#define GLYPH_ATLAS_PAGE_SIZE 1024 // Atlas page width and height in hi-res pixels (clamped to the renderer maximum)
+#define GLYPH_ATLAS_MAX_PAGES (GLYPH_TEXTURE_CACHE_BUDGET_BYTES / (GLYPH_ATLAS_PAGE_SIZE * GLYPH_ATLAS_PAGE_SIZE * 4))
+#define GLYPH_ATLAS_MAX_SHELVES 64 // Shelves (rows of glyphs) per atlas page
+#define BLOCK_TABLE_BATCH_BLOCKS 4096 // Blocks the layout block table tokenizes at a time ahead of the walker
+#define LINE_TEXTURE_CACHE_SLOTS (DISPLAY_LINES + 2) // Line textures kept, so lines scrolled just out of view are reused
+#define TEXT_IMPORT_SAMPLE_BYTES (64 * 1024) // Leading bytes of a practice file examined to guess its encoding (loaded before the first frame)
+#define TEXT_LOAD_CHUNK_BYTES (256 * 1024) // Bytes the background loader reads at a time (at least TEXT_IMPORT_SAMPLE_BYTES)
+#define TEXT_LOAD_MAX_CHUNK_BYTES (16 * 1024 * 1024) // Reads double as the text grows up to this, so large texts are preprocessed in parallel
+#define TEXT_LOAD_PUBLISH_BYTES (1024 * 1024) // Smallest piece of newly loaded text handed to the main thread (later half the text so far)
+#ifndef PREPROCESS_PARALLEL_MIN_BYTES // Lowered by the tests to split small inputs
+#define PREPROCESS_PARALLEL_MIN_BYTES (1024 * 1024) // Smallest piece of text worth preprocessing on its own thread
+#endif
+#define PREPROCESS_MAX_CHUNKS 64 // Upper bound on parallel preprocessing threads
+#ifndef PREPROCESS_MIN_THREADS // Raised by the tests to split inputs on machines with one CPU too
+#define PREPROCESS_MIN_THREADS 1 // Threads preprocessing may use however few CPUs there are
+#endif
+#define REPLACEMENT_RULES_MAX 256 // Typographic replacement rules (built-in plus rules file)
+#define REPLACEMENT_RULE_MAX_BYTES 16 // Longest "from" or "to" string of a rule, in UTF-8 bytes
+#define PROGRESS_CHECKPOINT_INTERVAL_MS 2000 // Longest time typing progress goes unsaved (what a crash can lose)
+#define PROGRESS_HASH_BYTES 256 // Text before the typing position that must be unchanged to resume there
+
+// Set to 0 to practice on HTML pages and Markdown notes as they are, tags and syntax included.
+// When 1, text.txt is checked for markup on load and the tags, entities and Markdown syntax are removed.
+#ifndef TEXT_IMPORT_STRIP_MARKUP
+#define TEXT_IMPORT_STRIP_MARKUP 1
+#endif
 
 // Set to 1 to enable logging to a file.
 // The log file will be created in the user's settings directory.
 #define ENABLE_GAME_LOGS 0
 
+// Set to 1 to present without VSYNC: input is polled again right before each frame is built and
+// frames are paced to the display refresh rate instead. Keystroke latency is reported in both modes.
+#ifndef LOW_LATENCY_MODE
+#define LOW_LATENCY_MODE 0
+#endif
+#define INPUT_LATENCY_PENDING_MAX 64 // Keystrokes waiting for the frame that shows them
+
+// Set to 1 to time each stage of the main loop: F3 toggles an overlay with rolling min/avg/p99 per stage,
+// and every drawn frame is appended to frame_profile.csv in the user's settings directory.
+#ifndef ENABLE_FRAME_PROFILER
+#define ENABLE_FRAME_PROFILER 0
+#endif
+#define FRAME_PROFILER_HISTORY 240 // Frames in the rolling window of the overlay
+
 // Colors
 enum {
     COL_BG,          // Background
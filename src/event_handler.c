@@ -1,6 +1,9 @@
 #include "event_handler.h"
 #include "utf8_utils.h" // For decode_utf8
 #include "config.h"     // Possibly for some constants related to events
+#include "stats_handler.h" // For RecordKeystrokeForLatency
+#include "rendering.h"     // For RenderMarkInputDirty, RenderInvalidateLineTextures
+#include "frame_profiler.h" // For FrameProfilerToggleOverlay
 
 #include <string.h> // For strlen, snprintf
 #include <stdlib.h> // For system()
@@ -72,6 +75,31 @@ void HandleAppEvents(AppContext *appCtx, SDL_Event *event,
             return;
         }
 
+        if (event->type == SDL_KEYDOWN && event->key.keysym.sym == SDLK_F3 && !event->key.repeat) {
+            FrameProfilerToggleOverlay(appCtx); // No-op unless ENABLE_FRAME_PROFILER
+        }
+
+        // --- Redraw scheduling ---
+        // Key presses, text input and window changes can all change what is on screen; key releases cannot
+        if (event->type == SDL_WINDOWEVENT) {
+            switch (event->window.event) {
+                case SDL_WINDOWEVENT_MINIMIZED:    appCtx->window_minimized = true; break;
+                case SDL_WINDOWEVENT_RESTORED:
+                case SDL_WINDOWEVENT_MAXIMIZED:
+                case SDL_WINDOWEVENT_SHOWN:        appCtx->window_minimized = false; break;
+                case SDL_WINDOWEVENT_FOCUS_GAINED: appCtx->window_has_focus = true; break;
+                case SDL_WINDOWEVENT_FOCUS_LOST:   appCtx->window_has_focus = false; break;
+                default: break;
+            }
+            appCtx->needs_redraw = true;
+        } else if (event->type == SDL_RENDER_TARGETS_RESET || event->type == SDL_RENDER_DEVICE_RESET) {
+            RenderInvalidateLineTextures(appCtx, event->type == SDL_RENDER_DEVICE_RESET); // Their contents are gone
+            appCtx->needs_redraw = true;
+        } else if (event->type == SDL_KEYDOWN || event->type == SDL_TEXTINPUT) {
+            appCtx->needs_redraw = true;
+        }
+        size_t input_idx_before_event = *current_input_byte_idx; // Characters between old and new index change color
+
         // --- Modifier Key State Update ---
         if (event->type == SDL_KEYDOWN || event->type == SDL_KEYUP) {
             bool key_is_down = (event->type == SDL_KEYDOWN);
@@ -245,6 +273,7 @@ void HandleAppEvents(AppContext *appCtx, SDL_Event *event,
                                          // The !event->key.repeat check is usually for actions you want once per physical press.
                                          // For backspace (single or word), repeating is often desired.
             if (event->key.keysym.sym == SDLK_BACKSPACE && *current_input_byte_idx > 0) {
+                RecordKeystrokeForLatency(appCtx, event->key.timestamp);
                 bool word_delete_modifier_active = false;
                 #if defined(__APPLE__)
                     // On macOS, LOption (LAlt) + Backspace
@@ -310,7 +339,12 @@ void HandleAppEvents(AppContext *appCtx, SDL_Event *event,
         }
 
         // Text input handling
-        if (event->type == SDL_TEXTINPUT) {
+        if (event->type == SDL_TEXTINPUT && !appCtx->text_load_finished &&
+            *current_input_byte_idx + strlen(event->text.text) > final_text_len) {
+            // The text there is still loading: neither a mistake nor progress, so the keys are dropped
+            log_event_message_format(appCtx, "Input '%s' past the loaded text ignored while the rest loads.", event->text.text);
+        } else if (event->type == SDL_TEXTINPUT) {
+            RecordKeystrokeForLatency(appCtx, event->text.timestamp);
             if (!(appCtx->typing_started) && final_text_len > 0) { // Start of typing
                 appCtx->start_time_ms = SDL_GetTicks();
                 appCtx->typing_started = true;
@@ -398,5 +432,9 @@ void HandleAppEvents(AppContext *appCtx, SDL_Event *event,
                 log_event_message_format(appCtx, "WARN: Input buffer near full or event text too long. Input from event '%s' ignored.", event->text.text);
             }
         }
+
+        if (*current_input_byte_idx != input_idx_before_event) {
+            RenderMarkInputDirty(appCtx, input_idx_before_event, *current_input_byte_idx);
+        }
     }
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define FILE_PATHS_H
 
 #include "app_context.h" // For AppContext (if log_file_handle is used here)
+#include <SDL2/SDL_atomic.h> // For SDL_atomic_t
+#include <stdbool.h>
 #include <stddef.h>      // For size_t
 #include <stdio.h>       // For FILE*
 
@@ -12,21 +14,26 @@
 typedef struct {
     char actual_text_file_path[MAX_PATH_LEN];
     char actual_stats_file_path[MAX_PATH_LEN];
+    char actual_rules_file_path[MAX_PATH_LEN];
+    char actual_progress_file_path[MAX_PATH_LEN];
     char default_text_file_in_bundle_path[MAX_PATH_LEN];
 } FilePaths;
 
 // Path initialization
 void InitializeFilePaths(AppContext *appCtx, FilePaths *paths);
 
-// Loading initial text
-// Returns a pointer to a dynamically allocated buffer with text,
-// or NULL in case of error. out_raw_text_len is set accordingly.
-char* LoadInitialText(AppContext *appCtx, FilePaths *paths, size_t* out_raw_text_len);
-
-// Saving remaining text
-void SaveRemainingText(AppContext *appCtx, FilePaths *paths,
-                       const char *text_to_type, size_t final_text_len,
-                       size_t current_input_byte_idx);
+// Opening initial text
+// Returns the user's text.txt opened for reading, after copying the bundled default text there if it did not
+// exist or writing the placeholder text there if it was empty, or NULL if none of that worked.
+// The file is read by the text loader as it goes, so there is no limit on its size.
+FILE* OpenInitialText(AppContext *appCtx, FilePaths *paths);
+// Text to practice on when there is no text file (explains how to add one)
+const char* GetPlaceholderText(void);
+
+// Replaces the file at path with data: writes path + ".tmp", flushes it to disk and renames it over path,
+// so a crash leaves either the old or the new file. Between pieces of a large write it gives up (leaving the
+// old file) once *cancel_requested is set; pass NULL to always finish. Usable from any thread.
+bool WriteFileAtomically(AppContext *appCtx, const char *path, const char *data, size_t data_len, SDL_atomic_t *cancel_requested);
 
 // Unicode-safe fopen wrapper
 FILE* fopen_unicode_path(const char *utf8_path, const char *mode);
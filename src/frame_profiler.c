@@ -0,0 +1,174 @@
+#include "frame_profiler.h"
+
+#if ENABLE_FRAME_PROFILER
+
+#include "glyph_cache.h"         // For GlyphCacheLookup, GlyphCacheQueueDraw, GlyphCacheFlushDraws
+#include "file_paths.h"          // For fopen_unicode_path, MAX_PATH_LEN
+#include <SDL2/SDL_filesystem.h> // For SDL_GetPrefPath
+#include <stdio.h>               // For snprintf, fprintf
+#include <stdlib.h>              // For qsort
+#include <string.h>              // For memcpy
+
+static const char *stage_names[PROFILE_STAGE_COUNT + 1] = {
+    "events", "timer", "live_stats", "cursor_layout", "scroll", "text", "present", "total"
+};
+
+// Helper function for logging if appCtx->log_file_handle is available
+static void log_profiler_message_format(AppContext *appCtx, const char* format, ...) {
+    if (appCtx && appCtx->log_file_handle && format) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(appCtx->log_file_handle, format, args);
+        va_end(args);
+        fprintf(appCtx->log_file_handle, "\n");
+        fflush(appCtx->log_file_handle);
+    }
+}
+
+static double counter_delta_ms(Uint64 from_counter, Uint64 to_counter) {
+    return (double)(to_counter - from_counter) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+void FrameProfilerInit(AppContext *appCtx) {
+    if (!appCtx) return;
+    FrameProfiler *profiler = &appCtx->frame_profiler;
+
+    char csv_path[MAX_PATH_LEN];
+    char *pref_path = SDL_GetPrefPath(COMPANY_NAME_STR, PROJECT_NAME_STR);
+    if (pref_path) {
+        snprintf(csv_path, sizeof(csv_path), "%sframe_profile.csv", pref_path);
+        SDL_free(pref_path);
+    } else {
+        snprintf(csv_path, sizeof(csv_path), "TypingApp_frame_profile.csv"); // Fallback path
+    }
+
+    profiler->csv_file = fopen_unicode_path(csv_path, "w");
+    if (!profiler->csv_file) {
+        fprintf(stderr, "Frame profiler: could not open %s; per-frame CSV disabled.\n", csv_path);
+        log_profiler_message_format(appCtx, "Frame profiler: failed to open CSV '%s'.", csv_path);
+        return;
+    }
+    fprintf(profiler->csv_file, "frame,ticks_ms");
+    for (int stage = 0; stage <= PROFILE_STAGE_COUNT; stage++) fprintf(profiler->csv_file, ",%s_ms", stage_names[stage]);
+    fprintf(profiler->csv_file, "\n");
+    log_profiler_message_format(appCtx, "Frame profiler: writing per-frame timings to '%s'.", csv_path);
+}
+
+void FrameProfilerShutdown(AppContext *appCtx) {
+    if (!appCtx || !appCtx->frame_profiler.csv_file) return;
+    fclose(appCtx->frame_profiler.csv_file);
+    appCtx->frame_profiler.csv_file = NULL;
+}
+
+void FrameProfilerBeginFrame(AppContext *appCtx) {
+    if (!appCtx) return;
+    FrameProfiler *profiler = &appCtx->frame_profiler;
+    profiler->frame_start_counter = SDL_GetPerformanceCounter();
+    profiler->last_mark_counter = profiler->frame_start_counter;
+    for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++) profiler->stage_ms[stage] = 0.0;
+}
+
+void FrameProfilerEndStage(AppContext *appCtx, int stage) {
+    if (!appCtx || stage >= PROFILE_STAGE_COUNT) return;
+    FrameProfiler *profiler = &appCtx->frame_profiler;
+    Uint64 now_counter = SDL_GetPerformanceCounter();
+    if (stage >= 0) { // Stages may repeat (e.g. a second event poll)
+        profiler->stage_ms[stage] += counter_delta_ms(profiler->last_mark_counter, now_counter);
+    }
+    profiler->last_mark_counter = now_counter;
+}
+
+void FrameProfilerEndFrame(AppContext *appCtx) {
+    if (!appCtx) return;
+    FrameProfiler *profiler = &appCtx->frame_profiler;
+    double total_ms = counter_delta_ms(profiler->frame_start_counter, SDL_GetPerformanceCounter());
+
+    for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+        profiler->history_ms[stage][profiler->history_next] = (float)profiler->stage_ms[stage];
+    }
+    profiler->history_ms[PROFILE_STAGE_COUNT][profiler->history_next] = (float)total_ms;
+    profiler->history_next = (profiler->history_next + 1) % FRAME_PROFILER_HISTORY;
+    if (profiler->history_count < FRAME_PROFILER_HISTORY) profiler->history_count++;
+
+    if (profiler->csv_file) {
+        fprintf(profiler->csv_file, "%llu,%u", (unsigned long long)profiler->frame_number, SDL_GetTicks());
+        for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++) fprintf(profiler->csv_file, ",%.4f", profiler->stage_ms[stage]);
+        fprintf(profiler->csv_file, ",%.4f\n", total_ms);
+    }
+    profiler->frame_number++;
+}
+
+void FrameProfilerToggleOverlay(AppContext *appCtx) {
+    if (!appCtx) return;
+    appCtx->frame_profiler.overlay_visible = !appCtx->frame_profiler.overlay_visible;
+    appCtx->needs_redraw = true;
+}
+
+static int compare_float_ascending(const void *a, const void *b) {
+    float value_a = *(const float*)a, value_b = *(const float*)b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+// Draws ASCII text from the glyph atlas at half the main font size
+static void draw_overlay_text(AppContext *appCtx, int x, int y, const char *text, SDL_Color color) {
+    int pen_x = x;
+    for (const char *p = text; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c < 32 || c >= 127) continue;
+        const GlyphMetrics *metrics = &appCtx->glyph_metrics[c];
+        int glyph_entry_idx = GlyphCacheLookup(appCtx, c);
+        if (glyph_entry_idx >= 0 && c != ' ') {
+            SDL_Rect dst_rect = {pen_x, y, metrics->w / 2, metrics->h / 2};
+            GlyphCacheQueueDraw(appCtx, glyph_entry_idx, &dst_rect, color);
+        }
+        pen_x += metrics->advance / 2;
+    }
+}
+
+// One overlay row; columns start at fixed offsets because the font is proportional
+static void draw_overlay_row(AppContext *appCtx, int x, int y, const char *columns[4], SDL_Color color) {
+    static const int column_offsets[4] = {0, 120, 190, 260};
+    for (int column = 0; column < 4; column++) draw_overlay_text(appCtx, x + column_offsets[column], y, columns[column], color);
+}
+
+void FrameProfilerRenderOverlay(AppContext *appCtx) {
+    if (!appCtx || !appCtx->ren || !appCtx->frame_profiler.overlay_visible) return;
+    FrameProfiler *profiler = &appCtx->frame_profiler;
+    int row_h = appCtx->line_h / 2 > 0 ? appCtx->line_h / 2 : 10;
+
+    SDL_Rect panel_rect = {WINDOW_W - 330, 0, 330, row_h * (PROFILE_STAGE_COUNT + 2) + 4};
+    SDL_SetRenderDrawBlendMode(appCtx->ren, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(appCtx->ren, 0, 0, 0, 200);
+    SDL_RenderFillRect(appCtx->ren, &panel_rect);
+    SDL_SetRenderDrawBlendMode(appCtx->ren, SDL_BLENDMODE_NONE);
+
+    SDL_Color text_color = {230, 230, 230, 255};
+    char min_buf[16], avg_buf[16], p99_buf[24];
+    int row_y = panel_rect.y + 2;
+    snprintf(p99_buf, sizeof(p99_buf), "p99 (%d fr)", profiler->history_count);
+    draw_overlay_row(appCtx, panel_rect.x + 6, row_y, (const char*[4]){"stage, ms", "min", "avg", p99_buf}, text_color);
+    row_y += row_h;
+
+    float sorted_ms[FRAME_PROFILER_HISTORY];
+    for (int stage = 0; stage <= PROFILE_STAGE_COUNT; stage++) {
+        float min_ms = 0.0f, avg_ms = 0.0f, p99_ms = 0.0f;
+        if (profiler->history_count > 0) {
+            memcpy(sorted_ms, profiler->history_ms[stage], (size_t)profiler->history_count * sizeof(float));
+            qsort(sorted_ms, (size_t)profiler->history_count, sizeof(float), compare_float_ascending);
+            double sum_ms = 0.0;
+            for (int i = 0; i < profiler->history_count; i++) sum_ms += sorted_ms[i];
+            int p99_rank = (profiler->history_count * 99 + 99) / 100; // Nearest rank
+            min_ms = sorted_ms[0];
+            avg_ms = (float)(sum_ms / profiler->history_count);
+            p99_ms = sorted_ms[p99_rank - 1];
+        }
+        snprintf(min_buf, sizeof(min_buf), "%.3f", min_ms);
+        snprintf(avg_buf, sizeof(avg_buf), "%.3f", avg_ms);
+        snprintf(p99_buf, sizeof(p99_buf), "%.3f", p99_ms);
+        draw_overlay_row(appCtx, panel_rect.x + 6, row_y, (const char*[4]){stage_names[stage], min_buf, avg_buf, p99_buf}, text_color);
+        row_y += row_h;
+    }
+    GlyphCacheFlushDraws(appCtx);
+}
+
+#endif // ENABLE_FRAME_PROFILER
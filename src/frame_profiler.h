@@ -0,0 +1,28 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include "app_context.h" // For AppContext, FrameProfiler, PROFILE_STAGE_*
+#include "config.h"      // For ENABLE_FRAME_PROFILER
+
+// Per-stage frame timing (SDL performance counter). Stages are measured back to back: each
+// FrameProfilerEndStage charges the time since the previous mark to its stage (PROFILE_STAGE_UNTRACKED
+// only moves the mark). Frames that are begun but never ended (nothing was drawn) are discarded.
+#if ENABLE_FRAME_PROFILER
+void FrameProfilerInit(AppContext *appCtx);     // Opens the CSV in the pref directory
+void FrameProfilerShutdown(AppContext *appCtx); // Closes the CSV
+void FrameProfilerBeginFrame(AppContext *appCtx);
+void FrameProfilerEndStage(AppContext *appCtx, int stage);
+void FrameProfilerEndFrame(AppContext *appCtx); // Adds the frame to the rolling window and the CSV
+void FrameProfilerToggleOverlay(AppContext *appCtx);
+void FrameProfilerRenderOverlay(AppContext *appCtx); // Rolling min/avg/p99 per stage, if the overlay is on
+#else
+#define FrameProfilerInit(appCtx) ((void)(appCtx))
+#define FrameProfilerShutdown(appCtx) ((void)(appCtx))
+#define FrameProfilerBeginFrame(appCtx) ((void)(appCtx))
+#define FrameProfilerEndStage(appCtx, stage) ((void)(appCtx))
+#define FrameProfilerEndFrame(appCtx) ((void)(appCtx))
+#define FrameProfilerToggleOverlay(appCtx) ((void)(appCtx))
+#define FrameProfilerRenderOverlay(appCtx) ((void)(appCtx))
+#endif
+
+#endif // FRAME_PROFILER_H
@@ -0,0 +1,358 @@
+#include "glyph_cache.h"
+#include "config.h"  // For GLYPH_TEXTURE_CACHE_BUCKETS, GLYPH_ATLAS_PAGE_SIZE, GLYPH_ATLAS_MAX_PAGES
+#include <stdio.h>   // For vfprintf
+#include <stdarg.h>  // For va_list
+#include <stdlib.h>  // For malloc, calloc, realloc, free
+#include <string.h>  // For memset
+
+#define GLYPH_ATLAS_PADDING 1 // Transparent border around each glyph so filtering never samples a neighbour
+#define GLYPH_PAGE_FAILED -2  // Entry page of a codepoint that could not be rendered or packed (not tried again)
+
+// Helper function for logging if appCtx->log_file_handle is available
+static void log_glyph_cache_message_format(AppContext *appCtx, const char* format, ...) {
+    if (appCtx && appCtx->log_file_handle && format) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(appCtx->log_file_handle, format, args);
+        va_end(args);
+        fprintf(appCtx->log_file_handle, "\n");
+        fflush(appCtx->log_file_handle);
+    }
+}
+
+static int glyph_bucket_for(Uint32 codepoint) {
+    return (int)(((codepoint * 2654435769u) >> 16) & (GLYPH_TEXTURE_CACHE_BUCKETS - 1));
+}
+
+bool GlyphCacheInit(AppContext *appCtx) {
+    if (!appCtx || !appCtx->ren) return false;
+    GlyphTextureCache *cache = &appCtx->glyph_texture_cache;
+    GlyphCacheFree(cache);
+
+    cache->buckets = (int*)malloc(GLYPH_TEXTURE_CACHE_BUCKETS * sizeof(int));
+    if (!cache->buckets) return false;
+    for (int i = 0; i < GLYPH_TEXTURE_CACHE_BUCKETS; i++) cache->buckets[i] = -1;
+    for (int c = 0; c < 128; c++) cache->ascii_entries[c] = -1;
+    cache->free_head = -1;
+
+    cache->page_size = GLYPH_ATLAS_PAGE_SIZE;
+    SDL_RendererInfo renderer_info;
+    if (SDL_GetRendererInfo(appCtx->ren, &renderer_info) == 0) {
+        if (renderer_info.max_texture_width > 0 && renderer_info.max_texture_width < cache->page_size) cache->page_size = renderer_info.max_texture_width;
+        if (renderer_info.max_texture_height > 0 && renderer_info.max_texture_height < cache->page_size) cache->page_size = renderer_info.max_texture_height;
+    }
+    log_glyph_cache_message_format(appCtx, "GlyphCache: atlas pages of %dx%d px, at most %d pages.", cache->page_size, cache->page_size, GLYPH_ATLAS_MAX_PAGES);
+    return true;
+}
+
+static int glyph_cache_alloc_entry(GlyphTextureCache *cache) {
+    if (cache->free_head >= 0) {
+        int idx = cache->free_head;
+        cache->free_head = cache->entries[idx].hash_next;
+        return idx;
+    }
+    if (cache->entry_count == cache->entry_capacity) {
+        int new_capacity = cache->entry_capacity ? cache->entry_capacity * 2 : 512;
+        GlyphTextureEntry *new_entries = (GlyphTextureEntry*)realloc(cache->entries, (size_t)new_capacity * sizeof(GlyphTextureEntry));
+        if (!new_entries) return -1;
+        cache->entries = new_entries;
+        cache->entry_capacity = new_capacity;
+    }
+    return cache->entry_count++;
+}
+
+static bool glyph_atlas_create_page(AppContext *appCtx) {
+    GlyphTextureCache *cache = &appCtx->glyph_texture_cache;
+    if (cache->page_count >= GLYPH_ATLAS_MAX_PAGES) return false;
+
+    GlyphAtlasPage *page = &cache->pages[cache->page_count];
+    memset(page, 0, sizeof(GlyphAtlasPage));
+    page->texture = SDL_CreateTexture(appCtx->ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, cache->page_size, cache->page_size);
+    if (!page->texture) {
+        log_glyph_cache_message_format(appCtx, "GlyphCache: Failed to create atlas page: %s", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(page->texture, SDL_BLENDMODE_BLEND);
+    cache->page_count++;
+    return true;
+}
+
+// Finds room for a w x h rect on page; returns false if the page is full
+static bool glyph_atlas_pack(GlyphTextureCache *cache, GlyphAtlasPage *page, int w, int h, SDL_Rect *out_rect) {
+    // Reuse a shelf of similar height so short glyphs do not waste tall rows
+    for (int i = 0; i < page->shelf_count; i++) {
+        if (h <= page->shelf_h[i] && h * 4 >= page->shelf_h[i] * 3 && page->shelf_x[i] + w <= cache->page_size) {
+            *out_rect = (SDL_Rect){page->shelf_x[i], page->shelf_y[i], w, h};
+            page->shelf_x[i] += w;
+            return true;
+        }
+    }
+    if (page->shelf_count < GLYPH_ATLAS_MAX_SHELVES && page->next_shelf_y + h <= cache->page_size && w <= cache->page_size) {
+        int i = page->shelf_count++;
+        page->shelf_y[i] = page->next_shelf_y;
+        page->shelf_h[i] = h;
+        page->shelf_x[i] = w;
+        page->next_shelf_y += h;
+        *out_rect = (SDL_Rect){0, page->shelf_y[i], w, h};
+        return true;
+    }
+    return false;
+}
+
+// Clears the least recently used unpinned page and drops every entry on it; returns its index or -1
+static int glyph_atlas_evict_page(AppContext *appCtx) {
+    GlyphTextureCache *cache = &appCtx->glyph_texture_cache;
+    int victim = -1;
+    for (int p = 0; p < cache->page_count; p++) {
+        if (cache->pages[p].pinned) continue;
+        if (victim < 0 || cache->pages[p].last_used_tick < cache->pages[victim].last_used_tick) victim = p;
+    }
+    if (victim < 0) return -1;
+
+    GlyphAtlasPage *page = &cache->pages[victim];
+    if (page->quad_count > 0) GlyphCacheFlushDraws(appCtx); // Quads queued this frame still need the old contents
+
+    // Rebuild the hash chains without the evicted entries (eviction is rare, lookups are not)
+    for (int i = 0; i < GLYPH_TEXTURE_CACHE_BUCKETS; i++) cache->buckets[i] = -1;
+    cache->free_head = -1;
+    for (int idx = cache->entry_count - 1; idx >= 0; idx--) {
+        GlyphTextureEntry *e = &cache->entries[idx];
+        if (e->page == victim) e->page = -1;
+        if (e->page == -1) { // Failed codepoints stay in their chains
+            e->hash_next = cache->free_head;
+            cache->free_head = idx;
+        } else {
+            int bucket = glyph_bucket_for(e->codepoint);
+            e->hash_next = cache->buckets[bucket];
+            cache->buckets[bucket] = idx;
+        }
+    }
+
+    page->shelf_count = 0;
+    page->next_shelf_y = 0;
+    cache->evictions++;
+    log_glyph_cache_message_format(appCtx, "GlyphCache: Evicted atlas page %d.", victim);
+    return victim;
+}
+
+// Copies surf into the atlas and registers it; returns the entry index or -1
+static int glyph_cache_insert_surface(AppContext *appCtx, Uint32 codepoint, SDL_Surface *surf, bool pinned) {
+    GlyphTextureCache *cache = &appCtx->glyph_texture_cache;
+    if (!cache->buckets || !surf || surf->w <= 0 || surf->h <= 0) return -1;
+
+    SDL_Surface *argb_surf = surf;
+    if (surf->format->format != SDL_PIXELFORMAT_ARGB8888) {
+        argb_surf = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ARGB8888, 0);
+        if (!argb_surf) return -1;
+    }
+
+    int padded_w = argb_surf->w + 2 * GLYPH_ATLAS_PADDING;
+    int padded_h = argb_surf->h + 2 * GLYPH_ATLAS_PADDING;
+    SDL_Rect slot;
+    int page_idx = -1;
+    // Newest pages first: they are the least likely to be full
+    for (int p = cache->page_count - 1; p >= 0 && page_idx < 0; p--) {
+        if (glyph_atlas_pack(cache, &cache->pages[p], padded_w, padded_h, &slot)) page_idx = p;
+    }
+    if (page_idx < 0 && glyph_atlas_create_page(appCtx)) {
+        if (glyph_atlas_pack(cache, &cache->pages[cache->page_count - 1], padded_w, padded_h, &slot)) page_idx = cache->page_count - 1;
+    }
+    if (page_idx < 0 && !pinned) {
+        int evicted = glyph_atlas_evict_page(appCtx);
+        if (evicted >= 0 && glyph_atlas_pack(cache, &cache->pages[evicted], padded_w, padded_h, &slot)) page_idx = evicted;
+    }
+
+    int idx = -1;
+    if (page_idx >= 0) idx = glyph_cache_alloc_entry(cache);
+    if (idx >= 0) {
+        GlyphAtlasPage *page = &cache->pages[page_idx];
+        // Clear the padded slot first: new pages are uninitialized and evicted pages hold old glyphs
+        void *clear_pixels = calloc((size_t)padded_w * (size_t)padded_h, 4);
+        if (clear_pixels) {
+            SDL_UpdateTexture(page->texture, &slot, clear_pixels, padded_w * 4);
+            free(clear_pixels);
+        }
+        SDL_Rect glyph_rect = {slot.x + GLYPH_ATLAS_PADDING, slot.y + GLYPH_ATLAS_PADDING, argb_surf->w, argb_surf->h};
+        SDL_UpdateTexture(page->texture, &glyph_rect, argb_surf->pixels, argb_surf->pitch);
+        if (pinned) page->pinned = true;
+        page->last_used_tick = ++cache->tick;
+
+        GlyphTextureEntry *e = &cache->entries[idx];
+        e->codepoint = codepoint;
+        e->page = page_idx;
+        e->src = glyph_rect;
+        int bucket = glyph_bucket_for(codepoint);
+        e->hash_next = cache->buckets[bucket];
+        cache->buckets[bucket] = idx;
+    } else {
+        log_glyph_cache_message_format(appCtx, "GlyphCache: No atlas space for U+%04X (%dx%d px).", codepoint, argb_surf->w, argb_surf->h);
+    }
+
+    if (argb_surf != surf) SDL_FreeSurface(argb_surf);
+    return idx;
+}
+
+// Remembers a codepoint that got no glyph, so it is neither rendered nor logged again on every draw
+static void glyph_cache_insert_failed(GlyphTextureCache *cache, Uint32 codepoint) {
+    int idx = glyph_cache_alloc_entry(cache);
+    if (idx < 0) return;
+    GlyphTextureEntry *e = &cache->entries[idx];
+    e->codepoint = codepoint;
+    e->page = GLYPH_PAGE_FAILED;
+    int bucket = glyph_bucket_for(codepoint);
+    e->hash_next = cache->buckets[bucket];
+    cache->buckets[bucket] = idx;
+}
+
+bool GlyphCacheAddAsciiSurface(AppContext *appCtx, int ascii_char, SDL_Surface *surf) {
+    if (!appCtx || ascii_char < 0 || ascii_char >= 128) return false;
+    int idx = glyph_cache_insert_surface(appCtx, (Uint32)ascii_char, surf, true);
+    appCtx->glyph_texture_cache.ascii_entries[ascii_char] = idx;
+    return idx >= 0;
+}
+
+int GlyphCacheLookup(AppContext *appCtx, Uint32 codepoint) {
+    if (!appCtx || !appCtx->font || !appCtx->ren) return -1;
+    GlyphTextureCache *cache = &appCtx->glyph_texture_cache;
+    if (!cache->buckets) return -1;
+
+    if (codepoint < 128) return cache->ascii_entries[codepoint];
+
+    for (int idx = cache->buckets[glyph_bucket_for(codepoint)]; idx >= 0; idx = cache->entries[idx].hash_next) {
+        GlyphTextureEntry *e = &cache->entries[idx];
+        if (e->codepoint == codepoint) {
+            if (e->page == GLYPH_PAGE_FAILED) return -1;
+            cache->hits++;
+            return idx;
+        }
+    }
+
+    cache->misses++;
+    SDL_Surface *surf = TTF_RenderGlyph32_Blended(appCtx->font, codepoint, (SDL_Color){255, 255, 255, 255}); // surf is hi-res
+    int idx = -1;
+    if (surf) {
+        idx = glyph_cache_insert_surface(appCtx, codepoint, surf, false);
+        SDL_FreeSurface(surf);
+    } else {
+        log_glyph_cache_message_format(appCtx, "GlyphCache: Surface error for U+%04X: %s", codepoint, TTF_GetError());
+    }
+    if (idx < 0) glyph_cache_insert_failed(cache, codepoint); // E.g. zero-width U+200B, drawn as nothing from now on
+    return idx;
+}
+
+void GlyphCacheQueueDraw(AppContext *appCtx, int entry_idx, const SDL_Rect *dst_logical, SDL_Color color) {
+    if (!appCtx || !dst_logical) return;
+    GlyphTextureCache *cache = &appCtx->glyph_texture_cache;
+    if (entry_idx < 0 || entry_idx >= cache->entry_count || cache->entries[entry_idx].page < 0) return;
+
+    GlyphTextureEntry *e = &cache->entries[entry_idx];
+    GlyphAtlasPage *page = &cache->pages[e->page];
+    page->last_used_tick = ++cache->tick;
+
+    if (page->quad_count == page->quad_capacity) {
+        int new_capacity = page->quad_capacity ? page->quad_capacity * 2 : 256;
+        GlyphQuad *new_quads = (GlyphQuad*)realloc(page->quads, (size_t)new_capacity * sizeof(GlyphQuad));
+        if (!new_quads) { // Draw it right away rather than lose it
+            SDL_SetTextureColorMod(page->texture, color.r, color.g, color.b);
+            SDL_SetTextureAlphaMod(page->texture, color.a);
+            SDL_RenderCopy(appCtx->ren, page->texture, &e->src, dst_logical);
+            SDL_SetTextureColorMod(page->texture, 255, 255, 255);
+            SDL_SetTextureAlphaMod(page->texture, 255);
+            return;
+        }
+        page->quads = new_quads;
+        page->quad_capacity = new_capacity;
+    }
+    page->quads[page->quad_count++] = (GlyphQuad){e->src, *dst_logical, color};
+}
+
+#if SDL_VERSION_ATLEAST(2,0,18)
+// Converts the page's quads into one SDL_RenderGeometry call; returns false if that is not possible
+static bool glyph_atlas_draw_page_geometry(AppContext *appCtx, GlyphAtlasPage *page) {
+    GlyphTextureCache *cache = &appCtx->glyph_texture_cache;
+    if (page->quad_count > cache->batch_capacity) {
+        int new_capacity = cache->batch_capacity ? cache->batch_capacity : 256;
+        while (new_capacity < page->quad_count) new_capacity *= 2;
+        SDL_Vertex *new_vertices = (SDL_Vertex*)realloc(cache->batch_vertices, (size_t)new_capacity * 4 * sizeof(SDL_Vertex));
+        if (!new_vertices) return false;
+        cache->batch_vertices = new_vertices;
+        int *new_indices = (int*)realloc(cache->batch_indices, (size_t)new_capacity * 6 * sizeof(int));
+        if (!new_indices) return false;
+        cache->batch_indices = new_indices;
+        // The index pattern never changes, so it is written once per growth
+        for (int q = cache->batch_capacity; q < new_capacity; q++) {
+            int *quad_indices = &cache->batch_indices[q * 6];
+            quad_indices[0] = q * 4 + 0; quad_indices[1] = q * 4 + 1; quad_indices[2] = q * 4 + 2;
+            quad_indices[3] = q * 4 + 2; quad_indices[4] = q * 4 + 1; quad_indices[5] = q * 4 + 3;
+        }
+        cache->batch_capacity = new_capacity;
+    }
+
+    const float inv_page_size = 1.0f / (float)cache->page_size;
+    for (int q = 0; q < page->quad_count; q++) {
+        const GlyphQuad *quad = &page->quads[q];
+        float x0 = (float)quad->dst.x, y0 = (float)quad->dst.y;
+        float x1 = (float)(quad->dst.x + quad->dst.w), y1 = (float)(quad->dst.y + quad->dst.h);
+        float u0 = (float)quad->src.x * inv_page_size, v0 = (float)quad->src.y * inv_page_size;
+        float u1 = (float)(quad->src.x + quad->src.w) * inv_page_size, v1 = (float)(quad->src.y + quad->src.h) * inv_page_size;
+        SDL_Vertex *v = &cache->batch_vertices[q * 4];
+        // Vertex colors multiply the white glyph, giving the palette color
+        v[0] = (SDL_Vertex){{x0, y0}, quad->color, {u0, v0}};
+        v[1] = (SDL_Vertex){{x1, y0}, quad->color, {u1, v0}};
+        v[2] = (SDL_Vertex){{x0, y1}, quad->color, {u0, v1}};
+        v[3] = (SDL_Vertex){{x1, y1}, quad->color, {u1, v1}};
+    }
+    return SDL_RenderGeometry(appCtx->ren, page->texture, cache->batch_vertices, page->quad_count * 4,
+                              cache->batch_indices, page->quad_count * 6) == 0;
+}
+#endif
+
+void GlyphCacheFlushDraws(AppContext *appCtx) {
+    if (!appCtx || !appCtx->ren) return;
+    GlyphTextureCache *cache = &appCtx->glyph_texture_cache;
+
+    for (int p = 0; p < cache->page_count; p++) {
+        GlyphAtlasPage *page = &cache->pages[p];
+        if (page->quad_count == 0) continue;
+
+        bool drawn = false;
+#if SDL_VERSION_ATLEAST(2,0,18)
+        if (!cache->geometry_unsupported) {
+            drawn = glyph_atlas_draw_page_geometry(appCtx, page);
+            if (!drawn) {
+                cache->geometry_unsupported = true;
+                log_glyph_cache_message_format(appCtx, "GlyphCache: SDL_RenderGeometry unavailable (%s), using SDL_RenderCopy.", SDL_GetError());
+            }
+        }
+#endif
+        if (!drawn) {
+            // Texture color modulation stands in for vertex colors; only changed when the color does
+            SDL_Color current_mod = {255, 255, 255, 255};
+            for (int q = 0; q < page->quad_count; q++) {
+                SDL_Color c = page->quads[q].color;
+                if (c.r != current_mod.r || c.g != current_mod.g || c.b != current_mod.b) SDL_SetTextureColorMod(page->texture, c.r, c.g, c.b);
+                if (c.a != current_mod.a) SDL_SetTextureAlphaMod(page->texture, c.a);
+                current_mod = c;
+                SDL_RenderCopy(appCtx->ren, page->texture, &page->quads[q].src, &page->quads[q].dst);
+            }
+            SDL_SetTextureColorMod(page->texture, 255, 255, 255);
+            SDL_SetTextureAlphaMod(page->texture, 255);
+        }
+        page->quad_count = 0;
+    }
+}
+
+void GlyphCacheFree(GlyphTextureCache *cache) {
+    if (!cache) return;
+    for (int p = 0; p < cache->page_count; p++) {
+        if (cache->pages[p].texture) SDL_DestroyTexture(cache->pages[p].texture);
+        free(cache->pages[p].quads);
+    }
+    free(cache->entries);
+    free(cache->buckets);
+#if SDL_VERSION_ATLEAST(2,0,18)
+    free(cache->batch_vertices);
+    free(cache->batch_indices);
+#endif
+    memset(cache, 0, sizeof(GlyphTextureCache));
+}
@@ -0,0 +1,22 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include "app_context.h" // For AppContext, GlyphTextureCache
+
+// Prepares an empty cache; call once the renderer exists
+bool GlyphCacheInit(AppContext *appCtx);
+
+// Packs a prebuilt white ASCII glyph surface into the atlas (its page is never evicted)
+bool GlyphCacheAddAsciiSurface(AppContext *appCtx, int ascii_char, SDL_Surface *surf);
+
+// Returns the entry of codepoint, rasterizing it in white on a miss; -1 on failure
+int GlyphCacheLookup(AppContext *appCtx, Uint32 codepoint);
+
+// Queues a glyph quad at dst_logical tinted with color; queued quads are drawn by GlyphCacheFlushDraws, one batch per page
+void GlyphCacheQueueDraw(AppContext *appCtx, int entry_idx, const SDL_Rect *dst_logical, SDL_Color color);
+void GlyphCacheFlushDraws(AppContext *appCtx);
+
+// Destroys all atlas pages (the renderer must still exist)
+void GlyphCacheFree(GlyphTextureCache *cache);
+
+#endif // GLYPH_CACHE_H
@@ -1,9 +1,199 @@
 #include "layout_logic.h"
-#include "text_processing.h" // For TextBlockInfo, get_next_text_block_func, get_codepoint_advance_and_metrics_func
-#include "utf8_utils.h"      // For decode_utf8
+#include "line_index.h"      // For LineIndexSeekOffset
+#include "block_table.h"     // For BlockTableFind, BLOCK_KIND_*
+#include "text_processing.h" // For TextBlockInfo, get_next_text_block_func, text_char_advance_and_metrics
+#include "utf8_utils.h"      // For decode_utf8_unchecked, CountUTF8Chars
 #include "config.h"          // For TEXT_AREA_X, TEXT_AREA_W, CURSOR_TARGET_VIEWPORT_LINE
 #include <stdio.h>           // For fprintf if logging is added here (e.g. in AppContext)
 
+// Advance of a single character at pen_x (tabs snap to the next tab stop)
+TEXT_LOOP_SPECIALIZED int char_advance_at_pen(AppContext *appCtx, Sint32 codepoint, int pen_x, bool ascii_text) {
+    if (codepoint == '\t') {
+        int offset_in_line = pen_x - TEXT_AREA_X;
+        int tab_adv = appCtx->tab_width_pixels - (offset_in_line % appCtx->tab_width_pixels);
+        if (tab_adv <= 0) tab_adv = appCtx->tab_width_pixels;
+        return tab_adv;
+    }
+    return text_char_advance_and_metrics(appCtx, codepoint, NULL, NULL, ascii_text);
+}
+
+// Fixed-width font: places char_count characters from (*pen_x, *abs_line_num) with integer arithmetic. Same result
+// as the per-character loops: a character that would cross the right edge starts a new line unless its line is empty.
+static void monospace_place_chars(int advance, size_t char_count, int *pen_x, int *abs_line_num) {
+    if (char_count == 0 || advance <= 0) return;
+    int line_end = TEXT_AREA_X + TEXT_AREA_W;
+    size_t chars_per_line = (size_t)(TEXT_AREA_W / advance);
+    if (chars_per_line == 0) chars_per_line = 1;
+    size_t fit_on_this_line = chars_per_line;
+    if (*pen_x != TEXT_AREA_X) fit_on_this_line = (*pen_x < line_end) ? (size_t)((line_end - *pen_x) / advance) : 0;
+
+    if (char_count <= fit_on_this_line) {
+        *pen_x += (int)char_count * advance;
+        return;
+    }
+    size_t chars_on_later_lines = char_count - fit_on_this_line;
+    *abs_line_num += (int)(1 + (chars_on_later_lines - 1) / chars_per_line);
+    *pen_x = TEXT_AREA_X + (int)((chars_on_later_lines - 1) % chars_per_line + 1) * advance;
+}
+
+// The block at pen_state->byte_offset, read from the block table (decoded from the text if the table cannot be used).
+// Also tells whether a run of spaces follows it, for the hanging-space check.
+static TextBlockInfo layout_block_at(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                                     const LayoutPenState *pen_state, bool *out_spaces_follow) {
+    const BlockTable *table = &appCtx->block_table;
+    size_t block_index;
+    TextBlockInfo block = {0};
+
+    if (BlockTableFind(appCtx, text_to_type, final_text_len, pen_state->byte_offset, &block_index)) {
+        Uint8 kind = table->kinds[block_index];
+        block.start_ptr = text_to_type + table->offsets[block_index];
+        block.num_bytes = table->offsets[block_index + 1] - table->offsets[block_index];
+        block.pixel_width = table->widths[block_index];
+        block.is_word = (kind & BLOCK_KIND_WORD) != 0;
+        block.is_newline = (kind & BLOCK_KIND_NEWLINE) != 0;
+        block.is_tab = (kind & BLOCK_KIND_TAB) != 0;
+        block.is_monospace = (kind & BLOCK_KIND_MONOSPACE) != 0;
+        if (block.is_tab) {
+            block.pixel_width = appCtx->tab_width_pixels > 0 ? char_advance_at_pen(appCtx, '\t', pen_state->pen_x, false)
+                                                              : appCtx->space_advance_width * TAB_SIZE_IN_SPACES;
+        }
+        *out_spaces_follow = block_index + 1 < table->count && (table->kinds[block_index + 1] & BLOCK_KIND_SPACES);
+        return block;
+    }
+
+    const char *p_end = text_to_type + final_text_len;
+    const char *p_iter = text_to_type + pen_state->byte_offset;
+    block = get_next_text_block_func(appCtx, &p_iter, p_end, pen_state->pen_x);
+    *out_spaces_follow = false;
+    if (block.is_word && p_iter < p_end) {
+        const char *temp_peek_ptr = p_iter; // p_iter already points to the beginning of the next block
+        TextBlockInfo next_block_peek = get_next_text_block_func(appCtx, &temp_peek_ptr, p_end, pen_state->pen_x + block.pixel_width);
+        if (next_block_peek.num_bytes > 0 && !next_block_peek.is_word && !next_block_peek.is_newline && !next_block_peek.is_tab) {
+            const char* space_char_ptr = next_block_peek.start_ptr;
+            *out_spaces_follow = decode_utf8_unchecked(&space_char_ptr, next_block_peek.start_ptr + next_block_peek.num_bytes) == ' ';
+        }
+    }
+    return block;
+}
+
+// Block wider than the rest of the line: wraps it character by character, as the renderer draws it
+TEXT_LOOP_SPECIALIZED void wrap_block_chars(AppContext *appCtx, const TextBlockInfo *block, int *pen_x, int *abs_line_num,
+                                            bool ascii_text) {
+    const char *p_char = block->start_ptr;
+    const char *p_block_end = block->start_ptr + block->num_bytes;
+    while (p_char < p_block_end) {
+        const char *p_char_before = p_char;
+        Sint32 cp = next_text_char(&p_char, p_block_end, ascii_text);
+        if (cp <= 0) {
+            if (p_char <= p_char_before) p_char = p_char_before + 1; // Guaranteed advancement
+            continue;
+        }
+        int adv = char_advance_at_pen(appCtx, cp, *pen_x, ascii_text);
+        if (*pen_x + adv > TEXT_AREA_X + TEXT_AREA_W && *pen_x != TEXT_AREA_X) {
+            (*abs_line_num)++;
+            *pen_x = TEXT_AREA_X;
+        }
+        *pen_x += adv;
+    }
+}
+
+bool LayoutNextBlock(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                     LayoutPenState *pen_state, LaidOutBlock *out_laid_block) {
+    if (!appCtx || !text_to_type || !pen_state || !out_laid_block) return false;
+    if (pen_state->byte_offset >= final_text_len) return false;
+
+    int pen_x_at_block_start = pen_state->pen_x;
+    int abs_line_num_at_block_start = pen_state->abs_line_num;
+
+    bool spaces_follow = false;
+    TextBlockInfo current_block = layout_block_at(appCtx, text_to_type, final_text_len, pen_state, &spaces_follow);
+
+    out_laid_block->block = current_block;
+    out_laid_block->start_offset = pen_state->byte_offset;
+    out_laid_block->abs_line_num = abs_line_num_at_block_start;
+    out_laid_block->x = pen_x_at_block_start;
+    out_laid_block->wrapped = false;
+    pen_state->byte_offset += current_block.num_bytes > 0 ? current_block.num_bytes : 1; // Ensure advancement
+
+    if (current_block.num_bytes == 0) { // Empty or invalid block: the pen does not move, callers skip it
+        return true;
+    }
+
+    if (current_block.is_newline) {
+        pen_state->abs_line_num = abs_line_num_at_block_start + 1;
+        pen_state->pen_x = TEXT_AREA_X;
+        return true;
+    }
+
+    bool must_wrap_this_block = false;
+    // Check for word wrap
+    if (pen_x_at_block_start != TEXT_AREA_X && // Not at the beginning of the line
+        (current_block.is_word || current_block.is_tab)) { // Only for words or tabs
+        if (pen_x_at_block_start + current_block.pixel_width > TEXT_AREA_X + TEXT_AREA_W) {
+            must_wrap_this_block = true;
+        }
+        else if (current_block.is_word && spaces_follow) { // Additional check for "hanging" spaces
+            // If the next block is space(s), and its first space doesn't fit
+            int pen_x_after_current_block = pen_x_at_block_start + current_block.pixel_width;
+            int space_width = get_codepoint_advance_and_metrics_func(appCtx, ' ', appCtx->space_advance_width, NULL, NULL);
+            if (space_width > 0 && (pen_x_after_current_block + space_width > TEXT_AREA_X + TEXT_AREA_W)) {
+                must_wrap_this_block = true; // Wrap the current word
+            }
+        }
+    }
+
+    int abs_line_num_for_block = abs_line_num_at_block_start;
+    int x_for_block_start = pen_x_at_block_start;
+    if (must_wrap_this_block) {
+        abs_line_num_for_block++;
+        x_for_block_start = TEXT_AREA_X;
+        out_laid_block->abs_line_num = abs_line_num_for_block;
+        out_laid_block->x = x_for_block_start;
+        out_laid_block->wrapped = true;
+    }
+
+    if (current_block.is_monospace && x_for_block_start + current_block.pixel_width > TEXT_AREA_X + TEXT_AREA_W) {
+        // Block is wider than the rest of the line, in a fixed-width font: wrap by character count
+        int pen_x = x_for_block_start;
+        monospace_place_chars(appCtx->monospace_advance, CountUTF8Chars(current_block.start_ptr, current_block.num_bytes),
+                              &pen_x, &abs_line_num_for_block);
+        pen_state->abs_line_num = abs_line_num_for_block;
+        pen_state->pen_x = pen_x;
+    } else if (!current_block.is_tab && x_for_block_start + current_block.pixel_width > TEXT_AREA_X + TEXT_AREA_W) {
+        int pen_x = x_for_block_start;
+        if (appCtx->text_is_ascii) wrap_block_chars(appCtx, &current_block, &pen_x, &abs_line_num_for_block, true);
+        else wrap_block_chars(appCtx, &current_block, &pen_x, &abs_line_num_for_block, false);
+        pen_state->abs_line_num = abs_line_num_for_block;
+        pen_state->pen_x = pen_x;
+    } else {
+        pen_state->abs_line_num = abs_line_num_for_block;
+        pen_state->pen_x = x_for_block_start + current_block.pixel_width;
+    }
+    return true;
+}
+
+// Moves (*cursor_x, *cursor_line_y) from the start of the block to the character at p_cursor, wrapping as
+// wrap_block_chars does; a cursor in the middle of a multi-byte character stays before it
+TEXT_LOOP_SPECIALIZED void advance_cursor_in_block(AppContext *appCtx, const TextBlockInfo *block, const char *p_cursor,
+                                                   int *cursor_x, int *cursor_line_y, bool ascii_text) {
+    const char *p_char = block->start_ptr;
+    const char *p_block_end = block->start_ptr + block->num_bytes;
+    while (p_char < p_cursor) {
+        const char *p_char_before = p_char;
+        Sint32 cp = next_text_char(&p_char, p_block_end, ascii_text);
+        if (cp <= 0) break; // Error or end
+        if (!ascii_text && p_char > p_cursor && p_cursor > p_char_before) break;
+
+        int adv = char_advance_at_pen(appCtx, cp, *cursor_x, ascii_text);
+        // Check for wrapping within a very long word (without spaces)
+        if (*cursor_x + adv > TEXT_AREA_X + TEXT_AREA_W && *cursor_x != TEXT_AREA_X && !block->is_tab) {
+            *cursor_line_y += appCtx->line_h; // Move to a new logical line
+            *cursor_x = TEXT_AREA_X;          // X position is reset
+        }
+        *cursor_x += adv; // Add character width
+    }
+}
+
 void CalculateCursorLayout(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
                            size_t current_input_byte_idx, int *out_cursor_abs_y_line_start, int *out_cursor_exact_x_on_line) {
     if (!appCtx || !text_to_type || !out_cursor_abs_y_line_start || !out_cursor_exact_x_on_line || !appCtx->font || appCtx->line_h <= 0) {
@@ -14,12 +204,6 @@ void CalculateCursorLayout(AppContext *appCtx, const char *text_to_type, size_t
 
     int calculated_cursor_y_abs_line_start = 0; // Y coordinate of the beginning of the line where the cursor is
     int calculated_cursor_x_on_this_line = TEXT_AREA_X; // Exact X position of the cursor on its line
-    int current_pen_x_on_line_iterator = TEXT_AREA_X; // X position for the current block
-    int current_abs_line_num_iterator = 0; // Absolute number of the current line
-
-    const char *p_iter = text_to_type; // Iterator through text
-    const char *p_end = text_to_type + final_text_len; // End of text
-    size_t processed_bytes_total_iterator = 0; // Number of processed bytes
     bool cursor_position_found_this_pass = false; // Flag indicating if cursor position has been found
 
     // If the cursor is at the very beginning
@@ -29,135 +213,55 @@ void CalculateCursorLayout(AppContext *appCtx, const char *text_to_type, size_t
         return;
     }
 
-    while(p_iter < p_end && !cursor_position_found_this_pass) {
-        size_t bytes_at_block_start = processed_bytes_total_iterator;
-        int pen_x_at_block_start_on_current_line = current_pen_x_on_line_iterator;
-        int abs_line_num_at_block_start = current_abs_line_num_iterator;
-
-        const char* p_iter_before_get_next_block = p_iter;
-        TextBlockInfo current_block = get_next_text_block_func(appCtx, &p_iter, p_end, pen_x_at_block_start_on_current_line);
+    // Resume from the nearest indexed line start instead of walking from byte 0
+    LayoutPenState pen_state;
+    LineIndexSeekOffset(appCtx, text_to_type, final_text_len, current_input_byte_idx, &pen_state);
 
-        if (current_block.num_bytes == 0) { // Skip empty or invalid blocks
-            if(p_iter < p_end && p_iter == p_iter_before_get_next_block) {p_iter++;} // Ensure advancement
-            if (p_iter > p_iter_before_get_next_block) {
-                 processed_bytes_total_iterator = (size_t)(p_iter - text_to_type);
-            } // else processed_bytes_total_iterator does not change if p_iter did not advance
-            if (p_iter >= p_end) break;
-            continue;
-        }
-
-        // Initial coordinates for characters in this block
-        int y_for_chars_in_this_block_abs_line_start = abs_line_num_at_block_start * appCtx->line_h;
-        int x_for_chars_in_this_block_start_on_line = pen_x_at_block_start_on_current_line;
-
-        if (current_block.is_newline) {
-            current_abs_line_num_iterator = abs_line_num_at_block_start + 1;
-            current_pen_x_on_line_iterator = TEXT_AREA_X;
-            // Y coordinate for the \n character itself remains on the current line
-            y_for_chars_in_this_block_abs_line_start = (abs_line_num_at_block_start) * appCtx->line_h;
-             // X for \n is not important, but logically it's at the beginning of the next one
-            x_for_chars_in_this_block_start_on_line = TEXT_AREA_X;
-        } else { // Not a new line
-            bool must_wrap_this_block = false;
-            // Check for word wrap
-            if (pen_x_at_block_start_on_current_line != TEXT_AREA_X && // Not at the beginning of the line
-                (current_block.is_word || current_block.is_tab)) { // Only for words or tabs
-                if (pen_x_at_block_start_on_current_line + current_block.pixel_width > TEXT_AREA_X + TEXT_AREA_W) {
-                    must_wrap_this_block = true;
-                }
-                else if (current_block.is_word) { // Additional check for "hanging" spaces
-                    const char *p_peek_next = p_iter; // p_iter already points to the beginning of the next block
-                    if (p_peek_next < p_end) {
-                        const char *temp_peek_ptr = p_peek_next;
-                        int pen_x_after_current_block = pen_x_at_block_start_on_current_line + current_block.pixel_width;
-                        TextBlockInfo next_block_peek = get_next_text_block_func(appCtx, &temp_peek_ptr, p_end, pen_x_after_current_block);
-
-                        // If the next block is space(s), and it doesn't fit
-                        if (next_block_peek.num_bytes > 0 && !next_block_peek.is_word && !next_block_peek.is_newline && !next_block_peek.is_tab) {
-                            const char* space_char_ptr = next_block_peek.start_ptr;
-                            Sint32 cp_space = decode_utf8(&space_char_ptr, next_block_peek.start_ptr + next_block_peek.num_bytes);
-                            if (cp_space == ' ') { // Check the first character of the space block
-                                int space_width = get_codepoint_advance_and_metrics_func(appCtx, (Uint32)cp_space, appCtx->space_advance_width, NULL, NULL);
-                                if (space_width > 0 && (pen_x_after_current_block + space_width > TEXT_AREA_X + TEXT_AREA_W)) {
-                                    must_wrap_this_block = true; // Wrap the current word
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-
-            if (must_wrap_this_block) {
-                current_abs_line_num_iterator = abs_line_num_at_block_start + 1;
-                y_for_chars_in_this_block_abs_line_start = current_abs_line_num_iterator * appCtx->line_h;
-                x_for_chars_in_this_block_start_on_line = TEXT_AREA_X;
-            }
-            current_pen_x_on_line_iterator = x_for_chars_in_this_block_start_on_line + current_block.pixel_width;
-        }
+    LaidOutBlock laid;
+    while (!cursor_position_found_this_pass &&
+           LayoutNextBlock(appCtx, text_to_type, final_text_len, &pen_state, &laid)) {
+        if (laid.block.num_bytes == 0) continue; // Skip empty or invalid blocks
 
         // If the cursor is inside the current block
-        if (!cursor_position_found_this_pass &&
-            current_input_byte_idx >= bytes_at_block_start &&
-            current_input_byte_idx < bytes_at_block_start + current_block.num_bytes) {
-
-            calculated_cursor_y_abs_line_start = y_for_chars_in_this_block_abs_line_start;
-            calculated_cursor_x_on_this_line = x_for_chars_in_this_block_start_on_line; // Start with the X of the block's beginning on its line
-
-            const char* p_char_iter_in_block = current_block.start_ptr;
-            const char* target_cursor_ptr_in_text = text_to_type + current_input_byte_idx; // Where the cursor should be
-
-            // Iterate through characters within the block up to the cursor position
-            while (p_char_iter_in_block < target_cursor_ptr_in_text &&
-                   p_char_iter_in_block < current_block.start_ptr + current_block.num_bytes) { // Do not go beyond the block limits
-                const char* temp_char_start_in_block_loop = p_char_iter_in_block;
-                Sint32 cp_in_block = decode_utf8(&p_char_iter_in_block, p_end); // p_char_iter_in_block advances
-
-                if (cp_in_block <= 0 ) { // Error or end
-                    if (p_char_iter_in_block <= temp_char_start_in_block_loop) p_char_iter_in_block = temp_char_start_in_block_loop + 1; // Guaranteed advancement
-                    break;
-                }
-                // Important: if p_char_iter_in_block JUMPED OVER target_cursor_ptr_in_text,
-                // it means the cursor is before the current cp_in_block.
-                // Then calculated_cursor_x_on_this_line is already correct.
-                if (p_char_iter_in_block > target_cursor_ptr_in_text && target_cursor_ptr_in_text > temp_char_start_in_block_loop) {
-                     p_char_iter_in_block = temp_char_start_in_block_loop; // Rollback to avoid adding the width of this character
-                    break;
-                }
-
-
-                int adv_char_in_block = 0;
-                if (current_block.is_tab && cp_in_block == '\t') { // Special handling for tab within a block (unlikely, but possible)
-                    int offset_in_line_inner = calculated_cursor_x_on_this_line - TEXT_AREA_X;
-                    adv_char_in_block = appCtx->tab_width_pixels - (offset_in_line_inner % appCtx->tab_width_pixels);
-                    if (adv_char_in_block == 0 && offset_in_line_inner >=0) adv_char_in_block = appCtx->tab_width_pixels;
-                    if (adv_char_in_block <=0) adv_char_in_block = appCtx->tab_width_pixels;
+        if (current_input_byte_idx >= laid.start_offset &&
+            current_input_byte_idx < laid.start_offset + laid.block.num_bytes) {
+
+            calculated_cursor_y_abs_line_start = laid.abs_line_num * appCtx->line_h;
+            // X for \n is not important, but logically it's at the beginning of the next one
+            calculated_cursor_x_on_this_line = laid.block.is_newline ? TEXT_AREA_X : laid.x;
+
+            if (laid.block.is_monospace) {
+                // Fixed-width font: count the characters before the cursor instead of measuring them
+                size_t chars_before_cursor = CountUTF8Chars(laid.block.start_ptr, current_input_byte_idx - laid.start_offset);
+                // The cursor is in the middle of a multi-byte character: it stays before it
+                if (((unsigned char)text_to_type[current_input_byte_idx] & 0xC0) == 0x80) chars_before_cursor--;
+                int cursor_abs_line_num = laid.abs_line_num;
+                monospace_place_chars(appCtx->monospace_advance, chars_before_cursor, &calculated_cursor_x_on_this_line, &cursor_abs_line_num);
+                calculated_cursor_y_abs_line_start = cursor_abs_line_num * appCtx->line_h;
+            } else if (!laid.block.is_newline) {
+                const char* target_cursor_ptr_in_text = text_to_type + current_input_byte_idx; // Where the cursor should be
+                if (appCtx->text_is_ascii) {
+                    advance_cursor_in_block(appCtx, &laid.block, target_cursor_ptr_in_text, &calculated_cursor_x_on_this_line,
+                                            &calculated_cursor_y_abs_line_start, true);
                 } else {
-                    adv_char_in_block = get_codepoint_advance_and_metrics_func(appCtx, (Uint32)cp_in_block, appCtx->space_advance_width, NULL, NULL);
-                }
-
-                // Check for wrapping within a very long word (without spaces)
-                if (calculated_cursor_x_on_this_line + adv_char_in_block > TEXT_AREA_X + TEXT_AREA_W && calculated_cursor_x_on_this_line != TEXT_AREA_X ) {
-                    calculated_cursor_y_abs_line_start += appCtx->line_h; // Move to a new logical line
-                    calculated_cursor_x_on_this_line = TEXT_AREA_X;    // X position is reset
+                    advance_cursor_in_block(appCtx, &laid.block, target_cursor_ptr_in_text, &calculated_cursor_x_on_this_line,
+                                            &calculated_cursor_y_abs_line_start, false);
                 }
-                calculated_cursor_x_on_this_line += adv_char_in_block; // Add character width
             }
             cursor_position_found_this_pass = true;
         }
-        processed_bytes_total_iterator = (size_t)(p_iter - text_to_type); // Update the total number of processed bytes
-
         // If the cursor is exactly at the end of the current block
-        if (!cursor_position_found_this_pass && processed_bytes_total_iterator == current_input_byte_idx) {
-            calculated_cursor_x_on_this_line = current_pen_x_on_line_iterator; // X is the end of the current block
-            calculated_cursor_y_abs_line_start = current_abs_line_num_iterator * appCtx->line_h; // Y is the beginning of the current line
+        else if (pen_state.byte_offset == current_input_byte_idx) {
+            calculated_cursor_x_on_this_line = pen_state.pen_x; // X is the end of the current block
+            calculated_cursor_y_abs_line_start = pen_state.abs_line_num * appCtx->line_h; // Y is the beginning of the current line
             cursor_position_found_this_pass = true;
         }
     }
 
     // If the cursor is at the very end of the text (after all blocks)
     if (!cursor_position_found_this_pass && current_input_byte_idx == final_text_len) {
-        calculated_cursor_x_on_this_line = current_pen_x_on_line_iterator;
-        calculated_cursor_y_abs_line_start = current_abs_line_num_iterator * appCtx->line_h;
+        calculated_cursor_x_on_this_line = pen_state.pen_x;
+        calculated_cursor_y_abs_line_start = pen_state.abs_line_num * appCtx->line_h;
     }
 
     *out_cursor_abs_y_line_start = calculated_cursor_y_abs_line_start;
@@ -233,7 +337,7 @@ void PerformPredictiveScrollUpdate(AppContext *appCtx,
             size_t next_char_byte_idx_in_doc = 0;
             const char* p_next_char_scanner = text_to_type + current_input_byte_idx;
             const char* temp_scan_ptr_next = p_next_char_scanner;
-            Sint32 cp_next_char = decode_utf8(&temp_scan_ptr_next, text_to_type + final_text_len);
+            Sint32 cp_next_char = decode_utf8_unchecked(&temp_scan_ptr_next, text_to_type + final_text_len);
 
             if (cp_next_char > 0 && temp_scan_ptr_next > p_next_char_scanner) {
                 next_char_byte_idx_in_doc = (size_t)(temp_scan_ptr_next - text_to_type);
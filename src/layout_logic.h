@@ -2,6 +2,21 @@
 #define LAYOUT_LOGIC_H
 
 #include "app_context.h"
+#include "text_processing.h" // For TextBlockInfo
+
+// One block placed by the word-wrap walker
+typedef struct {
+    TextBlockInfo block;
+    size_t start_offset; // Byte offset of the block in the text
+    int abs_line_num;    // Line on which the block's first character lands (after word wrap)
+    int x;               // Logical X of the block's first character
+    bool wrapped;        // The whole block was moved to a new line
+} LaidOutBlock;
+
+// Lays out the block at pen_state->byte_offset and advances pen_state past it.
+// Returns false when there is nothing left to lay out.
+bool LayoutNextBlock(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                     LayoutPenState *pen_state, LaidOutBlock *out_laid_block);
 
 void CalculateCursorLayout(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
                            size_t current_input_byte_idx, int *out_cursor_abs_y_line_start, int *out_cursor_exact_x_on_line);
@@ -14,4 +29,4 @@ void PerformPredictiveScrollUpdate(AppContext *appCtx,
                                    size_t final_text_len,
                                    size_t current_input_byte_idx,
                                    int current_logical_cursor_abs_y);
-#endif // LAYOUT_LOGIC_H
\ No newline at end of file
+#endif // LAYOUT_LOGIC_H
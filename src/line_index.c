@@ -0,0 +1,121 @@
+#include "line_index.h"
+#include "layout_logic.h" // For LayoutNextBlock, LaidOutBlock
+#include "config.h"       // For TEXT_AREA_X
+#include <stdlib.h>       // For realloc, free
+#include <string.h>       // For memset
+
+// The index only stores lines that start cleanly at TEXT_AREA_X (first line, after '\n', after a word wrap).
+// Lines that begin in the middle of a character-wrapped long word have no entry; seeks fall back to
+// the entry before that word, so a walk from any entry is still bounded by a few lines.
+
+void LineIndexReset(LineIndex *index) {
+    if (!index) return;
+    index->count = 0;
+    index->frontier = (LayoutPenState){0, 0, TEXT_AREA_X};
+    index->frontier_at_end = false;
+    index->indexed_text = NULL;
+    index->indexed_text_len = 0;
+}
+
+void LineIndexFree(LineIndex *index) {
+    if (!index) return;
+    free(index->line_starts);
+    memset(index, 0, sizeof(LineIndex));
+}
+
+void LineIndexTextExtended(LineIndex *index, const char *text_to_type, size_t final_text_len) {
+    if (!index || !index->indexed_text || final_text_len < index->indexed_text_len) return; // Rebuilt on the next seek
+    index->indexed_text = text_to_type;
+    index->indexed_text_len = final_text_len;
+    if (index->frontier.byte_offset < final_text_len) index->frontier_at_end = false; // Resumes where the old text ended
+}
+
+static bool line_index_push(LineIndex *index, LayoutPenState entry) {
+    if (index->count == index->capacity) {
+        size_t new_capacity = index->capacity ? index->capacity * 2 : 1024;
+        LayoutPenState *new_entries = (LayoutPenState*)realloc(index->line_starts, new_capacity * sizeof(LayoutPenState));
+        if (!new_entries) return false;
+        index->line_starts = new_entries;
+        index->capacity = new_capacity;
+    }
+    index->line_starts[index->count++] = entry;
+    return true;
+}
+
+// Makes sure the index belongs to this text and has its first entry
+static bool line_index_prepare(LineIndex *index, const char *text_to_type, size_t final_text_len) {
+    if (index->indexed_text != text_to_type || index->indexed_text_len != final_text_len || index->count == 0) {
+        LineIndexReset(index);
+        index->indexed_text = text_to_type;
+        index->indexed_text_len = final_text_len;
+        if (!line_index_push(index, (LayoutPenState){0, 0, TEXT_AREA_X})) return false;
+        index->frontier_at_end = (final_text_len == 0);
+    }
+    return true;
+}
+
+// Walks blocks from the frontier until it passes stop_offset and stop_line (or the text ends)
+static void line_index_extend(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                              size_t stop_offset, int stop_line) {
+    LineIndex *index = &appCtx->line_index;
+    LaidOutBlock laid;
+
+    while (!index->frontier_at_end &&
+           (index->frontier.byte_offset <= stop_offset || index->frontier.abs_line_num <= stop_line)) {
+        LayoutPenState state_before_block = index->frontier;
+        if (!LayoutNextBlock(appCtx, text_to_type, final_text_len, &index->frontier, &laid)) {
+            index->frontier_at_end = true;
+            break;
+        }
+
+        int last_indexed_line = index->line_starts[index->count - 1].abs_line_num;
+        if (laid.abs_line_num > last_indexed_line) {
+            // Resuming at TEXT_AREA_X skips the wrap check, so a wrapped block lands exactly where it did here
+            if (laid.wrapped) {
+                line_index_push(index, (LayoutPenState){laid.start_offset, laid.abs_line_num, TEXT_AREA_X});
+            } else if (state_before_block.pen_x == TEXT_AREA_X) {
+                line_index_push(index, state_before_block);
+            }
+        }
+        if (index->frontier.byte_offset >= final_text_len) index->frontier_at_end = true;
+    }
+}
+
+void LineIndexSeekOffset(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                         size_t byte_offset, LayoutPenState *out_pen_state) {
+    if (!out_pen_state) return;
+    *out_pen_state = (LayoutPenState){0, 0, TEXT_AREA_X};
+    if (!appCtx || !text_to_type) return;
+
+    LineIndex *index = &appCtx->line_index;
+    if (!line_index_prepare(index, text_to_type, final_text_len)) return;
+    line_index_extend(appCtx, text_to_type, final_text_len, byte_offset, -1);
+
+    // Last entry strictly before byte_offset: a cursor sitting on a block start belongs to the end of
+    // the previous block, which the walk from this entry still visits.
+    size_t lo = 0, hi = index->count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->line_starts[mid].byte_offset < byte_offset) lo = mid; else hi = mid;
+    }
+    *out_pen_state = index->line_starts[lo];
+}
+
+void LineIndexSeekLine(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                       int abs_line_num, LayoutPenState *out_pen_state) {
+    if (!out_pen_state) return;
+    *out_pen_state = (LayoutPenState){0, 0, TEXT_AREA_X};
+    if (!appCtx || !text_to_type || abs_line_num <= 0) return;
+
+    LineIndex *index = &appCtx->line_index;
+    if (!line_index_prepare(index, text_to_type, final_text_len)) return;
+    line_index_extend(appCtx, text_to_type, final_text_len, 0, abs_line_num);
+
+    // Last entry whose line is not after abs_line_num; everything before it lies on earlier lines
+    size_t lo = 0, hi = index->count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->line_starts[mid].abs_line_num <= abs_line_num) lo = mid; else hi = mid;
+    }
+    *out_pen_state = index->line_starts[lo];
+}
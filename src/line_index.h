@@ -0,0 +1,22 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include "app_context.h" // For LineIndex, LayoutPenState
+
+// Drops all entries (e.g. when the text or the font metrics change)
+void LineIndexReset(LineIndex *index);
+void LineIndexFree(LineIndex *index);
+// The text grew at its end (and may have moved). Entries are kept: the old text must end with a whole block
+// whose wrapping does not depend on what follows (e.g. after a space or line break, see text_loader.c).
+void LineIndexTextExtended(LineIndex *index, const char *text_to_type, size_t final_text_len);
+
+// Returns the pen state from which a walk reaches byte_offset without skipping the block that ends there.
+// The index is extended lazily up to byte_offset; the lookup itself is a binary search.
+void LineIndexSeekOffset(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                         size_t byte_offset, LayoutPenState *out_pen_state);
+
+// Returns the pen state from which a walk covers every block on abs_line_num.
+void LineIndexSeekLine(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
+                       int abs_line_num, LayoutPenState *out_pen_state);
+
+#endif // LINE_INDEX_H
@@ -3,21 +3,58 @@
 #include "config.h"
 #include "app_context.h"
 #include "file_paths.h"
+#include "text_loader.h"
+#include "progress_checkpoint.h"
 #include "text_processing.h"
 #include "event_handler.h"
 #include "layout_logic.h"
 #include "rendering.h"
 #include "stats_handler.h"
+#include "frame_profiler.h"
+#include "text_stats.h"
+#include "replacement_rules.h"
 
-#include <SDL2/SDL.h> // For SDL_Delay, SDL_GetTicks, SDL_StartTextInput, SDL_StopTextInput
+#include <SDL2/SDL.h> // For SDL_WaitEventTimeout, SDL_GetTicks, SDL_StartTextInput, SDL_StopTextInput
 #include <stdio.h>    // For perror
-#include <stdlib.h>   // For free, calloc
+#include <stdlib.h>   // For free, calloc, realloc
+#include <string.h>   // For strcmp, memset
+#ifdef _WIN32
+#include <io.h>       // For _setmode, _fileno
+#include <fcntl.h>    // For _O_BINARY
+#endif
+
+// Seconds shown by the session timer (0 before typing starts; frozen while paused)
+static Uint32 displayed_timer_second(const AppContext *appCtx) {
+    if (!appCtx->typing_started) return 0;
+    Uint32 elapsed_ms = appCtx->is_paused ? (appCtx->time_at_pause_ms - appCtx->start_time_ms)
+                                          : (SDL_GetTicks() - appCtx->start_time_ms);
+    return elapsed_ms / 1000;
+}
+
+// Milliseconds until the next cursor blink or timer tick, or -1 if nothing will change without input.
+// The cursor only blinks in the focused window, but the timer keeps running (and showing) without focus.
+static int next_redraw_timeout_ms(const AppContext *appCtx, Uint32 last_blink_time) {
+    if (appCtx->window_minimized || appCtx->is_paused) return -1;
+
+    Uint32 now_ms = SDL_GetTicks();
+    int timeout_ms = -1;
+    if (appCtx->window_has_focus) {
+        Uint32 since_blink_ms = now_ms - last_blink_time;
+        timeout_ms = since_blink_ms >= CURSOR_BLINK_INTERVAL_MS ? 0 : (int)(CURSOR_BLINK_INTERVAL_MS - since_blink_ms);
+    }
 
-int main(int argc, char **argv) {
-    (void)argc; (void)argv; // Suppress warnings about unused parameters
+    if (appCtx->typing_started) {
+        int until_next_second_ms = (int)(1000 - (now_ms - appCtx->start_time_ms) % 1000);
+        if (timeout_ms < 0 || until_next_second_ms < timeout_ms) timeout_ms = until_next_second_ms;
+    }
+    return timeout_ms;
+}
 
+int main(int argc, char **argv) {
     AppContext appCtx = {0}; // Initialize with zeros
     FilePaths filePaths = {0}; // Initialize paths with zeros
+    ProgressSaver progressSaver = {0};
+    bool text_from_stdin = (argc > 1 && strcmp(argv[1], "-") == 0); // "TypingApp -" practices on piped text
 
     // Initialization of SDL, TTF, window, renderer, font, log file, etc.
     // Log file is initialized inside InitializeApp
@@ -33,37 +70,52 @@ int main(int argc, char **argv) {
 
 
     InitializeFilePaths(&appCtx, &filePaths); // Initialize file paths
-
-    size_t raw_text_len = 0;
-    char *raw_text_content = LoadInitialText(&appCtx, &filePaths, &raw_text_len);
-    if (!raw_text_content) {
-        if (appCtx.log_file_handle) fprintf(appCtx.log_file_handle, "CRITICAL: Failed to load initial text content in main.\n");
-        CleanupApp(&appCtx);
-        return 1;
+    FrameProfilerInit(&appCtx); // No-op unless ENABLE_FRAME_PROFILER
+    ReplacementRulesLoad(&appCtx, filePaths.actual_rules_file_path); // Built-in rules plus the optional rules file
+
+    // Where the last session on text.txt stopped; a session that crashed still gets its stats recorded
+    ProgressRecord progress_record = {0};
+    bool resume_progress = !text_from_stdin && ProgressCheckpointLoad(&appCtx, filePaths.actual_progress_file_path, &progress_record);
+    if (resume_progress && progress_record.session_open) {
+        RecordRecoveredSessionStats(&appCtx, filePaths.actual_stats_file_path,
+                                    progress_record.total_keystrokes, progress_record.total_errors, progress_record.elapsed_ms);
+        progress_record.session_open = false;
+        ProgressCheckpointWrite(&appCtx, filePaths.actual_progress_file_path, &progress_record); // Recorded once only
     }
 
-    size_t final_text_len = 0;
-    char *text_to_type = PreprocessText(&appCtx, raw_text_content, raw_text_len, &final_text_len);
-    free(raw_text_content); // raw_text_content is no longer needed
-    raw_text_content = NULL;
-
-    if (!text_to_type) {
-        if (appCtx.log_file_handle) fprintf(appCtx.log_file_handle, "CRITICAL: Failed to preprocess text in main.\n");
+    // The start of the text is loaded now, the rest on a background thread (see the main loop)
+    FILE *text_source = NULL;
+    if (text_from_stdin) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY); // UTF-16 and '\r' bytes are converted by the loader
+#endif
+        text_source = stdin;
+    } else {
+        text_source = OpenInitialText(&appCtx, &filePaths);
+    }
+    TextLoader *textLoader = TextLoaderStart(&appCtx, text_source, text_from_stdin, GetPlaceholderText(),
+                                             resume_progress ? &progress_record : NULL);
+    if (!textLoader) {
+        if (appCtx.log_file_handle) fprintf(appCtx.log_file_handle, "CRITICAL: Failed to load initial text content in main.\n");
         CleanupApp(&appCtx);
         return 1;
     }
-    if (appCtx.log_file_handle && final_text_len == 0) {
-        fprintf(appCtx.log_file_handle, "Warning from main: Text content after preprocessing is empty.\n");
-         fflush(appCtx.log_file_handle);
+    const char *text_to_type = NULL;
+    size_t final_text_len = 0; // Grows while the text loads
+    TextLoaderPoll(&appCtx, textLoader, &text_to_type, &final_text_len);
+    if (!text_from_stdin) {
+        ProgressSaverStart(&appCtx, &progressSaver, filePaths.actual_progress_file_path, filePaths.actual_text_file_path,
+                           textLoader->start_offset);
     }
 
 
-    // Buffer for user-entered text. +100 for a small margin.
-    char *input_buffer = (char*)calloc(final_text_len + 100, 1);
+    // Buffer for user-entered text. +100 for a small margin. Enlarged with the text.
+    size_t input_buffer_capacity = final_text_len + 100;
+    char *input_buffer = (char*)calloc(input_buffer_capacity, 1);
     if (!input_buffer && (final_text_len + 100 > 0)) { // Check if calloc did not return NULL
         perror("Failed to allocate input buffer in main");
         if (appCtx.log_file_handle) fprintf(appCtx.log_file_handle, "CRITICAL: Failed to allocate input buffer in main.\n");
-        free(text_to_type);
+        TextLoaderFree(textLoader);
         CleanupApp(&appCtx);
         return 1;
     }
@@ -71,21 +123,53 @@ int main(int argc, char **argv) {
     size_t current_input_byte_idx = 0;
     bool show_cursor_flag = true;
     Uint32 last_blink_time = SDL_GetTicks();
+    Uint32 last_drawn_timer_second = 0; // Timer value on screen, to redraw when it ticks
     bool quit_game_flag = false;
 
     SDL_StartTextInput(); // Start accepting text input
 
-    // Main program loop
+    // Main program loop: sleep until input or the next visible change, then redraw only if needed
     while (!quit_game_flag) {
         SDL_Event event;
         size_t old_input_idx = current_input_byte_idx; // To check for input index change
 
+        if (!appCtx.needs_redraw) {
+            int wait_timeout_ms = next_redraw_timeout_ms(&appCtx, last_blink_time);
+            int checkpoint_timeout_ms = ProgressSaverTimeoutMs(&progressSaver); // Unsaved progress is saved even when idle
+            if (checkpoint_timeout_ms >= 0 && (wait_timeout_ms < 0 || checkpoint_timeout_ms < wait_timeout_ms)) {
+                wait_timeout_ms = checkpoint_timeout_ms;
+            }
+            if (wait_timeout_ms < 0) {
+                SDL_WaitEvent(NULL); // Nothing animates (paused, minimized, or unfocused before typing): wait for input only
+            } else if (wait_timeout_ms > 0) {
+                SDL_WaitEventTimeout(NULL, wait_timeout_ms);
+            }
+        }
+
+        // Text loaded in the background since the last iteration
+        if (TextLoaderPoll(&appCtx, textLoader, &text_to_type, &final_text_len) && final_text_len + 100 > input_buffer_capacity) {
+            size_t new_capacity = input_buffer_capacity * 2 > final_text_len + 100 ? input_buffer_capacity * 2 : final_text_len + 100;
+            char *grown_input_buffer = (char*)realloc(input_buffer, new_capacity);
+            if (!grown_input_buffer) {
+                perror("Failed to grow input buffer in main");
+                if (appCtx.log_file_handle) fprintf(appCtx.log_file_handle, "CRITICAL: Failed to grow input buffer in main; ending the session.\n");
+                break; // Stats and the remaining text are still saved
+            }
+            memset(grown_input_buffer + input_buffer_capacity, 0, new_capacity - input_buffer_capacity);
+            input_buffer = grown_input_buffer;
+            input_buffer_capacity = new_capacity;
+        }
+
+        FrameProfilerBeginFrame(&appCtx); // Discarded unless this iteration draws a frame
         HandleAppEvents(&appCtx, &event, &current_input_byte_idx, input_buffer,
                         final_text_len, text_to_type, &quit_game_flag,
                         filePaths.actual_text_file_path, filePaths.actual_stats_file_path);
+        FrameProfilerEndStage(&appCtx, PROFILE_STAGE_EVENTS);
 
         if (quit_game_flag) break;
 
+        ProgressSaverUpdate(&appCtx, &progressSaver, text_to_type, final_text_len, current_input_byte_idx);
+
         // If the input index changed, reset predictive scroll flags
         if (current_input_byte_idx != old_input_idx) {
             appCtx.predictive_scroll_triggered_this_input_idx = false;
@@ -93,13 +177,49 @@ int main(int argc, char **argv) {
         }
 
         // Update cursor blink state
-        if (!appCtx.is_paused && SDL_GetTicks() - last_blink_time > 500) {
+        Uint32 now_ms = SDL_GetTicks();
+        bool window_active = !appCtx.window_minimized && appCtx.window_has_focus;
+        if (!appCtx.is_paused && window_active && now_ms - last_blink_time >= CURSOR_BLINK_INTERVAL_MS) {
             show_cursor_flag = !show_cursor_flag;
-            last_blink_time = SDL_GetTicks();
-        } else if (appCtx.is_paused) {
-            show_cursor_flag = true; // Cursor is always visible when paused
+            last_blink_time = now_ms;
+            appCtx.needs_redraw = true;
+        } else if ((appCtx.is_paused || !window_active) && !show_cursor_flag) {
+            show_cursor_flag = true; // Cursor stays visible when paused or not blinking
+            appCtx.needs_redraw = true;
         }
 
+        // Redraw when the timer shows a new second (live stats are refreshed with it)
+        Uint32 timer_second = displayed_timer_second(&appCtx);
+        if (timer_second != last_drawn_timer_second) {
+            last_drawn_timer_second = timer_second;
+            appCtx.needs_redraw = true;
+        }
+
+        // Nothing to draw, or nowhere to draw it
+        if (!appCtx.needs_redraw || appCtx.window_minimized) continue;
+
+#if LOW_LATENCY_MODE
+        // Pace to the display refresh rate without VSYNC; input arriving meanwhile wakes the loop
+        Uint32 since_present_ms = SDL_GetTicks() - appCtx.last_present_ms;
+        if (since_present_ms < appCtx.frame_interval_ms) {
+            SDL_WaitEventTimeout(NULL, (int)(appCtx.frame_interval_ms - since_present_ms));
+            continue;
+        }
+
+        // Pick up keystrokes that arrived since the events were handled, right before the frame is built
+        FrameProfilerBeginFrame(&appCtx); // The frame starts here; the pacing wait is not part of it
+        HandleAppEvents(&appCtx, &event, &current_input_byte_idx, input_buffer,
+                        final_text_len, text_to_type, &quit_game_flag,
+                        filePaths.actual_text_file_path, filePaths.actual_stats_file_path);
+        FrameProfilerEndStage(&appCtx, PROFILE_STAGE_EVENTS);
+        if (quit_game_flag) break;
+        if (current_input_byte_idx != old_input_idx) {
+            appCtx.predictive_scroll_triggered_this_input_idx = false;
+            appCtx.y_offset_due_to_prediction_for_current_idx = 0;
+        }
+#endif
+        appCtx.needs_redraw = false;
+
         // Clear screen
         SDL_SetRenderDrawColor(appCtx.ren, appCtx.palette[COL_BG].r, appCtx.palette[COL_BG].g, appCtx.palette[COL_BG].b, appCtx.palette[COL_BG].a);
         SDL_RenderClear(appCtx.ren);
@@ -107,10 +227,12 @@ int main(int argc, char **argv) {
         // Render timer and get its dimensions
         int timer_h = 0, timer_w = 0;
         RenderAppTimer(&appCtx, &timer_h, &timer_w);
+        FrameProfilerEndStage(&appCtx, PROFILE_STAGE_TIMER); // Includes the clear
 
         // Render live statistics
         RenderLiveStats(&appCtx, input_buffer, current_input_byte_idx,
                         TEXT_AREA_X, timer_w, TEXT_AREA_PADDING_Y, timer_h);
+        FrameProfilerEndStage(&appCtx, PROFILE_STAGE_LIVE_STATS);
 
         // Determine the top coordinate of the text area
         int text_viewport_top_y = TEXT_AREA_PADDING_Y + timer_h + TEXT_AREA_PADDING_Y;
@@ -120,10 +242,12 @@ int main(int argc, char **argv) {
         int logical_cursor_x_on_line = 0; // X coordinate of the cursor on its line
         CalculateCursorLayout(&appCtx, text_to_type, final_text_len, current_input_byte_idx,
                               &logical_cursor_abs_y, &logical_cursor_x_on_line);
+        FrameProfilerEndStage(&appCtx, PROFILE_STAGE_CURSOR_LAYOUT);
 
         // Update visible text area (scrolling)
         // predictive_scroll_triggered and y_offset_due_to_prediction are set inside PerformPredictiveScrollUpdate
         PerformPredictiveScrollUpdate(&appCtx, text_to_type, final_text_len, current_input_byte_idx, logical_cursor_abs_y);
+        FrameProfilerEndStage(&appCtx, PROFILE_STAGE_SCROLL);
 
 
         // Render text content and get final coordinates for drawing the cursor
@@ -134,17 +258,28 @@ int main(int argc, char **argv) {
 
         // Render cursor
         RenderAppCursor(&appCtx, show_cursor_flag, final_cursor_draw_x, final_cursor_draw_y_baseline, text_viewport_top_y);
+        FrameProfilerEndStage(&appCtx, PROFILE_STAGE_TEXT); // Text content and cursor
+
+        FrameProfilerRenderOverlay(&appCtx); // Shows the previous frames; not charged to any stage
+        FrameProfilerEndStage(&appCtx, PROFILE_STAGE_UNTRACKED);
 
-        SDL_RenderPresent(appCtx.ren); // Update screen
-        SDL_Delay(16); // Limit FPS (approximately 60 FPS)
+        SDL_RenderPresent(appCtx.ren); // Update screen (VSYNC, or the pacing above, limits back-to-back redraws)
+        FrameProfilerEndStage(&appCtx, PROFILE_STAGE_PRESENT);
+        appCtx.last_present_ms = SDL_GetTicks();
+        RecordFramePresented(&appCtx);
+        FrameProfilerEndFrame(&appCtx);
     }
 
     SDL_StopTextInput(); // Stop accepting text input
 
     // Calculate and save final statistics
     if (appCtx.typing_started) {
+        TextStatsSyncPrefix(&appCtx.typed_input_stats, input_buffer, current_input_byte_idx); // Input after the last frame
+        TextLoaderPoll(&appCtx, textLoader, &text_to_type, &final_text_len); // Whatever has loaded; exit does not wait for the rest
         CalculateAndPrintAppStats(&appCtx, filePaths.actual_stats_file_path);
-        SaveRemainingText(&appCtx, &filePaths, text_to_type, final_text_len, current_input_byte_idx);
+        if (text_from_stdin) {
+            if (appCtx.log_file_handle) fprintf(appCtx.log_file_handle, "Text came from stdin; progress not saved.\n");
+        }
     } else {
         printf("No typing started. Stats not saved. Text file not modified.\n");
         if (appCtx.log_file_handle) {
@@ -153,8 +288,11 @@ int main(int argc, char **argv) {
         }
     }
 
+    // The position is saved as a small checkpoint; text.txt is rewritten only if all of it was typed
+    ProgressSaverStop(&appCtx, &progressSaver, text_to_type, final_text_len, current_input_byte_idx);
+
     // Free resources
-    if (text_to_type) free(text_to_type);
+    TextLoaderFree(textLoader); // Also frees text_to_type (after the progress saver is done with it)
     if (input_buffer) free(input_buffer);
     CleanupApp(&appCtx); // Frees SDL, TTF, font, textures, closes log file
 
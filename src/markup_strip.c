@@ -0,0 +1,664 @@
+#include "markup_strip.h"
+#include "utf8_utils.h" // For encode_utf8
+#include "config.h"     // For TEXT_IMPORT_SAMPLE_BYTES
+#include <string.h>     // For memchr, memcmp, memmove, memset, strlen
+#include <stdlib.h>     // For strtoul
+
+// The stripper is a byte-level state machine, so it needs no lookahead and no buffer beyond the current tag
+// name or entity: input can arrive in pieces of any size. Plain text between markup is found with a vector
+// scan for the few bytes that can start markup and copied as one run.
+
+enum {
+    MARKUP_MODE_TEXT,
+    MARKUP_MODE_LT,          // After '<': a tag if a letter, '/', '!' or '?' follows
+    MARKUP_MODE_TAG_NAME,
+    MARKUP_MODE_TAG_ATTRS,   // Skipped up to the closing '>' (quoted values may contain '>')
+    MARKUP_MODE_COMMENT,
+    MARKUP_MODE_RAW_TEXT,    // Contents of <script>, <style>... skipped up to the closing tag
+    MARKUP_MODE_ENTITY,      // After '&'
+    MARKUP_MODE_BANG,        // Markdown: after '!' (an image if '[' follows)
+    MARKUP_MODE_RBRACKET,    // Markdown: after the ']' of link text (a link if '(' follows)
+    MARKUP_MODE_LINK_URL,
+    MARKUP_MODE_BACKSLASH,   // Markdown: escapes the next punctuation character
+    MARKUP_MODE_UNDERSCORE,  // Markdown: emphasis unless inside a word (snake_case)
+    MARKUP_MODE_STAR,        // Markdown: emphasis unless standing alone ("5 * 3")
+    MARKUP_MODE_LINE_MARKER, // Markdown: '#', '>', '-', '*'... at the start of a line
+    MARKUP_MODE_SKIP_LINE,   // Markdown: the rest of a closing code fence line
+    MARKUP_MODE_FENCE_INFO,  // Markdown: the rest of an opening code fence line ("```c")
+    MARKUP_MODE_FENCE_CODE,  // Markdown: fenced code, kept as it is
+    MARKUP_MODE_FENCE_LINE_START, // Markdown: start of a fenced code line, which may be the closing fence
+};
+
+// Bytes that may start markup in text; Markdown's line-start markers are handled byte by byte instead
+static const char html_specials[] = "<&\n\r";
+static const char markdown_specials[] = "<&\n*`_[]!\\";
+static const char markdown_line_markers[] = "#>-*+`~_";
+
+// Skipped with their contents
+static const char *raw_text_tags[] = {"script", "style", "head", "noscript", "template"};
+// End a paragraph; everything else (a, span, b, em...) just disappears
+static const char *block_tags[] = {
+    "p", "div", "h1", "h2", "h3", "h4", "h5", "h6", "li", "ul", "ol", "dl", "dt", "dd", "tr", "table",
+    "blockquote", "pre", "section", "article", "header", "footer", "main", "nav", "aside", "figure",
+    "figcaption", "hr", "title", "body", "html", "form",
+};
+// Other tags Markdown text may contain; there, a '<' only starts a tag with one of the names above or these
+static const char *inline_tags[] = {
+    "a", "abbr", "b", "bdi", "bdo", "big", "br", "button", "caption", "center", "cite", "code", "col", "colgroup",
+    "del", "details", "dfn", "em", "font", "i", "iframe", "img", "input", "ins", "kbd", "label", "mark", "picture",
+    "q", "s", "samp", "small", "source", "span", "strike", "strong", "sub", "summary", "sup", "tbody", "td",
+    "tfoot", "th", "thead", "time", "tt", "u", "var", "video", "audio", "wbr",
+};
+
+// The replacement of every entity is shorter than the entity itself, which keeps output behind input
+static const char *named_entities[][2] = {
+    {"amp", "&"}, {"lt", "<"}, {"gt", ">"}, {"quot", "\""}, {"apos", "'"},
+    {"nbsp", " "}, {"ensp", " "}, {"emsp", " "}, {"thinsp", " "}, {"shy", ""},
+    {"ndash", "\xE2\x80\x93"}, {"mdash", "\xE2\x80\x94"}, {"hellip", "\xE2\x80\xA6"},
+    {"lsquo", "\xE2\x80\x98"}, {"rsquo", "\xE2\x80\x99"}, {"sbquo", "\xE2\x80\x9A"},
+    {"ldquo", "\xE2\x80\x9C"}, {"rdquo", "\xE2\x80\x9D"}, {"bdquo", "\xE2\x80\x9E"},
+    {"laquo", "\xC2\xAB"}, {"raquo", "\xC2\xBB"}, {"copy", "\xC2\xA9"}, {"reg", "\xC2\xAE"},
+    {"trade", "\xE2\x84\xA2"}, {"deg", "\xC2\xB0"}, {"middot", "\xC2\xB7"}, {"bull", "\xE2\x80\xA2"},
+    {"times", "\xC3\x97"}, {"euro", "\xE2\x82\xAC"},
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MARKUP_CTZ(mask) ((size_t)__builtin_ctz((unsigned int)(mask)))
+#else
+static size_t markup_ctz(unsigned int mask) {
+    size_t bit_index = 0;
+    while (!(mask & 1)) { mask >>= 1; bit_index++; }
+    return bit_index;
+}
+#define MARKUP_CTZ(mask) markup_ctz(mask)
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MARKUP_SCAN_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MARKUP_SCAN_NEON 1
+#endif
+
+// Length of the leading run of [p, end) that contains none of the special bytes
+static size_t scan_plain_run(const char *p, const char *end, const char *specials) {
+    const char *start = p;
+    size_t special_count = strlen(specials);
+#if defined(MARKUP_SCAN_SSE2)
+    __m128i special_vecs[16];
+    for (size_t i = 0; i < special_count; i++) special_vecs[i] = _mm_set1_epi8(specials[i]);
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+        __m128i hits = _mm_cmpeq_epi8(bytes, special_vecs[0]);
+        for (size_t i = 1; i < special_count; i++) hits = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, special_vecs[i]));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) return (size_t)(p - start) + MARKUP_CTZ(mask);
+        p += 16;
+    }
+#elif defined(MARKUP_SCAN_NEON)
+    uint8x16_t special_vecs[16];
+    for (size_t i = 0; i < special_count; i++) special_vecs[i] = vdupq_n_u8((uint8_t)specials[i]);
+    while (end - p >= 16) {
+        uint8x16_t bytes = vld1q_u8((const uint8_t*)p);
+        uint8x16_t hits = vceqq_u8(bytes, special_vecs[0]);
+        for (size_t i = 1; i < special_count; i++) hits = vorrq_u8(hits, vceqq_u8(bytes, special_vecs[i]));
+        if (vmaxvq_u8(hits)) break; // The byte loop below finds which one
+        p += 16;
+    }
+#endif
+    while (p < end && !memchr(specials, *p, special_count)) p++;
+    return (size_t)(p - start);
+}
+
+static bool is_word_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c >= 0x80;
+}
+
+static bool is_ascii_punctuation(unsigned char c) {
+    return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') || (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+}
+
+static char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool token_is_one_of(const char *token, const char **names, size_t name_count) {
+    for (size_t i = 0; i < name_count; i++) {
+        if (strcmp(token, names[i]) == 0) return true;
+    }
+    return false;
+}
+
+static void emit_byte(char *output, size_t *output_len, char c) {
+    output[(*output_len)++] = c;
+}
+
+static void emit_bytes(char *output, size_t *output_len, const char *bytes, size_t byte_count) {
+    memmove(output + *output_len, bytes, byte_count); // Output may trail the input in the same buffer
+    *output_len += byte_count;
+}
+
+// Markdown: whether the tag name in state->token is an HTML tag (anything else after '<' is text, as in "i<n")
+static bool token_is_known_tag(MarkupStripState *state) {
+    state->token[state->token_len] = '\0';
+    const char *name = state->token + (state->token[0] == '/' ? 1 : 0);
+    return token_is_one_of(name, raw_text_tags, sizeof(raw_text_tags) / sizeof(raw_text_tags[0])) ||
+           token_is_one_of(name, block_tags, sizeof(block_tags) / sizeof(block_tags[0])) ||
+           token_is_one_of(name, inline_tags, sizeof(inline_tags) / sizeof(inline_tags[0]));
+}
+
+// Markdown: bytes a tag may have outside quoted values (names, "=", "/", spaces); anything else, as in
+// "a<b && c>d", means the '<' started no tag. Unquoted values are limited to the same bytes.
+static bool is_markdown_tag_byte(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' ||
+           c == '.' || c == ':' || c == '=' || c == '/' || c == ' ' || c == '\t' || c == '\r' || c == '"' || c == '\'' || c == '>';
+}
+
+// Keeps bytes of the tag being read; false if they do not fit
+static bool hold_tag_bytes(MarkupStripState *state, const char *bytes, size_t byte_count) {
+    if (state->tag_bytes_lost) return true;
+    if (state->tag_bytes_len + byte_count > MARKUP_TAG_BYTES_MAX) {
+        state->tag_bytes_lost = true;
+        return false;
+    }
+    memcpy(state->tag_bytes + state->tag_bytes_len, bytes, byte_count);
+    state->tag_bytes_len += byte_count;
+    return true;
+}
+
+static void strip_byte(MarkupStripState *state, char c, char *output, size_t *output_len);
+
+// The '<' and what followed it are no tag after all: the bytes go through as text (they may start other markup)
+static void write_back_tag_bytes(MarkupStripState *state, char *output, size_t *output_len) {
+    char bytes[MARKUP_TAG_BYTES_MAX];
+    size_t byte_count = state->tag_bytes_len;
+    memcpy(bytes, state->tag_bytes, byte_count);
+    state->tag_bytes_len = 0;
+    state->mode = MARKUP_MODE_TEXT;
+    emit_byte(output, output_len, '<');
+    state->at_line_start = false;
+    state->prev_was_word = false;
+    for (size_t i = 1; i < byte_count; i++) strip_byte(state, bytes[i], output, output_len);
+}
+
+// Called at the '>' of a tag whose name is in state->token
+static void finish_tag(MarkupStripState *state, char *output, size_t *output_len) {
+    state->token[state->token_len] = '\0';
+    bool is_closing = state->token[0] == '/';
+    const char *name = state->token + (is_closing ? 1 : 0);
+    state->mode = MARKUP_MODE_TEXT;
+    state->tag_bytes_len = 0;
+    if (!is_closing && token_is_one_of(name, raw_text_tags, sizeof(raw_text_tags) / sizeof(raw_text_tags[0]))) {
+        memcpy(state->raw_text_end, name, strlen(name) + 1);
+        state->raw_text_matched = 0;
+        state->mode = MARKUP_MODE_RAW_TEXT;
+    } else if (strcmp(name, "br") == 0) {
+        emit_bytes(output, output_len, "\n", 1);
+        state->at_line_start = true;
+        state->prev_was_word = false;
+    } else if (token_is_one_of(name, block_tags, sizeof(block_tags) / sizeof(block_tags[0]))) {
+        emit_bytes(output, output_len, "\n\n", 2); // A paragraph break for the preprocessor
+        state->at_line_start = true;
+        state->prev_was_word = false;
+    }
+}
+
+// Replaces the entity in state->token (without '&' and ';') or writes it back as it was
+static void finish_entity(MarkupStripState *state, char *output, size_t *output_len) {
+    state->token[state->token_len] = '\0';
+    char utf8[4];
+    size_t utf8_len = 0;
+    bool decoded = false;
+    if (state->token[0] == '#' && state->token_len > 1) { // &#123; or &#x1F600;
+        bool is_hex = state->token[1] == 'x' || state->token[1] == 'X';
+        char *digits_end = NULL;
+        const char *digits = state->token + (is_hex ? 2 : 1);
+        unsigned long codepoint = strtoul(digits, &digits_end, is_hex ? 16 : 10);
+        if (*digits != '\0' && *digits_end == '\0' && codepoint > 0 && codepoint <= 0x10FFFF &&
+            !(codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+            if (codepoint == 0xA0) codepoint = ' '; // A no-break space can't be typed
+            utf8_len = encode_utf8((Uint32)codepoint, utf8);
+            decoded = true;
+        }
+    } else {
+        for (size_t i = 0; i < sizeof(named_entities) / sizeof(named_entities[0]); i++) {
+            if (strcmp(state->token, named_entities[i][0]) == 0) {
+                utf8_len = strlen(named_entities[i][1]);
+                memcpy(utf8, named_entities[i][1], utf8_len);
+                decoded = true;
+                break;
+            }
+        }
+    }
+    if (decoded) {
+        emit_bytes(output, output_len, utf8, utf8_len);
+    } else { // Unknown: kept literally
+        emit_byte(output, output_len, '&');
+        emit_bytes(output, output_len, state->token, state->token_len);
+        emit_byte(output, output_len, ';');
+    }
+    state->mode = MARKUP_MODE_TEXT;
+    state->at_line_start = false;
+    state->prev_was_word = false;
+}
+
+// Markdown line-start markers that turned out to be text: inline markers among them are still dropped
+static void flush_line_markers(MarkupStripState *state, char *output, size_t *output_len) {
+    for (size_t i = 0; i < state->token_len; i++) {
+        char c = state->token[i];
+        if (c != '*' && c != '`' && c != '_') emit_byte(output, output_len, c);
+    }
+    state->token_len = 0;
+    state->mode = MARKUP_MODE_TEXT;
+    state->at_line_start = false;
+    state->prev_was_word = false;
+}
+
+// Processes one byte outside the plain-text fast path
+static void strip_byte(MarkupStripState *state, char c, char *output, size_t *output_len) {
+    bool is_markdown = state->kind == MARKUP_MARKDOWN;
+    for (;;) { // Modes that can only decide on the next byte hand it back to text mode with 'continue'
+        switch (state->mode) {
+        case MARKUP_MODE_TEXT:
+            if (c == '<') { state->mode = MARKUP_MODE_LT; return; }
+            if (c == '&') { state->mode = MARKUP_MODE_ENTITY; state->token_len = 0; return; }
+            if (!is_markdown) {
+                if (c == '\n' || c == '\r') c = ' '; // HTML line breaks are spaces; block tags make paragraphs
+                break;
+            }
+            if (state->at_line_start && c != '\0' && strchr(markdown_line_markers, c)) {
+                state->token[0] = c;
+                state->token_len = 1;
+                state->mode = MARKUP_MODE_LINE_MARKER;
+                return;
+            }
+            switch (c) {
+            case '\n':
+                emit_byte(output, output_len, c);
+                state->at_line_start = true;
+                state->in_link_text = false;
+                state->prev_was_word = false;
+                return;
+            case ' ': case '\t':
+                emit_byte(output, output_len, c); // Indentation keeps at_line_start
+                state->prev_was_word = false;
+                return;
+            case '`': // Code spans: markers dropped, contents kept
+                state->at_line_start = false;
+                return;
+            case '*': state->mode = MARKUP_MODE_STAR; return;
+            case '_': state->mode = MARKUP_MODE_UNDERSCORE; return;
+            case '!': state->mode = MARKUP_MODE_BANG; return;
+            case '\\': state->mode = MARKUP_MODE_BACKSLASH; return;
+            case '[':
+                state->in_link_text = true;
+                state->at_line_start = false;
+                return;
+            case ']':
+                if (!state->in_link_text) break;
+                state->in_link_text = false;
+                state->mode = MARKUP_MODE_RBRACKET;
+                return;
+            default:
+                break;
+            }
+            break;
+
+        case MARKUP_MODE_LT:
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '/' || c == '!' || c == '?') {
+                state->token[0] = ascii_lower(c);
+                state->token_len = 1;
+                state->tag_bytes[0] = '<';
+                state->tag_bytes[1] = c;
+                state->tag_bytes_len = 2;
+                state->tag_bytes_lost = false;
+                state->mode = MARKUP_MODE_TAG_NAME;
+                return;
+            }
+            emit_byte(output, output_len, '<'); // "a < b"
+            state->mode = MARKUP_MODE_TEXT;
+            state->at_line_start = false;
+            state->prev_was_word = false;
+            continue;
+
+        case MARKUP_MODE_TAG_NAME:
+            // A Markdown tag ends on its line, has a known name, only tag bytes and fits in tag_bytes; else it was text
+            if (is_markdown && !state->tag_bytes_lost &&
+                (!is_markdown_tag_byte(c) || (c == '>' && !token_is_known_tag(state)) || !hold_tag_bytes(state, &c, 1))) {
+                write_back_tag_bytes(state, output, output_len);
+                continue;
+            }
+            if (!is_markdown) hold_tag_bytes(state, &c, 1);
+            if (c == '>') { finish_tag(state, output, output_len); return; }
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '/') { // The '/' of "</p" came before the name
+                state->mode = MARKUP_MODE_TAG_ATTRS;
+                state->quote = 0;
+                return;
+            }
+            if (state->token_len < MARKUP_TOKEN_MAX - 1) state->token[state->token_len++] = ascii_lower(c);
+            if (state->token_len == 3 && memcmp(state->token, "!--", 3) == 0) {
+                state->mode = MARKUP_MODE_COMMENT;
+                state->comment_dashes = 0;
+            }
+            return;
+
+        case MARKUP_MODE_TAG_ATTRS:
+            if (is_markdown && !state->tag_bytes_lost &&
+                (c == '\n' || (!state->quote && (!is_markdown_tag_byte(c) || (c == '>' && !token_is_known_tag(state)))) ||
+                 !hold_tag_bytes(state, &c, 1))) {
+                write_back_tag_bytes(state, output, output_len);
+                continue;
+            }
+            if (!is_markdown) hold_tag_bytes(state, &c, 1);
+            if (state->quote) {
+                if (c == state->quote) state->quote = 0;
+            } else if (c == '"' || c == '\'') {
+                state->quote = c;
+            } else if (c == '>') {
+                finish_tag(state, output, output_len);
+            }
+            return;
+
+        case MARKUP_MODE_COMMENT:
+            if (c == '>' && state->comment_dashes >= 2) state->mode = MARKUP_MODE_TEXT;
+            state->comment_dashes = (c == '-') ? state->comment_dashes + 1 : 0;
+            return;
+
+        case MARKUP_MODE_RAW_TEXT: { // Waiting for "</name"
+            size_t end_tag_len = 2 + strlen(state->raw_text_end);
+            char expected = state->raw_text_matched == 0 ? '<' : state->raw_text_matched == 1 ? '/' :
+                            state->raw_text_end[state->raw_text_matched - 2];
+            if (ascii_lower(c) != expected) {
+                state->raw_text_matched = (c == '<') ? 1 : 0;
+                return;
+            }
+            if (++state->raw_text_matched == end_tag_len) { // The rest of the closing tag is skipped as usual
+                state->token[0] = '/';
+                memcpy(state->token + 1, state->raw_text_end, end_tag_len - 2);
+                state->token_len = end_tag_len - 1;
+                state->mode = MARKUP_MODE_TAG_ATTRS;
+                state->quote = 0;
+                state->tag_bytes_len = 0;
+                state->tag_bytes_lost = true;
+            }
+            return;
+        }
+
+        case MARKUP_MODE_ENTITY: {
+            bool is_entity_char = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                                  (c == '#' && state->token_len == 0);
+            if (c == ';' && state->token_len > 0) { finish_entity(state, output, output_len); return; }
+            if (is_entity_char && state->token_len < MARKUP_TOKEN_MAX - 1) {
+                state->token[state->token_len++] = c;
+                return;
+            }
+            emit_byte(output, output_len, '&'); // Not an entity ("AT&T", "a & b")
+            emit_bytes(output, output_len, state->token, state->token_len);
+            state->prev_was_word = state->token_len > 0 && is_word_byte((unsigned char)state->token[state->token_len - 1]);
+            state->at_line_start = false;
+            state->mode = MARKUP_MODE_TEXT;
+            continue;
+        }
+
+        case MARKUP_MODE_BANG:
+            if (c != '[') emit_byte(output, output_len, '!'); // Else an image: "![alt](url)" -> "alt"
+            state->prev_was_word = false;
+            state->at_line_start = false;
+            state->mode = MARKUP_MODE_TEXT;
+            continue;
+
+        case MARKUP_MODE_RBRACKET:
+            state->mode = MARKUP_MODE_TEXT;
+            if (c == '(') {
+                state->mode = MARKUP_MODE_LINK_URL;
+                state->link_paren_depth = 1;
+                return;
+            }
+            continue;
+
+        case MARKUP_MODE_LINK_URL:
+            if (c == '\n') { state->mode = MARKUP_MODE_TEXT; continue; } // Unclosed: give up on the line
+            if (c == '(') state->link_paren_depth++;
+            if (c == ')' && --state->link_paren_depth == 0) state->mode = MARKUP_MODE_TEXT;
+            return;
+
+        case MARKUP_MODE_BACKSLASH:
+            state->mode = MARKUP_MODE_TEXT;
+            state->at_line_start = false;
+            if (is_ascii_punctuation((unsigned char)c)) {
+                emit_byte(output, output_len, c);
+                state->prev_was_word = false;
+                return;
+            }
+            emit_byte(output, output_len, '\\');
+            continue;
+
+        case MARKUP_MODE_UNDERSCORE:
+            if (state->prev_was_word && is_word_byte((unsigned char)c)) emit_byte(output, output_len, '_'); // snake_case
+            state->at_line_start = false;
+            state->mode = MARKUP_MODE_TEXT;
+            continue;
+
+        case MARKUP_MODE_STAR:
+            if (!state->prev_was_word && (c == ' ' || c == '\t' || c == '\n')) emit_byte(output, output_len, '*');
+            state->at_line_start = false;
+            state->mode = MARKUP_MODE_TEXT;
+            continue;
+
+        case MARKUP_MODE_LINE_MARKER: {
+            if (c != '\0' && strchr(markdown_line_markers, c) && state->token_len < MARKUP_TOKEN_MAX - 1) {
+                state->token[state->token_len++] = c;
+                return;
+            }
+            bool all_same = true;
+            for (size_t i = 1; i < state->token_len; i++) all_same = all_same && state->token[i] == state->token[0];
+            char marker = state->token[0];
+            if (c == ' ' || c == '\t') {
+                if (all_same && marker == '#' && state->token_len <= 6) { // Heading
+                    state->token_len = 0;
+                    state->mode = MARKUP_MODE_TEXT;
+                    state->at_line_start = false;
+                    return;
+                }
+                if (state->token_len == 1 && strchr(">-*+", marker)) { // Quote or bullet; may nest ("> - item")
+                    state->token_len = 0;
+                    state->mode = MARKUP_MODE_TEXT;
+                    return;
+                }
+            }
+            if (all_same && state->token_len >= 3 && (marker == '`' || marker == '~')) { // Code fence
+                state->fence_char = marker;
+                state->fence_len = state->token_len;
+                state->token_len = 0;
+                state->mode = MARKUP_MODE_FENCE_INFO;
+                continue;
+            }
+            if (c == '\n' && all_same && state->token_len >= 3 && strchr("-*_", marker)) { // Horizontal rule
+                state->token_len = 0;
+                state->mode = MARKUP_MODE_TEXT;
+                continue;
+            }
+            flush_line_markers(state, output, output_len);
+            continue;
+        }
+
+        case MARKUP_MODE_SKIP_LINE:
+            if (c != '\n') return;
+            state->mode = MARKUP_MODE_TEXT;
+            continue;
+
+        case MARKUP_MODE_FENCE_INFO: // The info string ("c", "python") is dropped
+            if (c != '\n') return;
+            emit_byte(output, output_len, c);
+            state->token_len = 0;
+            state->mode = MARKUP_MODE_FENCE_LINE_START;
+            return;
+
+        case MARKUP_MODE_FENCE_CODE:
+            emit_byte(output, output_len, c);
+            if (c == '\n') {
+                state->token_len = 0;
+                state->mode = MARKUP_MODE_FENCE_LINE_START;
+            }
+            return;
+
+        case MARKUP_MODE_FENCE_LINE_START: { // Up to 3 spaces, then fence characters, held in token
+            size_t fence_char_count = 0;
+            for (size_t i = 0; i < state->token_len; i++) fence_char_count += (state->token[i] == state->fence_char);
+            bool fits = state->token_len < MARKUP_TOKEN_MAX - 1;
+            if (fits && c == ' ' && fence_char_count == 0 && state->token_len < 3) { state->token[state->token_len++] = c; return; }
+            if (fits && c == state->fence_char) { state->token[state->token_len++] = c; return; }
+            if (fence_char_count >= state->fence_len && (c == '\n' || c == ' ' || c == '\t')) { // Closing fence
+                state->token_len = 0;
+                state->fence_char = 0;
+                state->mode = MARKUP_MODE_SKIP_LINE;
+                continue;
+            }
+            emit_bytes(output, output_len, state->token, state->token_len); // A code line after all
+            state->token_len = 0;
+            state->mode = MARKUP_MODE_FENCE_CODE;
+            continue;
+        }
+
+        default:
+            state->mode = MARKUP_MODE_TEXT;
+            continue;
+        }
+
+        // Plain text byte
+        emit_byte(output, output_len, c);
+        state->at_line_start = false;
+        state->prev_was_word = is_word_byte((unsigned char)c);
+        return;
+    }
+}
+
+void MarkupStripInit(MarkupStripState *state, MarkupKind kind) {
+    if (!state) return;
+    memset(state, 0, sizeof(MarkupStripState));
+    state->kind = kind;
+    state->mode = MARKUP_MODE_TEXT;
+    state->at_line_start = true;
+}
+
+size_t MarkupStripFeed(MarkupStripState *state, const char *input, size_t input_len, char *output, size_t output_len) {
+    if (!state || !input || !output) return output_len;
+    if (state->kind == MARKUP_NONE) {
+        emit_bytes(output, &output_len, input, input_len);
+        return output_len;
+    }
+    const char *specials = state->kind == MARKUP_HTML ? html_specials : markdown_specials;
+    const char *p = input, *end = input + input_len;
+    while (p < end) {
+        if (state->mode == MARKUP_MODE_TEXT && !state->at_line_start) { // Copy up to the next possible markup
+            size_t run_len = scan_plain_run(p, end, specials);
+            if (run_len > 0) {
+                emit_bytes(output, &output_len, p, run_len);
+                state->prev_was_word = is_word_byte((unsigned char)p[run_len - 1]);
+                p += run_len;
+                continue;
+            }
+        } else if (state->mode == MARKUP_MODE_TAG_ATTRS && state->kind == MARKUP_HTML) { // Skip to the end of the tag or of a quoted value
+            // (Markdown tags are short and checked byte by byte)
+            const char *next = state->quote ? (const char*)memchr(p, state->quote, (size_t)(end - p)) : p + scan_plain_run(p, end, "\"'>");
+            if (!next) next = end;
+            hold_tag_bytes(state, p, (size_t)(next - p));
+            p = next;
+            if (p == end) break;
+        } else if (state->mode == MARKUP_MODE_FENCE_CODE) { // Copy the rest of the code line
+            const char *line_end = (const char*)memchr(p, '\n', (size_t)(end - p));
+            size_t run_len = line_end ? (size_t)(line_end - p) : (size_t)(end - p);
+            emit_bytes(output, &output_len, p, run_len);
+            p += run_len;
+            if (p == end) break;
+        } else if (state->mode == MARKUP_MODE_RAW_TEXT && state->raw_text_matched == 0) { // Skip to the next '<'
+            const char *next_lt = (const char*)memchr(p, '<', (size_t)(end - p));
+            if (!next_lt) break;
+            p = next_lt;
+        } else if (state->mode == MARKUP_MODE_COMMENT && state->comment_dashes == 0) { // Skip to the next '-'
+            const char *next_dash = (const char*)memchr(p, '-', (size_t)(end - p));
+            if (!next_dash) break;
+            p = next_dash;
+        }
+        strip_byte(state, *p++, output, &output_len);
+    }
+    return output_len;
+}
+
+size_t MarkupStripFinish(MarkupStripState *state, char *output, size_t output_len) {
+    if (!state || !output) return output_len;
+    switch (state->mode) {
+    case MARKUP_MODE_LT: emit_byte(output, &output_len, '<'); break;
+    case MARKUP_MODE_ENTITY:
+        emit_byte(output, &output_len, '&');
+        emit_bytes(output, &output_len, state->token, state->token_len);
+        break;
+    case MARKUP_MODE_BANG: emit_byte(output, &output_len, '!'); break;
+    case MARKUP_MODE_STAR: if (!state->prev_was_word) emit_byte(output, &output_len, '*'); break;
+    case MARKUP_MODE_BACKSLASH: emit_byte(output, &output_len, '\\'); break;
+    case MARKUP_MODE_LINE_MARKER: flush_line_markers(state, output, &output_len); break;
+    case MARKUP_MODE_TAG_NAME:
+    case MARKUP_MODE_TAG_ATTRS:
+        if (state->tag_bytes_lost) break;
+        write_back_tag_bytes(state, output, &output_len); // "a <b" at the very end; may leave another construct open
+        return MarkupStripFinish(state, output, output_len);
+    case MARKUP_MODE_FENCE_LINE_START: {
+        size_t fence_char_count = 0;
+        for (size_t i = 0; i < state->token_len; i++) fence_char_count += (state->token[i] == state->fence_char);
+        if (fence_char_count < state->fence_len) emit_bytes(output, &output_len, state->token, state->token_len);
+        break;
+    }
+    default: break; // Unclosed comments and scripts are dropped
+    }
+    state->fence_char = 0;
+    state->mode = MARKUP_MODE_TEXT;
+    return output_len;
+}
+
+// Case-insensitive prefix test for the start of a document
+static bool starts_with_ci(const char *text, const char *end, const char *prefix) {
+    for (; *prefix; prefix++, text++) {
+        if (text >= end || ascii_lower(*text) != *prefix) return false;
+    }
+    return true;
+}
+
+MarkupKind DetectTextMarkup(const char *text, size_t text_len) {
+    if (!text || text_len == 0) return MARKUP_NONE;
+    const char *end = text + (text_len < TEXT_IMPORT_SAMPLE_BYTES ? text_len : TEXT_IMPORT_SAMPLE_BYTES);
+    const char *p = text;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    if (starts_with_ci(p, end, "<!doctype html") || starts_with_ci(p, end, "<html") || starts_with_ci(p, end, "<?xml")) {
+        return MARKUP_HTML;
+    }
+
+    // Tags, and Markdown syntax that plain prose rarely has: headings, fences, links, bold, lists, quotes
+    size_t tag_count = 0, closing_tag_count = 0;
+    int markdown_score = 0;
+    bool strong_markdown = false;
+    bool at_line_start = true;
+    for (p = text; p < end; p++) {
+        char c = *p;
+        char next = (p + 1 < end) ? p[1] : '\0';
+        if (c == '<' && ((next >= 'a' && next <= 'z') || (next >= 'A' && next <= 'Z') || next == '/')) {
+            tag_count++;
+            if (next == '/') closing_tag_count++;
+        }
+        if (at_line_start) {
+            const char *q = p;
+            while (q < end && *q == '#') q++;
+            if (q > p && q - p <= 6 && q < end && *q == ' ') { markdown_score += 2; strong_markdown = true; }
+            else if (end - p >= 3 && (memcmp(p, "```", 3) == 0 || memcmp(p, "~~~", 3) == 0)) { markdown_score += 2; strong_markdown = true; }
+            else if ((c == '-' || c == '*' || c == '+' || c == '>') && next == ' ') markdown_score++;
+        }
+        if (c == ']' && next == '(') { markdown_score += 2; strong_markdown = true; }
+        if (c == '*' && next == '*') markdown_score++;
+        at_line_start = (c == '\n');
+    }
+    size_t sample_len = (size_t)(end - text);
+    if (tag_count >= 8 && closing_tag_count >= 2 && tag_count * 200 >= sample_len) return MARKUP_HTML; // A tag per 200 bytes
+    if (strong_markdown && markdown_score >= 4) return MARKUP_MARKDOWN;
+    return MARKUP_NONE;
+}
+
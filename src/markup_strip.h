@@ -0,0 +1,49 @@
+#ifndef MARKUP_STRIP_H
+#define MARKUP_STRIP_H
+
+#include <stdbool.h>
+#include <stddef.h> // For size_t
+
+#define MARKUP_TOKEN_MAX 32 // Longest tag name or entity kept while it is being read
+#define MARKUP_TAG_BYTES_MAX 256 // Longest tag kept as it was read, to be written back if it is no tag after all
+
+typedef enum {
+    MARKUP_NONE,
+    MARKUP_HTML,
+    MARKUP_MARKDOWN, // Markdown also strips inline HTML tags (known names, closed on their line) and entities
+} MarkupKind;
+
+// State of the streaming markup stripper between pieces of input
+typedef struct {
+    MarkupKind kind;
+    int mode;                     // What the next byte belongs to: text, a tag, a comment, an entity...
+    char token[MARKUP_TOKEN_MAX]; // Tag name (lowercased), entity or line-start Markdown markers read so far
+    size_t token_len;
+    char raw_text_end[MARKUP_TOKEN_MAX]; // Inside <script>, <style>...: the tag name that ends the skipped text
+    size_t raw_text_matched;      // Bytes of "</name" matched so far
+    char quote;                   // Quote character of the tag attribute being skipped, or 0
+    char tag_bytes[MARKUP_TAG_BYTES_MAX]; // The tag being read as it was in the input, from its '<'
+    size_t tag_bytes_len;
+    bool tag_bytes_lost;          // The tag outgrew tag_bytes (HTML only) or is a skipped closing tag: not written back
+    int comment_dashes;           // Consecutive '-' seen inside a comment
+    int link_paren_depth;         // Markdown: inside the "(url)" of a link
+    bool in_link_text;            // Markdown: after '[' (so ']' may close a link)
+    bool at_line_start;           // Markdown: only spaces/tabs since the last line break
+    bool prev_was_word;           // The previous input byte was a letter, digit or part of a UTF-8 character
+    char fence_char;              // Markdown: '`' or '~' inside a fenced code block, else 0
+    size_t fence_len;             // Markdown: length of the opening fence (the closing one is at least as long)
+} MarkupStripState;
+
+// Guesses from the first TEXT_IMPORT_SAMPLE_BYTES whether a text is an HTML page, Markdown or plain text
+MarkupKind DetectTextMarkup(const char *text, size_t text_len);
+
+void MarkupStripInit(MarkupStripState *state, MarkupKind kind);
+// Appends the text of input with the markup removed to output[output_len..] and returns the new output length.
+// Output is never longer than the input read so far, so output may be the input buffer itself.
+size_t MarkupStripFeed(MarkupStripState *state, const char *input, size_t input_len, char *output, size_t output_len);
+// Flushes a construct left open at the end of the input (e.g. a lone '<' or '&', or an unclosed tag, which is
+// written back as text); returns the final length
+size_t MarkupStripFinish(MarkupStripState *state, char *output, size_t output_len);
+
+
+#endif // MARKUP_STRIP_H
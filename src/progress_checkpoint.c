@@ -0,0 +1,375 @@
+#include "progress_checkpoint.h"
+#include "file_paths.h"     // For WriteFileAtomically, fopen_unicode_path
+#include "config.h"         // For PROGRESS_CHECKPOINT_INTERVAL_MS, PROGRESS_HASH_BYTES
+#include <SDL2/SDL_timer.h> // For SDL_GetTicks
+#include <stdio.h>          // For snprintf, sscanf, fgets
+#include <string.h>         // For memset, memchr, strcmp, strncmp, strlen
+#include <stdlib.h>         // For malloc, free
+#include <errno.h>          // For errno
+
+// Typing progress is kept in a small checkpoint file next to text.txt instead of rewriting text.txt on exit.
+// The record holds the typing position in the loaded text and a hash of the text just before it: on the next
+// start, the loader skips to that position only if the hash still matches, so an edited or replaced text.txt
+// starts from the beginning. Records are written every few seconds by a thread of their own (temporary file,
+// then rename), so a crash loses at most PROGRESS_CHECKPOINT_INTERVAL_MS of progress.
+//
+// text.txt itself is only rewritten once at least half of it has been typed (and the whole text is loaded):
+// the untyped part is written in the background and renamed over it. Each rewrite is no longer than the part
+// typed since the last one. A record written before the rename carries the length being cut, so if the
+// program dies before the next record, the position is tried both in the old and in the cut text.
+// The untyped part is written from the loaded text, so text.txt is compacted only if it is exactly what that
+// writes (plain UTF-8 the loader leaves as it is): other files would come back converted, stripped or changed.
+
+#define PROGRESS_FILE_HEADER "TypingApp progress 1"
+#define PROGRESS_COMPACTION_SCAN_BYTES 1024 // How far back from the latest possible cut a word start is looked for
+#define PROGRESS_FILE_CHECK_BYTES (64 * 1024) // text.txt is compared with the loaded text this many bytes at a time
+
+// Helper function for logging if appCtx->log_file_handle is available
+static void log_progress_message_format(AppContext *appCtx, const char* format, ...) {
+    if (appCtx && appCtx->log_file_handle && format) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(appCtx->log_file_handle, format, args);
+        va_end(args);
+        fprintf(appCtx->log_file_handle, "\n");
+        fflush(appCtx->log_file_handle);
+    }
+}
+
+bool ProgressCheckpointLoad(AppContext *appCtx, const char *checkpoint_path, ProgressRecord *record) {
+    if (!checkpoint_path || checkpoint_path[0] == '\0' || !record) return false;
+    memset(record, 0, sizeof(ProgressRecord));
+    FILE *checkpoint_file_handle = fopen_unicode_path(checkpoint_path, "r");
+    if (!checkpoint_file_handle) return false; // No progress saved yet
+
+    char line[128];
+    bool header_ok = fgets(line, sizeof(line), checkpoint_file_handle) && strncmp(line, PROGRESS_FILE_HEADER, strlen(PROGRESS_FILE_HEADER)) == 0;
+    int fields_found = 0;
+    while (header_ok && fgets(line, sizeof(line), checkpoint_file_handle)) {
+        char key[32];
+        unsigned long long value = 0;
+        if (sscanf(line, "%31s %llu", key, &value) != 2) continue;
+        if (strcmp(key, "offset") == 0) { record->text_offset = (size_t)value; fields_found |= 1; }
+        else if (strcmp(key, "hash") == 0) { record->text_hash = (Uint64)value; fields_found |= 2; }
+        else if (strcmp(key, "cut") == 0) { record->compaction_cut_len = (size_t)value; fields_found |= 4; }
+        else if (strcmp(key, "session") == 0) { record->session_open = value != 0; fields_found |= 8; }
+        else if (strcmp(key, "keystrokes") == 0) { record->total_keystrokes = value; fields_found |= 16; }
+        else if (strcmp(key, "errors") == 0) { record->total_errors = value; fields_found |= 32; }
+        else if (strcmp(key, "elapsed_ms") == 0) { record->elapsed_ms = (Uint32)value; fields_found |= 64; }
+    }
+    fclose(checkpoint_file_handle);
+
+    if (!header_ok || fields_found != 127) {
+        log_progress_message_format(appCtx, "Warning: Progress checkpoint '%s' is damaged; ignoring it.", checkpoint_path);
+        memset(record, 0, sizeof(ProgressRecord));
+        return false;
+    }
+    log_progress_message_format(appCtx, "Progress checkpoint: offset %zu%s%s.", record->text_offset,
+                                record->compaction_cut_len > 0 ? ", text.txt was being compacted" : "",
+                                record->session_open ? ", the session did not end normally" : "");
+    return true;
+}
+
+bool ProgressCheckpointWrite(AppContext *appCtx, const char *checkpoint_path, const ProgressRecord *record) {
+    if (!record) return false;
+    char record_text[512];
+    int record_len = snprintf(record_text, sizeof(record_text),
+                              PROGRESS_FILE_HEADER "\noffset %zu\nhash %llu\ncut %zu\nsession %d\nkeystrokes %llu\nerrors %llu\nelapsed_ms %u\n",
+                              record->text_offset, (unsigned long long)record->text_hash, record->compaction_cut_len,
+                              record->session_open ? 1 : 0, record->total_keystrokes, record->total_errors, (unsigned)record->elapsed_ms);
+    if (record_len <= 0 || (size_t)record_len >= sizeof(record_text)) return false;
+    return WriteFileAtomically(appCtx, checkpoint_path, record_text, (size_t)record_len, NULL);
+}
+
+Uint64 ProgressTextHash(const char *text, size_t offset) {
+    // 64-bit FNV-1a over the bytes right before offset
+    size_t window_len = offset < PROGRESS_HASH_BYTES ? offset : PROGRESS_HASH_BYTES;
+    const unsigned char *p = (const unsigned char*)text + offset - window_len;
+    const unsigned char *end = (const unsigned char*)text + offset;
+    Uint64 hash = 14695981039346656037ULL;
+    while (p < end) {
+        hash ^= *p++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+int ProgressResumeOffsets(const ProgressRecord *record, size_t resume_offsets[2]) {
+    if (!record || record->text_offset == 0) return 0;
+    int offset_count = 0;
+    resume_offsets[offset_count++] = record->text_offset;
+    // If text.txt was already replaced by its untyped part, the position moved back by the part cut off
+    if (record->compaction_cut_len > 0 && record->compaction_cut_len < record->text_offset) {
+        resume_offsets[offset_count++] = record->text_offset - record->compaction_cut_len;
+    }
+    return offset_count;
+}
+
+// The untyped text as it is written back to text.txt. The preprocessor turns a single line break into a space
+// and a blank line into a line break, so every line break is doubled for the file to load back to exactly this text.
+static char* progress_file_text(const char *text, size_t text_len, size_t *out_file_text_len) {
+    size_t newline_count = 0;
+    for (const char *p = text; (p = memchr(p, '\n', (size_t)(text + text_len - p))) != NULL; p++) newline_count++;
+    char *file_text = (char*)malloc(text_len + newline_count + 1);
+    if (!file_text) return NULL;
+    size_t file_text_len = 0;
+    for (size_t i = 0; i < text_len; i++) {
+        file_text[file_text_len++] = text[i];
+        if (text[i] == '\n') file_text[file_text_len++] = '\n';
+    }
+    *out_file_text_len = file_text_len;
+    return file_text;
+}
+
+// Saver thread: true if text.txt holds exactly progress_file_text of the loaded text, up to trailing whitespace (which
+// the loader trims), so writing its untyped part only cuts the file. Any file the loader changes (other encodings,
+// markup, single line breaks, characters the replacement rules or the preprocessor rewrite) is left alone.
+static bool progress_file_matches_text(ProgressSaver *saver, const char *text, size_t text_len) {
+    FILE *text_file_handle = fopen_unicode_path(saver->text_path, "rb");
+    char *file_bytes = (char*)malloc(PROGRESS_FILE_CHECK_BYTES);
+    bool matches = text_file_handle && file_bytes;
+    size_t text_idx = 0;
+    bool doubled_newline_due = false; // The text's last byte was a line break, written twice
+    size_t read_len = 0;
+    while (matches && !SDL_AtomicGet(&saver->cancel_requested) &&
+           (read_len = fread(file_bytes, 1, PROGRESS_FILE_CHECK_BYTES, text_file_handle)) > 0) {
+        for (size_t i = 0; i < read_len && matches; i++) {
+            char file_byte = file_bytes[i];
+            if (doubled_newline_due) {
+                matches = (file_byte == '\n');
+                doubled_newline_due = false;
+            } else if (text_idx < text_len) {
+                matches = (file_byte == text[text_idx]);
+                doubled_newline_due = (text[text_idx++] == '\n');
+            } else {
+                matches = (file_byte == ' ' || file_byte == '\t' || file_byte == '\r' || file_byte == '\n');
+            }
+        }
+    }
+    if (text_file_handle && ferror(text_file_handle)) matches = false;
+    if (text_file_handle) fclose(text_file_handle);
+    free(file_bytes);
+    return matches && !SDL_AtomicGet(&saver->cancel_requested) && text_idx == text_len && !doubled_newline_due;
+}
+
+static int progress_saver_thread(void *data) {
+    ProgressSaver *saver = (ProgressSaver*)data;
+    SDL_LockMutex(saver->mutex);
+    while (!saver->quit_requested) {
+        if (saver->record_pending) { // Before a compaction requested with it, so the cut length is on disk first
+            ProgressRecord record = saver->pending_record;
+            saver->record_pending = false;
+            SDL_UnlockMutex(saver->mutex);
+            ProgressCheckpointWrite(saver->appCtx, saver->checkpoint_path, &record);
+            SDL_LockMutex(saver->mutex);
+        } else if (saver->compaction_file_text) {
+            const char *compaction_file_text = saver->compaction_file_text;
+            size_t compaction_file_text_len = saver->compaction_file_text_len;
+            size_t compaction_skip_len = saver->compaction_skip_len;
+            saver->compaction_file_text = NULL;
+            SDL_UnlockMutex(saver->mutex);
+            bool compaction_refused = false;
+            if (!saver->file_checked) { // Once per session: later compactions cut a file this thread wrote
+                saver->file_checked = progress_file_matches_text(saver, compaction_file_text, compaction_file_text_len);
+                compaction_refused = !saver->file_checked && !SDL_AtomicGet(&saver->cancel_requested);
+            }
+            const char *compaction_text = compaction_file_text + compaction_skip_len;
+            size_t compaction_text_len = compaction_file_text_len - compaction_skip_len;
+            size_t file_text_len = 0;
+            char *file_text = saver->file_checked ? progress_file_text(compaction_text, compaction_text_len, &file_text_len) : NULL;
+            bool compaction_ok = file_text && WriteFileAtomically(saver->appCtx, saver->text_path, file_text, file_text_len, &saver->cancel_requested);
+            if (saver->file_checked && !file_text) log_progress_message_format(saver->appCtx, "Error: Failed to allocate %zu bytes to compact text.txt: %s", compaction_text_len, strerror(errno));
+            free(file_text);
+            SDL_LockMutex(saver->mutex);
+            saver->compaction_done = true;
+            saver->compaction_ok = compaction_ok;
+            saver->compaction_refused = compaction_refused;
+        } else {
+            SDL_CondWait(saver->cond, saver->mutex);
+        }
+    }
+    SDL_UnlockMutex(saver->mutex);
+    return 0;
+}
+
+bool ProgressSaverStart(AppContext *appCtx, ProgressSaver *saver, const char *checkpoint_path, const char *text_path,
+                        size_t text_start_offset) {
+    if (!saver) return false;
+    memset(saver, 0, sizeof(ProgressSaver));
+    if (!checkpoint_path || checkpoint_path[0] == '\0' || !text_path) return false;
+    saver->appCtx = appCtx;
+    snprintf(saver->checkpoint_path, sizeof(saver->checkpoint_path), "%s", checkpoint_path);
+    snprintf(saver->text_path, sizeof(saver->text_path), "%s", text_path);
+    saver->text_start_offset = text_start_offset;
+    saver->last_record.text_offset = text_start_offset; // Nothing to save until the position or the counters change
+    saver->last_post_ms = SDL_GetTicks() - PROGRESS_CHECKPOINT_INTERVAL_MS; // The first change is saved right away
+
+    saver->mutex = SDL_CreateMutex();
+    saver->cond = SDL_CreateCond();
+    if (saver->mutex && saver->cond) saver->thread = SDL_CreateThread(progress_saver_thread, "progress_saver", saver);
+    if (!saver->thread) {
+        log_progress_message_format(appCtx, "Warning: Could not start the progress saver thread: %s. Checkpoints are written on the main thread.", SDL_GetError());
+    }
+    saver->active = true;
+    return true;
+}
+
+// The record for the current position; the hash is filled in only when it is saved
+static void progress_saver_make_record(const AppContext *appCtx, const ProgressSaver *saver, size_t current_input_byte_idx, ProgressRecord *record) {
+    memset(record, 0, sizeof(ProgressRecord));
+    size_t cursor_offset = saver->text_start_offset + current_input_byte_idx;
+    // Typed back past a compaction: what is left of text.txt starts at the beginning
+    record->text_offset = cursor_offset > saver->file_start_offset ? cursor_offset - saver->file_start_offset : 0;
+    record->compaction_cut_len = saver->compaction_in_flight ? saver->compaction_cut_offset - saver->file_start_offset : 0;
+    record->session_open = appCtx->typing_started;
+    record->total_keystrokes = appCtx->total_keystrokes_for_accuracy;
+    record->total_errors = appCtx->total_errors_committed_for_accuracy;
+    if (appCtx->typing_started) {
+        record->elapsed_ms = (appCtx->is_paused ? appCtx->time_at_pause_ms : SDL_GetTicks()) - appCtx->start_time_ms;
+    }
+}
+
+// Hashes the text before the record's position. text_to_type may start past the beginning of text.txt
+// (typing resumed there); TextLoader keeps the skipped bytes in front of it.
+static void progress_saver_hash_record(const ProgressSaver *saver, const char *text_to_type, ProgressRecord *record) {
+    const char *file_text = text_to_type - saver->text_start_offset + saver->file_start_offset;
+    record->text_hash = ProgressTextHash(file_text, record->text_offset);
+}
+
+// Where text.txt can be cut: a word start at least PROGRESS_HASH_BYTES before the typing position (so the
+// next checkpoint's hash finds its text in the file), if that drops at least half of the file.
+// Returns the offset in the loaded text, or 0 for no compaction.
+static size_t progress_saver_compaction_cut(const ProgressSaver *saver, const char *text_to_type, size_t final_text_len, size_t record_offset) {
+    if (record_offset < PROGRESS_HASH_BYTES) return 0;
+    size_t file_len = saver->text_start_offset + final_text_len - saver->file_start_offset;
+    size_t latest_cut = saver->file_start_offset + record_offset - PROGRESS_HASH_BYTES;
+    if ((latest_cut - saver->file_start_offset) * 2 < file_len) return 0;
+
+    // Cut in the loaded part of the text, never at text.txt's current start
+    size_t lowest_cut = latest_cut > PROGRESS_COMPACTION_SCAN_BYTES ? latest_cut - PROGRESS_COMPACTION_SCAN_BYTES : 0;
+    if (lowest_cut < saver->text_start_offset + 1) lowest_cut = saver->text_start_offset + 1;
+    if (lowest_cut < saver->file_start_offset + 1) lowest_cut = saver->file_start_offset + 1;
+    for (size_t cut = latest_cut; cut >= lowest_cut; cut--) {
+        // Reloading the untyped part must give the same text: it may not start with whitespace (that would be dropped)
+        char byte_before = text_to_type[cut - saver->text_start_offset - 1];
+        char byte_at = text_to_type[cut - saver->text_start_offset];
+        if ((byte_before == ' ' || byte_before == '\n') && byte_at != ' ' && byte_at != '\n') {
+            return (cut - saver->file_start_offset) * 2 >= file_len ? cut : 0;
+        }
+    }
+    return 0;
+}
+
+// Marks a finished compaction: from now on, offsets count from where text.txt was cut
+static void progress_saver_apply_compaction(AppContext *appCtx, ProgressSaver *saver, bool compaction_ok) {
+    saver->compaction_in_flight = false;
+    saver->record_dirty = true; // The position changed meaning either way (the cut length is dropped)
+    if (!compaction_ok) return;
+    log_progress_message_format(appCtx, "text.txt compacted: %zu typed bytes removed.", saver->compaction_cut_offset - saver->file_start_offset);
+    saver->file_start_offset = saver->compaction_cut_offset;
+}
+
+void ProgressSaverUpdate(AppContext *appCtx, ProgressSaver *saver, const char *text_to_type, size_t final_text_len,
+                         size_t current_input_byte_idx) {
+    if (!appCtx || !saver || !saver->active || !text_to_type) return;
+
+    if (saver->compaction_in_flight) {
+        SDL_LockMutex(saver->mutex);
+        bool compaction_done = saver->compaction_done;
+        bool compaction_ok = saver->compaction_ok;
+        bool compaction_refused = saver->compaction_refused;
+        saver->compaction_done = false;
+        SDL_UnlockMutex(saver->mutex);
+        if (compaction_done) progress_saver_apply_compaction(appCtx, saver, compaction_ok);
+        if (compaction_done && compaction_refused) {
+            saver->compaction_disabled = true;
+            log_progress_message_format(appCtx, "text.txt does not load back as it is written (another encoding, markup or text the loader changes); it is kept as it is and not compacted.");
+        }
+    }
+
+    ProgressRecord record;
+    progress_saver_make_record(appCtx, saver, current_input_byte_idx, &record);
+    if (record.text_offset != saver->last_record.text_offset || record.session_open != saver->last_record.session_open ||
+        record.total_keystrokes != saver->last_record.total_keystrokes || record.total_errors != saver->last_record.total_errors) {
+        saver->record_dirty = true;
+    }
+    Uint32 now_ms = SDL_GetTicks();
+    if (!saver->record_dirty || now_ms - saver->last_post_ms < PROGRESS_CHECKPOINT_INTERVAL_MS) return;
+
+    // The text may only be handed to the saver thread once it no longer moves (the loader is done)
+    size_t compaction_cut = 0;
+    if (saver->thread && !saver->compaction_in_flight && !saver->compaction_disabled && appCtx->text_load_finished) {
+        compaction_cut = progress_saver_compaction_cut(saver, text_to_type, final_text_len, record.text_offset);
+    }
+    if (compaction_cut > 0) {
+        saver->compaction_in_flight = true;
+        saver->compaction_cut_offset = compaction_cut;
+        record.compaction_cut_len = compaction_cut - saver->file_start_offset;
+        SDL_AtomicSet(&saver->cancel_requested, 0);
+        log_progress_message_format(appCtx, "Compacting text.txt: dropping the first %zu typed bytes in the background.", record.compaction_cut_len);
+    }
+    progress_saver_hash_record(saver, text_to_type, &record);
+
+    if (saver->thread) {
+        SDL_LockMutex(saver->mutex);
+        saver->pending_record = record;
+        saver->record_pending = true;
+        if (compaction_cut > 0) {
+            saver->compaction_file_text = text_to_type - saver->text_start_offset + saver->file_start_offset;
+            saver->compaction_file_text_len = saver->text_start_offset + final_text_len - saver->file_start_offset;
+            saver->compaction_skip_len = compaction_cut - saver->file_start_offset;
+        }
+        SDL_CondSignal(saver->cond);
+        SDL_UnlockMutex(saver->mutex);
+    } else {
+        ProgressCheckpointWrite(appCtx, saver->checkpoint_path, &record); // A few dozen bytes
+    }
+    saver->last_record = record;
+    saver->record_dirty = false;
+    saver->last_post_ms = now_ms;
+}
+
+int ProgressSaverTimeoutMs(const ProgressSaver *saver) {
+    if (!saver || !saver->active || !saver->record_dirty) return -1;
+    Uint32 since_post_ms = SDL_GetTicks() - saver->last_post_ms;
+    return since_post_ms >= PROGRESS_CHECKPOINT_INTERVAL_MS ? 0 : (int)(PROGRESS_CHECKPOINT_INTERVAL_MS - since_post_ms);
+}
+
+void ProgressSaverStop(AppContext *appCtx, ProgressSaver *saver, const char *text_to_type, size_t final_text_len,
+                       size_t current_input_byte_idx) {
+    if (!saver || !saver->active) return;
+
+    if (saver->thread) { // A compaction in progress gives up within one piece; the old text.txt stays
+        SDL_AtomicSet(&saver->cancel_requested, 1);
+        SDL_LockMutex(saver->mutex);
+        saver->quit_requested = true;
+        SDL_CondSignal(saver->cond);
+        SDL_UnlockMutex(saver->mutex);
+        SDL_WaitThread(saver->thread, NULL);
+        saver->thread = NULL;
+    }
+    if (saver->compaction_in_flight) progress_saver_apply_compaction(appCtx, saver, saver->compaction_done && saver->compaction_ok);
+
+    if (appCtx && text_to_type && (appCtx->typing_started || saver->record_dirty)) {
+        ProgressRecord record;
+        progress_saver_make_record(appCtx, saver, current_input_byte_idx, &record);
+        progress_saver_hash_record(saver, text_to_type, &record);
+        record.session_open = false; // Its stats have just been recorded
+
+        // Typed to the end: an empty text.txt gets the placeholder text on the next start
+        bool whole_text_typed = appCtx->text_load_finished && final_text_len > 0 && current_input_byte_idx >= final_text_len;
+        if (whole_text_typed && WriteFileAtomically(appCtx, saver->text_path, "", 0, NULL)) {
+            log_progress_message_format(appCtx, "The whole text was typed; '%s' emptied.", saver->text_path);
+            memset(&record, 0, sizeof(ProgressRecord));
+        }
+        if (ProgressCheckpointWrite(appCtx, saver->checkpoint_path, &record)) {
+            log_progress_message_format(appCtx, "Progress saved: offset %zu of text.txt.", record.text_offset);
+        } else {
+            log_progress_message_format(appCtx, "ERROR: Could not save progress to '%s'.", saver->checkpoint_path);
+        }
+    }
+
+    if (saver->cond) SDL_DestroyCond(saver->cond);
+    if (saver->mutex) SDL_DestroyMutex(saver->mutex);
+    memset(saver, 0, sizeof(ProgressSaver));
+}
@@ -0,0 +1,82 @@
+#ifndef PROGRESS_CHECKPOINT_H
+#define PROGRESS_CHECKPOINT_H
+
+#include "app_context.h"     // For AppContext
+#include "file_paths.h"      // For MAX_PATH_LEN
+#include <SDL2/SDL_thread.h> // For SDL_Thread, SDL_mutex, SDL_cond
+#include <SDL2/SDL_atomic.h> // For SDL_atomic_t
+#include <stdbool.h>
+#include <stddef.h> // For size_t
+
+// How far text.txt has been typed, and the counters of the session typing it (see progress_checkpoint.c).
+// Offsets count bytes of the text as loaded (converted, stripped and preprocessed), not of the file itself.
+typedef struct {
+    size_t text_offset;        // Typing position
+    Uint64 text_hash;          // ProgressTextHash of the text before text_offset
+    size_t compaction_cut_len; // Bytes being cut from the front of text.txt by a compaction that may not have finished, or 0
+    bool session_open;         // A typing session had started and its stats were not recorded yet
+    unsigned long long total_keystrokes;
+    unsigned long long total_errors;
+    Uint32 elapsed_ms;         // Typing time of the session (pauses excluded)
+} ProgressRecord;
+
+// Writes checkpoints on its own thread and, now and then, compacts text.txt (drops the typed part)
+typedef struct {
+    // Shared with the saver thread, guarded by mutex
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    ProgressRecord pending_record;
+    bool record_pending;
+    const char *compaction_file_text; // Loaded text of the current text.txt, NULL if no compaction is requested
+    size_t compaction_file_text_len;
+    size_t compaction_skip_len;    // Typed bytes at its front, which the compaction drops
+    bool compaction_done;          // The requested compaction has ended (compaction_ok says how)
+    bool compaction_ok;
+    bool compaction_refused;       // text.txt does not load back unchanged (see progress_file_matches_text)
+    bool quit_requested;
+    SDL_atomic_t cancel_requested; // Stops a compaction between pieces
+
+    // Saver thread
+    AppContext *appCtx;
+    SDL_Thread *thread;
+    char checkpoint_path[MAX_PATH_LEN];
+    char text_path[MAX_PATH_LEN];
+    bool file_checked;             // text.txt was found to hold exactly the loaded text (or was written by a compaction)
+
+    // Main thread
+    bool active;                   // Started for text.txt (not for piped text)
+    size_t text_start_offset;      // Offset of text_to_type[0] in the text loaded from text.txt
+    size_t file_start_offset;      // Offset in the loaded text where text.txt now begins (moved by compactions)
+    bool compaction_in_flight;
+    size_t compaction_cut_offset;  // Loaded-text offset text.txt will begin at once the compaction is done
+    bool compaction_disabled;      // text.txt is kept as the user wrote it (another encoding, markup, changed text)
+    ProgressRecord last_record;    // Last record handed to the saver thread
+    bool record_dirty;             // Progress changed since last_record
+    Uint32 last_post_ms;
+} ProgressSaver;
+
+// Reads the checkpoint; returns false if there is none or it is damaged
+bool ProgressCheckpointLoad(AppContext *appCtx, const char *checkpoint_path, ProgressRecord *record);
+// Writes the checkpoint (to a temporary file renamed over the old one)
+bool ProgressCheckpointWrite(AppContext *appCtx, const char *checkpoint_path, const ProgressRecord *record);
+// Hash of the PROGRESS_HASH_BYTES of text before offset (fewer near the start), to check that the text is still the same
+Uint64 ProgressTextHash(const char *text, size_t offset);
+// Offsets to try when resuming, most likely first (two if a compaction may have been cut short); returns their count
+int ProgressResumeOffsets(const ProgressRecord *record, size_t resume_offsets[2]);
+
+// Starts the saver for text.txt; text_start_offset is where typing resumed in the loaded text (TextLoader start_offset)
+bool ProgressSaverStart(AppContext *appCtx, ProgressSaver *saver, const char *checkpoint_path, const char *text_path,
+                        size_t text_start_offset);
+// Main thread, every loop iteration: notes the typing position and hands a checkpoint to the saver thread at most
+// every PROGRESS_CHECKPOINT_INTERVAL_MS. Once the whole text is loaded and at least half of text.txt has been typed,
+// also has text.txt rewritten without the typed part in the background.
+void ProgressSaverUpdate(AppContext *appCtx, ProgressSaver *saver, const char *text_to_type, size_t final_text_len,
+                         size_t current_input_byte_idx);
+// Milliseconds until ProgressSaverUpdate should be called to save unsaved progress, or -1 if there is none
+int ProgressSaverTimeoutMs(const ProgressSaver *saver);
+// On exit: cancels a running compaction, stops the thread and writes the final checkpoint (the session's stats
+// have been recorded). If the whole text was typed, text.txt is emptied instead. Call before the text is freed.
+void ProgressSaverStop(AppContext *appCtx, ProgressSaver *saver, const char *text_to_type, size_t final_text_len,
+                       size_t current_input_byte_idx);
+
+#endif // PROGRESS_CHECKPOINT_H
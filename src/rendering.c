@@ -1,10 +1,15 @@
 #include "rendering.h"
-#include "text_processing.h" // For get_codepoint_advance_and_metrics_func, TextBlockInfo, get_next_text_block_func
-#include "utf8_utils.h"      // For decode_utf8
+#include "text_processing.h" // For text_char_advance_and_metrics, next_text_char, TextBlockInfo
+#include "layout_logic.h"    // For LayoutNextBlock, LaidOutBlock
+#include "line_index.h"      // For LineIndexSeekLine
+#include "glyph_cache.h"     // For GlyphCacheLookup, GlyphCacheQueueDraw, GlyphCacheFlushDraws
+#include "text_stats.h"      // For TextStatsSyncPrefix
 #include "config.h"          // For TEXT_AREA_X, TEXT_AREA_W, DISPLAY_LINES, COL_CURSOR etc.
 #include <stdio.h>           // For snprintf
-#include <string.h>          // For memcmp
+#include <string.h>          // For memcmp, memset
 #include <math.h>            // For roundf
+#include <stdlib.h>          // For realloc, free
+#include <limits.h>          // For INT_MAX
 
 // Helper function for logging if appCtx->log_file_handle is available
 static void log_render_message_format(AppContext *appCtx, const char* format, ...) {
@@ -18,6 +23,46 @@ static void log_render_message_format(AppContext *appCtx, const char* format, ..
     }
 }
 
+// Draws text with ui_font at logical (x, y). The texture is kept in the given ui_text_cache slot and
+// only re-rendered when the string or color differs from the last call; returns NULL if nothing was drawn.
+static const UiTextCacheEntry* draw_cached_ui_text(AppContext *appCtx, int slot, const char *text, SDL_Color color, int x, int y) {
+    UiTextCacheEntry *entry = &appCtx->ui_text_cache[slot];
+
+    bool same_color = entry->color.r == color.r && entry->color.g == color.g && entry->color.b == color.b && entry->color.a == color.a;
+    if (!entry->texture || !same_color || strncmp(entry->text, text, sizeof(entry->text)) != 0) {
+        if (entry->texture) {
+            SDL_DestroyTexture(entry->texture);
+            entry->texture = NULL;
+        }
+        SDL_Surface *surf = TTF_RenderText_Blended(appCtx->ui_font, text, color);
+        if (!surf) {
+            log_render_message_format(appCtx, "Error rendering UI text surface '%s': %s", text, TTF_GetError());
+            return NULL;
+        }
+        entry->texture = SDL_CreateTextureFromSurface(appCtx->ren, surf);
+        if (!entry->texture) {
+            log_render_message_format(appCtx, "Error creating UI text texture '%s': %s", text, SDL_GetError());
+            SDL_FreeSurface(surf);
+            return NULL;
+        }
+        // Convert surface dimensions (scaled pixels) to logical dimensions
+        entry->scaled_w = surf->w;
+        entry->scaled_h = surf->h;
+        entry->logical_w = (appCtx->scale_x_factor > 0.01f && surf->w > 0) ? (int)roundf((float)surf->w / appCtx->scale_x_factor) : surf->w;
+        entry->logical_h = (appCtx->scale_y_factor > 0.01f && surf->h > 0) ? (int)roundf((float)surf->h / appCtx->scale_y_factor) : surf->h;
+        if (surf->w > 0 && entry->logical_w <= 0) entry->logical_w = 1;
+        if (surf->h > 0 && entry->logical_h <= 0) entry->logical_h = 1;
+        SDL_FreeSurface(surf);
+
+        snprintf(entry->text, sizeof(entry->text), "%s", text);
+        entry->color = color;
+    }
+
+    SDL_Rect dst_logical = {x, y, entry->logical_w, entry->logical_h}; // dst_rect uses logical dimensions
+    SDL_RenderCopy(appCtx->ren, entry->texture, NULL, &dst_logical);
+    return entry;
+}
+
 void RenderAppTimer(AppContext *appCtx, int *out_timer_h_logical, int *out_timer_w_logical) {
     // Ensure AppContext and essential pointers are valid, especially ui_font
     if (!appCtx || !appCtx->ui_font || !appCtx->ren || !out_timer_h_logical || !out_timer_w_logical) {
@@ -57,37 +102,16 @@ void RenderAppTimer(AppContext *appCtx, int *out_timer_h_logical, int *out_timer
     }
     timer_buf[sizeof(timer_buf)-1] = '\0';
 
-    int scaled_timer_pixel_h = 0; // Height of the rendered text surface in scaled pixels
-    int scaled_timer_pixel_w = 0; // Width of the rendered text surface in scaled pixels
-
-    // Render text using the UI font
-    SDL_Surface *timer_surf = TTF_RenderText_Blended(appCtx->ui_font, timer_buf, appCtx->palette[COL_CURSOR]);
-
-    if (timer_surf) {
-        SDL_Texture *timer_tex = SDL_CreateTextureFromSurface(appCtx->ren, timer_surf);
-        if (timer_tex) {
-            scaled_timer_pixel_w = timer_surf->w; // Physical pixel width from surface
-            scaled_timer_pixel_h = timer_surf->h; // Physical pixel height from surface
+    int scaled_timer_pixel_h = 0; // Height of the rendered text in scaled pixels
+    int scaled_timer_pixel_w = 0; // Width of the rendered text in scaled pixels
 
-            // Convert physical pixel dimensions from surface to logical dimensions for dst_rect
-            int logical_w = (appCtx->scale_x_factor > 0.01f && scaled_timer_pixel_w > 0) ? (int)roundf((float)scaled_timer_pixel_w / appCtx->scale_x_factor) : scaled_timer_pixel_w;
-            int logical_h = (appCtx->scale_y_factor > 0.01f && scaled_timer_pixel_h > 0) ? (int)roundf((float)scaled_timer_pixel_h / appCtx->scale_y_factor) : scaled_timer_pixel_h;
-            if (scaled_timer_pixel_w > 0 && logical_w <= 0) logical_w = 1;
-            if (scaled_timer_pixel_h > 0 && logical_h <= 0) logical_h = 1;
-
-
-            SDL_Rect rtimer = { TEXT_AREA_X, TEXT_AREA_PADDING_Y, logical_w, logical_h };
-            SDL_RenderCopy(appCtx->ren, timer_tex, NULL, &rtimer); // dst_rect uses logical dimensions
-            SDL_DestroyTexture(timer_tex);
-        } else {
-            log_render_message_format(appCtx, "Error: Failed to create timer texture from surface: %s", SDL_GetError());
-            // Fallback: Get dimensions using TTF_SizeText (returns in pixels for the loaded font)
-            TTF_SizeText(appCtx->ui_font, timer_buf, &scaled_timer_pixel_w, &scaled_timer_pixel_h);
-        }
-        SDL_FreeSurface(timer_surf);
+    // Render text using the UI font; the texture is reused until the displayed second changes
+    const UiTextCacheEntry *timer_entry = draw_cached_ui_text(appCtx, UI_TEXT_TIMER, timer_buf, appCtx->palette[COL_CURSOR], TEXT_AREA_X, TEXT_AREA_PADDING_Y);
+    if (timer_entry) {
+        scaled_timer_pixel_w = timer_entry->scaled_w;
+        scaled_timer_pixel_h = timer_entry->scaled_h;
     } else {
-        log_render_message_format(appCtx, "Error: Failed to render timer text surface: %s", TTF_GetError());
-        // Fallback: Get dimensions using TTF_SizeText
+        // Fallback: Get dimensions using TTF_SizeText (returns in pixels for the loaded font)
         TTF_SizeText(appCtx->ui_font, timer_buf, &scaled_timer_pixel_w, &scaled_timer_pixel_h);
     }
 
@@ -134,29 +158,9 @@ void RenderLiveStats(AppContext *appCtx,
     float live_wpm = (elapsed_minutes > 0.0001f) ? (live_net_words_for_wpm / elapsed_minutes) : 0.0f;
     if (live_wpm < 0.0f) live_wpm = 0.0f;
 
-    int live_typed_words_count = 0;
-    if (current_input_byte_idx > 0 && input_buffer) {
-        bool in_word_flag = false;
-        const char* p_word_scan_iter = input_buffer;
-        const char* p_word_scan_end_iter = input_buffer + current_input_byte_idx;
-        while(p_word_scan_iter < p_word_scan_end_iter) {
-            const char* temp_p_word_start = p_word_scan_iter;
-            Sint32 cp_word = decode_utf8(&p_word_scan_iter, p_word_scan_end_iter);
-            if (cp_word <= 0) {
-                if (p_word_scan_iter <= temp_p_word_start && p_word_scan_iter < p_word_scan_end_iter) p_word_scan_iter++; else break;
-                continue;
-            }
-            bool is_current_char_separator = (cp_word == ' ' || cp_word == '\n' || cp_word == '\t');
-            if (!is_current_char_separator) {
-                if (!in_word_flag) {
-                    live_typed_words_count++;
-                    in_word_flag = true;
-                }
-            } else {
-                in_word_flag = false;
-            }
-        }
-    }
+    // Only the bytes typed since the last frame are scanned
+    TextStatsSyncPrefix(&appCtx->typed_input_stats, input_buffer, current_input_byte_idx);
+    int live_typed_words_count = (int)appCtx->typed_input_stats.word_count;
 
     char wpm_buf[32], acc_buf[32], words_buf[32];
     snprintf(wpm_buf, sizeof(wpm_buf)-1, "WPM: %.0f", live_wpm); wpm_buf[sizeof(wpm_buf)-1] = '\0';
@@ -169,66 +173,342 @@ void RenderLiveStats(AppContext *appCtx,
     // Align all UI elements (timer, stats) to the same top Y coordinate for simplicity and visual neatness
     int stats_y_render_pos_logical = timer_y_pos_logical;
 
-    SDL_Surface *surf;
-    SDL_Texture *tex;
-    SDL_Rect dst_logical; // Destination rectangle in logical coordinates
+    // Each label keeps its texture until its formatted value changes
+    const UiTextCacheEntry *entry;
 
     // Render WPM
-    surf = TTF_RenderText_Blended(appCtx->ui_font, wpm_buf, stat_color); // Use ui_font
-    if (surf) {
-        tex = SDL_CreateTextureFromSurface(appCtx->ren, surf);
-        if (tex) {
-            // Convert surface dimensions (scaled pixels) to logical dimensions
-            int logical_w = (appCtx->scale_x_factor > 0.01f && surf->w > 0) ? (int)roundf((float)surf->w / appCtx->scale_x_factor) : surf->w;
-            int logical_h = (appCtx->scale_y_factor > 0.01f && surf->h > 0) ? (int)roundf((float)surf->h / appCtx->scale_y_factor) : surf->h;
-            if (surf->w > 0 && logical_w <= 0) logical_w = 1;
-            if (surf->h > 0 && logical_h <= 0) logical_h = 1;
-
-            dst_logical = (SDL_Rect){current_x_render_pos_logical, stats_y_render_pos_logical, logical_w, logical_h};
-            SDL_RenderCopy(appCtx->ren, tex, NULL, &dst_logical);
-            current_x_render_pos_logical += logical_w + 15; // Advance by logical width + padding
-            SDL_DestroyTexture(tex);
-        } else { log_render_message_format(appCtx, "Error creating WPM texture: %s", SDL_GetError()); }
-        SDL_FreeSurface(surf);
-    } else { log_render_message_format(appCtx, "Error rendering WPM surface: %s", TTF_GetError()); }
+    entry = draw_cached_ui_text(appCtx, UI_TEXT_WPM, wpm_buf, stat_color, current_x_render_pos_logical, stats_y_render_pos_logical);
+    if (entry) current_x_render_pos_logical += entry->logical_w + 15; // Advance by logical width + padding
 
     // Render Accuracy
-    surf = TTF_RenderText_Blended(appCtx->ui_font, acc_buf, stat_color); // Use ui_font
-    if (surf) {
-        tex = SDL_CreateTextureFromSurface(appCtx->ren, surf);
-        if (tex) {
-            int logical_w = (appCtx->scale_x_factor > 0.01f && surf->w > 0) ? (int)roundf((float)surf->w / appCtx->scale_x_factor) : surf->w;
-            int logical_h = (appCtx->scale_y_factor > 0.01f && surf->h > 0) ? (int)roundf((float)surf->h / appCtx->scale_y_factor) : surf->h;
-            if (surf->w > 0 && logical_w <= 0) logical_w = 1;
-            if (surf->h > 0 && logical_h <= 0) logical_h = 1;
-
-            dst_logical = (SDL_Rect){current_x_render_pos_logical, stats_y_render_pos_logical, logical_w, logical_h};
-            SDL_RenderCopy(appCtx->ren, tex, NULL, &dst_logical);
-            current_x_render_pos_logical += logical_w + 15;
-            SDL_DestroyTexture(tex);
-        } else { log_render_message_format(appCtx, "Error creating Accuracy texture: %s", SDL_GetError()); }
-        SDL_FreeSurface(surf);
-    } else { log_render_message_format(appCtx, "Error rendering Accuracy surface: %s", TTF_GetError()); }
+    entry = draw_cached_ui_text(appCtx, UI_TEXT_ACCURACY, acc_buf, stat_color, current_x_render_pos_logical, stats_y_render_pos_logical);
+    if (entry) current_x_render_pos_logical += entry->logical_w + 15;
 
     // Render Words
-    surf = TTF_RenderText_Blended(appCtx->ui_font, words_buf, stat_color); // Use ui_font
-    if (surf) {
-        tex = SDL_CreateTextureFromSurface(appCtx->ren, surf);
-        if (tex) {
-            int logical_w = (appCtx->scale_x_factor > 0.01f && surf->w > 0) ? (int)roundf((float)surf->w / appCtx->scale_x_factor) : surf->w;
-            int logical_h = (appCtx->scale_y_factor > 0.01f && surf->h > 0) ? (int)roundf((float)surf->h / appCtx->scale_y_factor) : surf->h;
-            if (surf->w > 0 && logical_w <= 0) logical_w = 1;
-            if (surf->h > 0 && logical_h <= 0) logical_h = 1;
-
-            dst_logical = (SDL_Rect){current_x_render_pos_logical, stats_y_render_pos_logical, logical_w, logical_h};
-            SDL_RenderCopy(appCtx->ren, tex, NULL, &dst_logical);
-            SDL_DestroyTexture(tex);
-        } else { log_render_message_format(appCtx, "Error creating Words texture: %s", SDL_GetError()); }
-        SDL_FreeSurface(surf);
-    } else { log_render_message_format(appCtx, "Error rendering Words surface: %s", TTF_GetError()); }
+    draw_cached_ui_text(appCtx, UI_TEXT_WORDS, words_buf, stat_color, current_x_render_pos_logical, stats_y_render_pos_logical);
+}
+
+// --- Line textures ---
+// Each visible wrapped line is drawn once into a render-target texture (full window width, one line high)
+// and the frame is composed from those textures. Input only redraws the glyphs whose typed/correct state
+// changed; lines that stay visible while scrolling keep their texture.
+
+void RenderMarkInputDirty(AppContext *appCtx, size_t from_byte, size_t to_byte) {
+    if (!appCtx || from_byte == to_byte) return;
+    LineTextureCache *cache = &appCtx->line_texture_cache;
+    if (from_byte > to_byte) { size_t tmp = from_byte; from_byte = to_byte; to_byte = tmp; }
+    if (from_byte < appCtx->typed_input_stats.byte_count) { // Counted input changed; recount on the next frame
+        memset(&appCtx->typed_input_stats, 0, sizeof(TextStats));
+    }
+    if (cache->dirty_begin >= cache->dirty_end) {
+        cache->dirty_begin = from_byte;
+        cache->dirty_end = to_byte;
+    } else {
+        if (from_byte < cache->dirty_begin) cache->dirty_begin = from_byte;
+        if (to_byte > cache->dirty_end) cache->dirty_end = to_byte;
+    }
 }
 
-// RenderTextContent remains unchanged as it uses appCtx->font and its specific caches/metrics
+void RenderInvalidateLineTextures(AppContext *appCtx, bool textures_lost) {
+    if (!appCtx) return;
+    LineTextureCache *cache = &appCtx->line_texture_cache;
+    for (int i = 0; i < LINE_TEXTURE_CACHE_SLOTS; i++) {
+        if (textures_lost && cache->slots[i].texture) {
+            SDL_DestroyTexture(cache->slots[i].texture);
+            cache->slots[i].texture = NULL;
+        }
+        cache->slots[i].valid = false;
+    }
+}
+
+void RenderFreeLineTextures(AppContext *appCtx) {
+    if (!appCtx) return;
+    RenderInvalidateLineTextures(appCtx, true);
+    free(appCtx->line_texture_cache.glyphs);
+    memset(&appCtx->line_texture_cache, 0, sizeof(LineTextureCache));
+}
+
+// Appends a glyph of viewport line `viewport_line`; lines arrive in nondecreasing order during layout
+static void push_line_glyph(LineTextureCache *cache, int *collected_line, int viewport_line, const LineGlyph *glyph) {
+    if (cache->glyph_count == cache->glyph_capacity) {
+        int new_capacity = cache->glyph_capacity ? cache->glyph_capacity * 2 : 256;
+        LineGlyph *new_glyphs = (LineGlyph*)realloc(cache->glyphs, (size_t)new_capacity * sizeof(LineGlyph));
+        if (!new_glyphs) return; // The glyph is simply not drawn this frame
+        cache->glyphs = new_glyphs;
+        cache->glyph_capacity = new_capacity;
+    }
+    while (*collected_line < viewport_line) cache->line_glyph_start[++(*collected_line)] = cache->glyph_count;
+    cache->glyphs[cache->glyph_count++] = *glyph;
+}
+
+// Queues the glyphs of a viewport line that overlap [x_begin, x_end) at vertical offset line_top_y
+TEXT_LOOP_SPECIALIZED void queue_line_glyphs(AppContext *appCtx, int viewport_line, int x_begin, int x_end, int line_top_y,
+                                             bool ascii_text) {
+    LineTextureCache *cache = &appCtx->line_texture_cache;
+    const int *ascii_entries = appCtx->glyph_texture_cache.ascii_entries;
+    for (int i = cache->line_glyph_start[viewport_line]; i < cache->line_glyph_start[viewport_line + 1]; i++) {
+        const LineGlyph *glyph = &cache->glyphs[i];
+        if (glyph->dst.x >= x_end || glyph->dst.x + glyph->dst.w <= x_begin) continue;
+        // ASCII glyphs are prebuilt; anything else is rasterized into the atlas on first use
+        int glyph_entry_idx = (ascii_text && glyph->codepoint < 128) ? ascii_entries[glyph->codepoint]
+                                                                     : GlyphCacheLookup(appCtx, glyph->codepoint);
+        if (glyph_entry_idx < 0) continue;
+        SDL_Rect dst_rect = glyph->dst;
+        dst_rect.y += line_top_y;
+        GlyphCacheQueueDraw(appCtx, glyph_entry_idx, &dst_rect, glyph->color); // Drawn in one batch per atlas page
+    }
+}
+
+// Draws the glyphs of a viewport line that overlap [x_begin, x_end) at vertical offset line_top_y
+static void draw_line_glyphs(AppContext *appCtx, int viewport_line, int x_begin, int x_end, int line_top_y) {
+    // The ASCII entries are only valid once the cache is set up (GlyphCacheLookup checks the same)
+    if (appCtx->text_is_ascii && appCtx->glyph_texture_cache.buckets && appCtx->ren) {
+        queue_line_glyphs(appCtx, viewport_line, x_begin, x_end, line_top_y, true);
+    } else {
+        queue_line_glyphs(appCtx, viewport_line, x_begin, x_end, line_top_y, false);
+    }
+    GlyphCacheFlushDraws(appCtx);
+}
+
+// Creates the slot texture on first use; false (and the direct drawing fallback from then on) if that fails
+static bool ensure_line_texture(AppContext *appCtx, LineTextureSlot *slot) {
+    LineTextureCache *cache = &appCtx->line_texture_cache;
+    if (slot->texture) return true;
+
+    slot->texture = SDL_CreateTexture(appCtx->ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, cache->texture_w, cache->texture_h);
+    if (!slot->texture) {
+        log_render_message_format(appCtx, "Line texture creation failed (%s); drawing text directly.", SDL_GetError());
+        cache->targets_unsupported = true;
+        RenderInvalidateLineTextures(appCtx, true);
+        return false;
+    }
+    SDL_SetTextureBlendMode(slot->texture, SDL_BLENDMODE_NONE); // Lines are opaque (background included)
+    slot->valid = false;
+    return true;
+}
+
+static bool begin_line_texture_drawing(AppContext *appCtx, LineTextureSlot *slot) {
+    if (SDL_SetRenderTarget(appCtx->ren, slot->texture) != 0) return false;
+    SDL_RenderSetScale(appCtx->ren, appCtx->scale_x_factor, appCtx->scale_y_factor); // Targets start at scale 1
+    SDL_SetRenderDrawColor(appCtx->ren, appCtx->palette[COL_BG].r, appCtx->palette[COL_BG].g, appCtx->palette[COL_BG].b, appCtx->palette[COL_BG].a);
+    return true;
+}
+
+// Redraws a whole line into its slot
+static void rebuild_line_texture(AppContext *appCtx, LineTextureSlot *slot, int viewport_line) {
+    LineTextureCache *cache = &appCtx->line_texture_cache;
+    if (!begin_line_texture_drawing(appCtx, slot)) return;
+    SDL_RenderClear(appCtx->ren);
+    draw_line_glyphs(appCtx, viewport_line, INT_MIN, INT_MAX, 0);
+
+    int first = cache->line_glyph_start[viewport_line], last = cache->line_glyph_start[viewport_line + 1];
+    slot->start_offset = (first < last) ? cache->glyphs[first].byte_offset : 0;
+    slot->end_offset = (first < last) ? cache->glyphs[last - 1].byte_offset + cache->glyphs[last - 1].byte_len : 0;
+    slot->abs_line_num = appCtx->first_visible_abs_line_num + viewport_line;
+    slot->valid = true;
+}
+
+// Redraws only the span of a cached line covered by glyphs in the dirty input range
+static void update_dirty_line_span(AppContext *appCtx, LineTextureSlot *slot, int viewport_line) {
+    LineTextureCache *cache = &appCtx->line_texture_cache;
+    if (cache->dirty_begin >= cache->dirty_end ||
+        slot->end_offset <= cache->dirty_begin || slot->start_offset >= cache->dirty_end) return;
+
+    int span_x_begin = INT_MAX, span_x_end = INT_MIN;
+    for (int i = cache->line_glyph_start[viewport_line]; i < cache->line_glyph_start[viewport_line + 1]; i++) {
+        const LineGlyph *glyph = &cache->glyphs[i];
+        if (glyph->byte_offset >= cache->dirty_end || glyph->byte_offset + glyph->byte_len <= cache->dirty_begin) continue;
+        if (glyph->dst.x < span_x_begin) span_x_begin = glyph->dst.x;
+        if (glyph->dst.x + glyph->dst.w > span_x_end) span_x_end = glyph->dst.x + glyph->dst.w;
+    }
+    if (span_x_begin >= span_x_end) return;
+    if (!begin_line_texture_drawing(appCtx, slot)) return;
+
+    // Neighbours overlapping the span are redrawn too, clipped so their pixels outside it are not blended twice.
+    // The fill is one pixel larger than the clip so rounding at fractional scales cannot leave an edge uncleared.
+    SDL_Rect clip_rect = {span_x_begin, 0, span_x_end - span_x_begin, appCtx->line_h};
+    SDL_Rect clear_rect = {span_x_begin - 1, -1, span_x_end - span_x_begin + 2, appCtx->line_h + 2};
+    SDL_RenderSetClipRect(appCtx->ren, &clip_rect);
+    SDL_RenderFillRect(appCtx->ren, &clear_rect);
+    draw_line_glyphs(appCtx, viewport_line, span_x_begin, span_x_end, 0);
+    SDL_RenderSetClipRect(appCtx->ren, NULL);
+}
+
+static bool line_textures_available(AppContext *appCtx) {
+    LineTextureCache *cache = &appCtx->line_texture_cache;
+    if (cache->targets_unsupported) return false;
+    if (!SDL_RenderTargetSupported(appCtx->ren)) {
+        log_render_message_format(appCtx, "Render targets not supported; drawing text directly.");
+        cache->targets_unsupported = true;
+        return false;
+    }
+    if (cache->texture_w <= 0 || cache->texture_h <= 0) {
+        cache->texture_w = (int)roundf(WINDOW_W * appCtx->scale_x_factor);
+        cache->texture_h = (int)roundf(appCtx->line_h * appCtx->scale_y_factor);
+        if (cache->texture_w <= 0 || cache->texture_h <= 0) return false;
+    }
+    return true;
+}
+
+// Brings the textures of the visible lines up to date and copies them to the screen
+static void compose_text_lines(AppContext *appCtx, int text_viewport_top_y) {
+    LineTextureCache *cache = &appCtx->line_texture_cache;
+    cache->frame++;
+
+    if (!line_textures_available(appCtx)) {
+        for (int v = 0; v < DISPLAY_LINES; v++) {
+            draw_line_glyphs(appCtx, v, INT_MIN, INT_MAX, text_viewport_top_y + v * appCtx->line_h);
+        }
+        cache->dirty_begin = cache->dirty_end = 0;
+        return;
+    }
+
+    // Lines still held by a slot keep it; the others take the least recently used free slot
+    int slot_for_line[DISPLAY_LINES];
+    bool slot_taken[LINE_TEXTURE_CACHE_SLOTS] = {false};
+    for (int v = 0; v < DISPLAY_LINES; v++) {
+        slot_for_line[v] = -1;
+        for (int s = 0; s < LINE_TEXTURE_CACHE_SLOTS; s++) {
+            if (cache->slots[s].valid && cache->slots[s].abs_line_num == appCtx->first_visible_abs_line_num + v) {
+                slot_for_line[v] = s;
+                slot_taken[s] = true;
+                break;
+            }
+        }
+    }
+    for (int v = 0; v < DISPLAY_LINES; v++) {
+        if (slot_for_line[v] >= 0) continue;
+        int lru_slot = -1;
+        for (int s = 0; s < LINE_TEXTURE_CACHE_SLOTS; s++) {
+            if (slot_taken[s]) continue;
+            if (!cache->slots[s].valid) { lru_slot = s; break; }
+            if (lru_slot < 0 || cache->slots[s].last_used_frame < cache->slots[lru_slot].last_used_frame) lru_slot = s;
+        }
+        slot_for_line[v] = lru_slot;
+        slot_taken[lru_slot] = true;
+        cache->slots[lru_slot].valid = false;
+    }
+
+    bool drew_into_target = false;
+    for (int v = 0; v < DISPLAY_LINES; v++) {
+        LineTextureSlot *slot = &cache->slots[slot_for_line[v]];
+        if (!ensure_line_texture(appCtx, slot)) {
+            if (drew_into_target) SDL_SetRenderTarget(appCtx->ren, NULL);
+            SDL_RenderSetScale(appCtx->ren, appCtx->scale_x_factor, appCtx->scale_y_factor);
+            compose_text_lines(appCtx, text_viewport_top_y); // Now takes the direct path
+            return;
+        }
+        if (!slot->valid) rebuild_line_texture(appCtx, slot, v);
+        else update_dirty_line_span(appCtx, slot, v);
+        slot->last_used_frame = cache->frame;
+        drew_into_target = true;
+    }
+    SDL_SetRenderTarget(appCtx->ren, NULL);
+    SDL_RenderSetScale(appCtx->ren, appCtx->scale_x_factor, appCtx->scale_y_factor);
+
+    for (int v = 0; v < DISPLAY_LINES; v++) {
+        LineTextureSlot *slot = &cache->slots[slot_for_line[v]];
+        if (!slot->valid) continue; // Target drawing failed; the line stays blank for this frame
+        SDL_Rect line_dst = {0, text_viewport_top_y + v * appCtx->line_h, WINDOW_W, appCtx->line_h};
+        SDL_RenderCopy(appCtx->ren, slot->texture, NULL, &line_dst);
+    }
+
+    // Off-screen slots were not updated, so any that the input touched must be redrawn when they come back
+    for (int s = 0; s < LINE_TEXTURE_CACHE_SLOTS; s++) {
+        LineTextureSlot *slot = &cache->slots[s];
+        if (slot->valid && !slot_taken[s] && cache->dirty_begin < cache->dirty_end &&
+            slot->start_offset < cache->dirty_end && slot->end_offset > cache->dirty_begin) {
+            slot->valid = false;
+        }
+    }
+    cache->dirty_begin = cache->dirty_end = 0;
+}
+
+// Collects the glyphs of a laid-out word or space run into the line glyph lists, wrapping a block wider than the
+// line as LayoutNextBlock does, and places the cursor if it is on one of its characters
+TEXT_LOOP_SPECIALIZED void collect_block_glyphs(AppContext *appCtx, const LaidOutBlock *laid, const char *input_buffer,
+                                                size_t current_input_byte_idx, int text_viewport_top_y, int *collected_line,
+                                                int *out_final_cursor_draw_x, int *out_final_cursor_draw_y_baseline,
+                                                bool ascii_text) {
+    LineTextureCache *line_cache = &appCtx->line_texture_cache;
+    const char *p_char_in_block = laid->block.start_ptr;
+    const char *p_char_end_in_block = laid->block.start_ptr + laid->block.num_bytes;
+    size_t char_offset_within_block = 0;
+    int char_render_px = laid->x;
+    int char_current_abs_line_num_for_render = laid->abs_line_num;
+    int char_render_py_baseline = text_viewport_top_y + (laid->abs_line_num - appCtx->first_visible_abs_line_num) * appCtx->line_h;
+
+    while(p_char_in_block < p_char_end_in_block) {
+        int char_current_viewport_line_for_render = char_current_abs_line_num_for_render - appCtx->first_visible_abs_line_num;
+        if (char_current_viewport_line_for_render >= DISPLAY_LINES) break;
+
+        const char* glyph_start_ptr_in_block = p_char_in_block;
+        Sint32 cp_to_render = next_text_char(&p_char_in_block, p_char_end_in_block, ascii_text);
+        size_t glyph_byte_len = (size_t)(p_char_in_block - glyph_start_ptr_in_block);
+
+        if (cp_to_render <= 0 || glyph_byte_len == 0) {
+            if (p_char_in_block <= glyph_start_ptr_in_block && p_char_in_block < p_char_end_in_block) p_char_in_block++; else break;
+            continue;
+        }
+
+        size_t char_absolute_byte_pos_in_doc = laid->start_offset + char_offset_within_block;
+        if (char_absolute_byte_pos_in_doc == current_input_byte_idx &&
+            char_current_viewport_line_for_render >= 0 && char_current_viewport_line_for_render < DISPLAY_LINES) {
+            *out_final_cursor_draw_x = char_render_px;
+            *out_final_cursor_draw_y_baseline = char_render_py_baseline;
+        }
+
+        int glyph_w_metric = 0, glyph_h_metric = 0; // These will be filled with logical metrics
+        int advance = text_char_advance_and_metrics(appCtx, cp_to_render, &glyph_w_metric, &glyph_h_metric, ascii_text);
+
+        // Same character-level wrap as LayoutNextBlock for blocks wider than the line
+        if (char_render_px + advance > TEXT_AREA_X + TEXT_AREA_W && char_render_px != TEXT_AREA_X ) {
+            char_current_abs_line_num_for_render++;
+            char_current_viewport_line_for_render = char_current_abs_line_num_for_render - appCtx->first_visible_abs_line_num;
+            if (char_current_viewport_line_for_render >= DISPLAY_LINES) break;
+
+            char_render_py_baseline = text_viewport_top_y + char_current_viewport_line_for_render * appCtx->line_h;
+            char_render_px = TEXT_AREA_X;
+
+            if (char_absolute_byte_pos_in_doc == current_input_byte_idx &&
+                char_current_viewport_line_for_render >=0 && char_current_viewport_line_for_render < DISPLAY_LINES) {
+                *out_final_cursor_draw_x = char_render_px;
+                *out_final_cursor_draw_y_baseline = char_render_py_baseline;
+            }
+        }
+
+        // Lines above the viewport are laid out but not drawn
+        if(cp_to_render >= 32 && char_current_viewport_line_for_render >= 0){
+            bool char_is_typed = char_absolute_byte_pos_in_doc < current_input_byte_idx;
+            bool char_is_correct = false;
+            if (char_is_typed && ascii_text) {
+                char_is_correct = (input_buffer[char_absolute_byte_pos_in_doc] == *glyph_start_ptr_in_block);
+            } else if(char_is_typed && char_absolute_byte_pos_in_doc + glyph_byte_len <= current_input_byte_idx) {
+                char_is_correct = (memcmp(glyph_start_ptr_in_block, input_buffer + char_absolute_byte_pos_in_doc, glyph_byte_len) == 0);
+            }
+
+            SDL_Color render_color = appCtx->palette[char_is_typed ? (char_is_correct ? COL_CORRECT : COL_INCORRECT) : COL_TEXT];
+
+            // Ensure logical metrics are valid for rendering
+            if(glyph_w_metric == 0 && advance > 0) glyph_w_metric = advance; // Use logical advance
+            if(glyph_h_metric == 0) glyph_h_metric = appCtx->line_h; // Use logical line height
+
+            // Vertical centering of the glyph relative to logical line_h
+            int y_offset_for_glyph = (appCtx->line_h > glyph_h_metric) ? (appCtx->line_h - glyph_h_metric) / 2 : 0; // All are logical units
+            LineGlyph line_glyph = {
+                {char_render_px, y_offset_for_glyph, glyph_w_metric, glyph_h_metric}, // Logical, relative to the line top
+                (Uint32)cp_to_render, render_color, char_absolute_byte_pos_in_doc, glyph_byte_len
+            };
+            push_line_glyph(line_cache, collected_line, char_current_viewport_line_for_render, &line_glyph);
+        }
+        char_render_px += advance; // Advance by logical advance
+        char_offset_within_block += glyph_byte_len;
+    }
+}
+
+// RenderTextContent uses appCtx->font and its specific caches/metrics.
+// Layout starts from the line index entry for the first visible line, so only the viewport is walked.
+// The walk collects the visible glyphs per line; compose_text_lines then draws what changed into the line textures.
 void RenderTextContent(AppContext *appCtx, const char *text_to_type, size_t final_text_len,
                        const char *input_buffer, size_t current_input_byte_idx,
                        int text_viewport_top_y,
@@ -241,11 +521,6 @@ void RenderTextContent(AppContext *appCtx, const char *text_to_type, size_t fina
         return;
     }
 
-    int render_pen_x = TEXT_AREA_X;
-    int render_current_abs_line_num = 0;
-    const char *p_render_iter = text_to_type;
-    const char *p_text_end_for_render = text_to_type + final_text_len;
-
     *out_final_cursor_draw_x = -100;
     *out_final_cursor_draw_y_baseline = -100;
 
@@ -257,199 +532,70 @@ void RenderTextContent(AppContext *appCtx, const char *text_to_type, size_t fina
         }
     }
 
-    while(p_render_iter < p_text_end_for_render) {
-        int current_viewport_line_idx = render_current_abs_line_num - appCtx->first_visible_abs_line_num;
-        if (current_viewport_line_idx >= DISPLAY_LINES) break;
-
-        size_t block_start_byte_offset_in_doc = (size_t)(p_render_iter - text_to_type);
-        TextBlockInfo block = get_next_text_block_func(appCtx, &p_render_iter, p_text_end_for_render, render_pen_x);
-
-        if (block.num_bytes == 0 && p_render_iter >= p_text_end_for_render) break;
-        if (block.num_bytes == 0 || !block.start_ptr) {
-            if(p_render_iter < p_text_end_for_render) p_render_iter++; else break;
-            continue;
+    LineTextureCache *line_cache = &appCtx->line_texture_cache;
+    if (line_cache->cached_text != text_to_type || line_cache->cached_text_len != final_text_len) {
+        RenderInvalidateLineTextures(appCtx, false);
+        line_cache->cached_text = text_to_type;
+        line_cache->cached_text_len = final_text_len;
+    }
+    line_cache->glyph_count = 0;
+    line_cache->line_glyph_start[0] = 0;
+    int collected_line = 0;
+
+    LayoutPenState pen_state;
+    LineIndexSeekLine(appCtx, text_to_type, final_text_len, appCtx->first_visible_abs_line_num, &pen_state);
+
+    LaidOutBlock laid;
+    bool reached_text_end = false;
+    while (true) {
+        if (pen_state.abs_line_num - appCtx->first_visible_abs_line_num >= DISPLAY_LINES) break;
+        if (!LayoutNextBlock(appCtx, text_to_type, final_text_len, &pen_state, &laid)) {
+            reached_text_end = true;
+            break;
         }
 
+        TextBlockInfo block = laid.block;
+        if (block.num_bytes == 0 || !block.start_ptr) continue;
+
+        int current_viewport_line_idx = laid.abs_line_num - appCtx->first_visible_abs_line_num;
+        if (current_viewport_line_idx >= DISPLAY_LINES) break;
+        size_t block_start_byte_offset_in_doc = laid.start_offset;
         int line_on_screen_y_baseline = text_viewport_top_y + current_viewport_line_idx * appCtx->line_h;
 
         if (block_start_byte_offset_in_doc == current_input_byte_idx &&
             current_viewport_line_idx >=0 && current_viewport_line_idx < DISPLAY_LINES ) {
-            *out_final_cursor_draw_x = render_pen_x;
+            *out_final_cursor_draw_x = laid.x;
             *out_final_cursor_draw_y_baseline = line_on_screen_y_baseline;
         }
 
-        if (block.is_newline) {
-            render_current_abs_line_num++;
-            render_pen_x = TEXT_AREA_X;
-        } else {
-            int x_block_starts_on_this_line = render_pen_x;
-            int y_baseline_for_block_content = line_on_screen_y_baseline;
-            bool wrap_this_block = false;
-
-            if (render_pen_x != TEXT_AREA_X && block.is_word) {
-                if (render_pen_x + block.pixel_width > TEXT_AREA_X + TEXT_AREA_W) {
-                    wrap_this_block = true;
-                } else {
-                    const char *p_peek_next_char_after_block = p_render_iter;
-                    if (p_peek_next_char_after_block < p_text_end_for_render) {
-                        const char *temp_peek_iter = p_peek_next_char_after_block;
-                        int pen_x_after_this_block = render_pen_x + block.pixel_width;
-                        TextBlockInfo next_block_after_this = get_next_text_block_func(appCtx, &temp_peek_iter, p_text_end_for_render, pen_x_after_this_block);
-
-                        if (next_block_after_this.num_bytes > 0 && !next_block_after_this.is_word &&
-                            !next_block_after_this.is_newline && !next_block_after_this.is_tab) {
-                            const char* space_block_char_ptr = next_block_after_this.start_ptr;
-                            Sint32 cp_space_in_next_block = decode_utf8(&space_block_char_ptr, next_block_after_this.start_ptr + next_block_after_this.num_bytes);
-                            if (cp_space_in_next_block == ' ') {
-                                int space_char_width = get_codepoint_advance_and_metrics_func(appCtx, (Uint32)cp_space_in_next_block, appCtx->space_advance_width,NULL,NULL);
-                                if (space_char_width > 0 && (pen_x_after_this_block + space_char_width > TEXT_AREA_X + TEXT_AREA_W)) {
-                                    wrap_this_block = true;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-
-            if (wrap_this_block) {
-                render_current_abs_line_num++;
-                current_viewport_line_idx = render_current_abs_line_num - appCtx->first_visible_abs_line_num;
-                if (current_viewport_line_idx >= DISPLAY_LINES) break;
-
-                y_baseline_for_block_content = text_viewport_top_y + current_viewport_line_idx * appCtx->line_h;
-                render_pen_x = TEXT_AREA_X;
-                x_block_starts_on_this_line = render_pen_x;
-
-                if (block_start_byte_offset_in_doc == current_input_byte_idx &&
-                    current_viewport_line_idx >=0 && current_viewport_line_idx < DISPLAY_LINES) {
-                    *out_final_cursor_draw_x = render_pen_x;
-                    *out_final_cursor_draw_y_baseline = y_baseline_for_block_content;
-                }
-            }
-
-            if (current_viewport_line_idx >= 0 && current_viewport_line_idx < DISPLAY_LINES) {
-                if (!block.is_tab) {
-                    const char *p_char_in_block = block.start_ptr;
-                    const char *p_char_end_in_block = block.start_ptr + block.num_bytes;
-                    size_t char_offset_within_block = 0;
-                    int char_render_px = x_block_starts_on_this_line;
-                    int char_render_py_baseline = y_baseline_for_block_content;
-                    int char_current_abs_line_num_for_render = render_current_abs_line_num;
-
-                    while(p_char_in_block < p_char_end_in_block) {
-                        int char_current_viewport_line_for_render = char_current_abs_line_num_for_render - appCtx->first_visible_abs_line_num;
-                        if (char_current_viewport_line_for_render >= DISPLAY_LINES) goto end_char_loop_render_local;
-
-                        const char* glyph_start_ptr_in_block = p_char_in_block;
-                        Sint32 cp_to_render = decode_utf8(&p_char_in_block, p_char_end_in_block);
-                        size_t glyph_byte_len = (size_t)(p_char_in_block - glyph_start_ptr_in_block);
-
-                        if (cp_to_render <= 0 || glyph_byte_len == 0) {
-                            if (p_char_in_block <= glyph_start_ptr_in_block && p_char_in_block < p_char_end_in_block) p_char_in_block++; else break;
-                            continue;
-                        }
-
-                        size_t char_absolute_byte_pos_in_doc = block_start_byte_offset_in_doc + char_offset_within_block;
-                        if (char_absolute_byte_pos_in_doc == current_input_byte_idx &&
-                            char_current_viewport_line_for_render >= 0 && char_current_viewport_line_for_render < DISPLAY_LINES) {
-                            *out_final_cursor_draw_x = char_render_px;
-                            *out_final_cursor_draw_y_baseline = char_render_py_baseline;
-                        }
-
-                        int glyph_w_metric = 0, glyph_h_metric = 0; // These will be filled with logical metrics
-                        int advance = get_codepoint_advance_and_metrics_func(appCtx, (Uint32)cp_to_render, appCtx->space_advance_width, &glyph_w_metric, &glyph_h_metric);
-
-                        if (char_render_px + advance > TEXT_AREA_X + TEXT_AREA_W && char_render_px != TEXT_AREA_X ) {
-                            char_current_abs_line_num_for_render++;
-                            char_current_viewport_line_for_render = char_current_abs_line_num_for_render - appCtx->first_visible_abs_line_num;
-                            if (char_current_viewport_line_for_render >= DISPLAY_LINES) goto end_char_loop_render_local;
-
-                            char_render_py_baseline = text_viewport_top_y + char_current_viewport_line_for_render * appCtx->line_h;
-                            char_render_px = TEXT_AREA_X;
-
-                            if (char_absolute_byte_pos_in_doc == current_input_byte_idx &&
-                                char_current_viewport_line_for_render >=0 && char_current_viewport_line_for_render < DISPLAY_LINES) {
-                                *out_final_cursor_draw_x = char_render_px;
-                                *out_final_cursor_draw_y_baseline = char_render_py_baseline;
-                            }
-                        }
-
-                        SDL_Color render_color;
-                        bool char_is_typed = char_absolute_byte_pos_in_doc < current_input_byte_idx;
-                        bool char_is_correct = false;
-                        if(char_is_typed){
-                            if(char_absolute_byte_pos_in_doc + glyph_byte_len <= current_input_byte_idx) {
-                                char_is_correct = (memcmp(glyph_start_ptr_in_block, input_buffer + char_absolute_byte_pos_in_doc, glyph_byte_len) == 0);
-                            }
-                            render_color = char_is_correct ? appCtx->palette[COL_CORRECT] : appCtx->palette[COL_INCORRECT];
-                        } else {
-                            render_color = appCtx->palette[COL_TEXT];
-                        }
-
-                        if(cp_to_render >= 32){
-                            SDL_Texture* tex_to_render =NULL;
-                            bool use_otf_render = false;
-
-                            if(cp_to_render < 128){ // Try to get from cache for ASCII
-                                int cache_color_idx = char_is_typed ? (char_is_correct ? COL_CORRECT : COL_INCORRECT) : COL_TEXT;
-                                tex_to_render = appCtx->glyph_tex_cache[cache_color_idx][(int)cp_to_render]; // This is a hi-res texture
-                                // glyph_w_metric and glyph_h_metric were already obtained from get_codepoint_advance_and_metrics_func
-                                // which uses cached logical metrics for these.
-                            }
-
-                            if(!tex_to_render && appCtx->font){ // If not in cache or not ASCII, render "on-the-fly"
-                                SDL_Surface* surf_otf = TTF_RenderGlyph32_Blended(appCtx->font, (Uint32)cp_to_render, render_color); // surf_otf is hi-res
-                                if(surf_otf){
-                                    tex_to_render = SDL_CreateTextureFromSurface(appCtx->ren, surf_otf); // Texture is hi-res
-                                    if(tex_to_render){
-                                        // glyph_w_metric and glyph_h_metric (logical) were already correctly obtained
-                                        // by get_codepoint_advance_and_metrics_func for non-cached characters.
-                                        // No need to recalculate them from surf_otf->w/h here, as that function handles it.
-                                    } else { log_render_message_format(appCtx, "RenderTextContent: OTF Tex Error for U+%04X: %s", cp_to_render, SDL_GetError()); }
-                                    SDL_FreeSurface(surf_otf);
-                                    use_otf_render = true;
-                                } else { log_render_message_format(appCtx, "RenderTextContent: OTF Surf Error for U+%04X: %s", cp_to_render, TTF_GetError()); }
-                            }
-
-                            if(tex_to_render){
-                                // Ensure logical metrics are valid for rendering
-                                if(glyph_w_metric == 0 && advance > 0) glyph_w_metric = advance; // Use logical advance
-                                if(glyph_h_metric == 0) glyph_h_metric = appCtx->line_h; // Use logical line height
-
-                                // Vertical centering of the glyph relative to logical line_h
-                                int y_offset_for_glyph = (appCtx->line_h > glyph_h_metric) ? (appCtx->line_h - glyph_h_metric) / 2 : 0; // All are logical units
-                                SDL_Rect dst_rect = {char_render_px, char_render_py_baseline + y_offset_for_glyph, glyph_w_metric, glyph_h_metric}; // dst_rect is logical
-                                SDL_RenderCopy(appCtx->ren, tex_to_render, NULL, &dst_rect);
-                                if(use_otf_render) SDL_DestroyTexture(tex_to_render);
-                            }
-                        }
-                        char_render_px += advance; // Advance by logical advance
-                        char_offset_within_block += glyph_byte_len;
-                    }
-                    end_char_loop_render_local:;
-                    render_pen_x = char_render_px;
-                    render_current_abs_line_num = char_current_abs_line_num_for_render;
-                } else {
-                    render_pen_x += block.pixel_width; // block.pixel_width is already logical
-                }
+        // Draw the characters of the block unless it lies entirely above the viewport
+        if (!block.is_newline && !block.is_tab &&
+            pen_state.abs_line_num - appCtx->first_visible_abs_line_num >= 0) {
+            if (appCtx->text_is_ascii) {
+                collect_block_glyphs(appCtx, &laid, input_buffer, current_input_byte_idx, text_viewport_top_y, &collected_line,
+                                     out_final_cursor_draw_x, out_final_cursor_draw_y_baseline, true);
             } else {
-                render_pen_x += block.pixel_width; // block.pixel_width is already logical
+                collect_block_glyphs(appCtx, &laid, input_buffer, current_input_byte_idx, text_viewport_top_y, &collected_line,
+                                     out_final_cursor_draw_x, out_final_cursor_draw_y_baseline, false);
             }
         }
 
         if (block_start_byte_offset_in_doc + block.num_bytes == current_input_byte_idx) {
-            int final_block_viewport_line = render_current_abs_line_num - appCtx->first_visible_abs_line_num;
+            int final_block_viewport_line = pen_state.abs_line_num - appCtx->first_visible_abs_line_num;
             if (final_block_viewport_line >=0 && final_block_viewport_line < DISPLAY_LINES) {
-                *out_final_cursor_draw_x = render_pen_x;
+                *out_final_cursor_draw_x = pen_state.pen_x;
                 *out_final_cursor_draw_y_baseline = text_viewport_top_y + final_block_viewport_line * appCtx->line_h;
             }
         }
     }
 
-    if (current_input_byte_idx == final_text_len) {
-        int final_text_end_viewport_line = render_current_abs_line_num - appCtx->first_visible_abs_line_num;
+    while (collected_line < DISPLAY_LINES) line_cache->line_glyph_start[++collected_line] = line_cache->glyph_count;
+    compose_text_lines(appCtx, text_viewport_top_y);
+
+    if (reached_text_end && current_input_byte_idx == final_text_len) {
+        int final_text_end_viewport_line = pen_state.abs_line_num - appCtx->first_visible_abs_line_num;
         if (final_text_end_viewport_line >=0 && final_text_end_viewport_line < DISPLAY_LINES) {
-            *out_final_cursor_draw_x = render_pen_x;
+            *out_final_cursor_draw_x = pen_state.pen_x;
             *out_final_cursor_draw_y_baseline = text_viewport_top_y + final_text_end_viewport_line * appCtx->line_h;
         }
     }
@@ -14,6 +14,12 @@ void RenderTextContent(AppContext *appCtx, const char *text_to_type, size_t fina
                        int text_viewport_top_y,
                        int *out_final_cursor_draw_x, int *out_final_cursor_draw_y_baseline);
 
+// Line textures: input bytes [from_byte, to_byte) changed state, or all textures must be redrawn
+// (textures_lost after SDL_RENDER_DEVICE_RESET, when the textures themselves are gone)
+void RenderMarkInputDirty(AppContext *appCtx, size_t from_byte, size_t to_byte);
+void RenderInvalidateLineTextures(AppContext *appCtx, bool textures_lost);
+void RenderFreeLineTextures(AppContext *appCtx);
+
 void RenderAppCursor(AppContext *appCtx, bool show_cursor_param, int final_cursor_x_on_screen,
                      int final_cursor_y_baseline_on_screen, int text_viewport_top_y);
 
@@ -0,0 +1,226 @@
+#include "replacement_rules.h"
+#include "utf8_utils.h" // For ValidateUTF8, encode_utf8
+#include "file_paths.h" // For fopen_unicode_path
+#include <stdio.h>      // For fgets, fclose, fprintf
+#include <stdlib.h>     // For calloc, free, strtoul
+#include <string.h>     // For memcpy, memcmp, memset, strlen, strerror
+#include <errno.h>      // For errno
+
+// Rules are compiled into a trie over bytes. Each state has one transition per byte class (all bytes that
+// occur in no "from" share class 0), so a match costs one table lookup per byte no matter how many rules
+// there are, and the preprocessor only calls the matcher at bytes that start some rule.
+//
+// Rules file format (UTF-8, one rule per line, '#' starts a comment line):
+//     "from" = "to"
+// Escapes inside quotes: \" \\ \t \uXXXX \UXXXXXXXX. "from" must not contain line breaks or NUL.
+
+static const char *builtin_rules[][2] = {
+    {"--", "\xE2\x80\x93"},           // Double hyphen -> en dash
+    {"\xE2\x80\x94", "\xE2\x80\x93"}, // Em dash -> en dash, for consistency
+    {"\xE2\x80\xA6", "..."},          // Ellipsis
+    {"\xE2\x80\x98", "'"},            // Smart quotes -> apostrophe
+    {"\xE2\x80\x99", "'"},
+    {"\xE2\x80\x9C", "'"},
+    {"\xE2\x80\x9D", "'"},
+};
+
+// Helper function for logging if appCtx->log_file_handle is available
+static void log_rules_message_format(AppContext *appCtx, const char* format, ...) {
+    if (appCtx && appCtx->log_file_handle && format) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(appCtx->log_file_handle, format, args);
+        va_end(args);
+        fprintf(appCtx->log_file_handle, "\n");
+        fflush(appCtx->log_file_handle);
+    }
+}
+
+void ReplacementRulesFree(ReplacementRules *rules) {
+    if (!rules) return;
+    free(rules->transitions);
+    free(rules->accept_rule);
+    free(rules->has_children);
+    memset(rules, 0, sizeof(ReplacementRules));
+}
+
+int ReplacementRulesMatch(const ReplacementRules *rules, const char *p, const char *end, bool input_is_final) {
+    if (!rules || rules->state_count == 0) return REPLACEMENT_NO_MATCH;
+    int state = 1, best_rule = REPLACEMENT_NO_MATCH;
+    for (const char *q = p; q < end; q++) {
+        state = rules->transitions[state * rules->class_count + rules->byte_class[(unsigned char)*q]];
+        if (state == 0) return best_rule;
+        if (rules->accept_rule[state] >= 0) best_rule = rules->accept_rule[state];
+    }
+    return (!input_is_final && rules->has_children[state]) ? REPLACEMENT_NEED_MORE_INPUT : best_rule;
+}
+
+// Adds or replaces a rule; "from" and "to" must be valid UTF-8 of the allowed lengths
+static bool add_rule(ReplacementRules *rules, const char *from, size_t from_len, const char *to, size_t to_len) {
+    int rule_idx = 0;
+    while (rule_idx < rules->rule_count &&
+           !(rules->rules[rule_idx].from_len == from_len && memcmp(rules->rules[rule_idx].from, from, from_len) == 0)) {
+        rule_idx++;
+    }
+    if (rule_idx == rules->rule_count) {
+        if (rules->rule_count == REPLACEMENT_RULES_MAX) return false;
+        rules->rule_count++;
+    }
+    ReplacementRule *rule = &rules->rules[rule_idx];
+    memcpy(rule->from, from, from_len);
+    memcpy(rule->to, to, to_len);
+    rule->from_len = (Uint8)from_len;
+    rule->to_len = (Uint8)to_len;
+    return true;
+}
+
+// Parses a quoted string at *p into out (at most REPLACEMENT_RULE_MAX_BYTES); returns its length or -1
+static int parse_quoted(const char **p, char *out) {
+    const char *s = *p;
+    while (*s == ' ' || *s == '\t') s++;
+    if (*s != '"') return -1;
+    s++;
+    size_t out_len = 0;
+    while (*s && *s != '"') {
+        char piece[4];
+        size_t piece_len = 0;
+        if (*s == '\\') {
+            s++;
+            if (*s == '"' || *s == '\\') { piece[piece_len++] = *s++; }
+            else if (*s == 't') { piece[piece_len++] = '\t'; s++; }
+            else if (*s == 'u' || *s == 'U') {
+                int digit_count = (*s == 'u') ? 4 : 8;
+                char hex[9] = {0};
+                s++;
+                for (int i = 0; i < digit_count; i++) {
+                    if (!((s[i] >= '0' && s[i] <= '9') || (s[i] >= 'a' && s[i] <= 'f') || (s[i] >= 'A' && s[i] <= 'F'))) return -1;
+                    hex[i] = s[i];
+                }
+                s += digit_count;
+                Uint32 codepoint = (Uint32)strtoul(hex, NULL, 16);
+                if (codepoint == 0 || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) return -1;
+                piece_len = encode_utf8(codepoint, piece);
+            } else {
+                return -1; // Unknown escape
+            }
+        } else {
+            piece[piece_len++] = *s++;
+        }
+        if (out_len + piece_len > REPLACEMENT_RULE_MAX_BYTES) return -1;
+        memcpy(out + out_len, piece, piece_len);
+        out_len += piece_len;
+    }
+    if (*s != '"') return -1;
+    *p = s + 1;
+    return (int)out_len;
+}
+
+static void load_rules_file(AppContext *appCtx, ReplacementRules *rules, const char *rules_file_path) {
+    FILE *rules_file = fopen_unicode_path(rules_file_path, "rb");
+    if (!rules_file) {
+        log_rules_message_format(appCtx, "No replacement rules file at '%s' (%s); using built-in rules.", rules_file_path, strerror(errno));
+        return;
+    }
+    char line[512];
+    int line_num = 0, loaded_count = 0;
+    while (fgets(line, sizeof(line), rules_file)) {
+        line_num++;
+        const char *p = line;
+        if (line_num == 1 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3; // UTF-8 BOM
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+        char from[REPLACEMENT_RULE_MAX_BYTES], to[REPLACEMENT_RULE_MAX_BYTES];
+        int from_len = parse_quoted(&p, from);
+        while (*p == ' ' || *p == '\t') p++;
+        bool has_equals = (*p == '=');
+        if (has_equals) p++;
+        int to_len = has_equals ? parse_quoted(&p, to) : -1;
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+
+        bool valid = from_len > 0 && to_len >= 0 && *p == '\0' &&
+                     ValidateUTF8(from, (size_t)from_len) && ValidateUTF8(to, (size_t)to_len) &&
+                     !memchr(from, '\n', (size_t)from_len) && !memchr(from, '\r', (size_t)from_len) &&
+                     !memchr(to, '\r', (size_t)to_len);
+        if (!valid) {
+            log_rules_message_format(appCtx, "Replacement rules '%s', line %d: expected \"from\" = \"to\" (at most %d bytes each); line skipped.",
+                                     rules_file_path, line_num, REPLACEMENT_RULE_MAX_BYTES);
+            continue;
+        }
+        if (!add_rule(rules, from, (size_t)from_len, to, (size_t)to_len)) {
+            log_rules_message_format(appCtx, "Replacement rules '%s': more than %d rules, the rest are ignored.", rules_file_path, REPLACEMENT_RULES_MAX);
+            break;
+        }
+        loaded_count++;
+    }
+    fclose(rules_file);
+    log_rules_message_format(appCtx, "Loaded %d replacement rules from '%s'.", loaded_count, rules_file_path);
+}
+
+// Builds byte classes, the trie and the first-byte tables from rules->rules
+static bool compile_rules(ReplacementRules *rules) {
+    int max_states = 2;
+    memset(rules->byte_class, 0, sizeof(rules->byte_class));
+    rules->class_count = 1;
+    for (int rule_idx = 0; rule_idx < rules->rule_count; rule_idx++) {
+        const ReplacementRule *rule = &rules->rules[rule_idx];
+        for (int i = 0; i < rule->from_len; i++) {
+            unsigned char c = (unsigned char)rule->from[i];
+            if (rules->byte_class[c] == 0) rules->byte_class[c] = (Uint8)rules->class_count++;
+        }
+        max_states += rule->from_len;
+    }
+
+    rules->transitions = (Uint16*)calloc((size_t)max_states * (size_t)rules->class_count, sizeof(Uint16));
+    rules->accept_rule = (Sint16*)malloc((size_t)max_states * sizeof(Sint16));
+    rules->has_children = (bool*)calloc((size_t)max_states, sizeof(bool));
+    if (!rules->transitions || !rules->accept_rule || !rules->has_children) return false;
+    for (int state = 0; state < max_states; state++) rules->accept_rule[state] = -1;
+
+    rules->state_count = 2; // Dead state and root
+    memset(rules->starts_rule, 0, sizeof(rules->starts_rule));
+    memset(rules->starts_growing_rule, 0, sizeof(rules->starts_growing_rule));
+    for (int rule_idx = 0; rule_idx < rules->rule_count; rule_idx++) {
+        const ReplacementRule *rule = &rules->rules[rule_idx];
+        int state = 1;
+        for (int i = 0; i < rule->from_len; i++) {
+            Uint16 *next = &rules->transitions[state * rules->class_count + rules->byte_class[(unsigned char)rule->from[i]]];
+            if (*next == 0) *next = (Uint16)rules->state_count++;
+            rules->has_children[state] = true;
+            state = *next;
+        }
+        rules->accept_rule[state] = (Sint16)rule_idx;
+        unsigned char first_byte = (unsigned char)rule->from[0];
+        rules->starts_rule[first_byte] = true;
+        if (rule->to_len > rule->from_len) rules->starts_growing_rule[first_byte] = true;
+    }
+
+    // The preprocessor's ASCII fast path can stop at one extra byte; more than one needs a table check
+    int ascii_start_count = 0;
+    rules->ascii_stop_byte = ' ';
+    for (int c = 0x21; c < 0x80; c++) {
+        if (rules->starts_rule[c]) { rules->ascii_stop_byte = (char)c; ascii_start_count++; }
+    }
+    rules->several_ascii_starts = ascii_start_count > 1;
+    return true;
+}
+
+bool ReplacementRulesLoad(AppContext *appCtx, const char *rules_file_path) {
+    if (!appCtx) return false;
+    ReplacementRules *rules = &appCtx->replacement_rules;
+    ReplacementRulesFree(rules);
+
+    for (size_t i = 0; i < sizeof(builtin_rules) / sizeof(builtin_rules[0]); i++) {
+        add_rule(rules, builtin_rules[i][0], strlen(builtin_rules[i][0]), builtin_rules[i][1], strlen(builtin_rules[i][1]));
+    }
+    if (rules_file_path && rules_file_path[0] != '\0') load_rules_file(appCtx, rules, rules_file_path);
+
+    if (!compile_rules(rules)) {
+        log_rules_message_format(appCtx, "Error: could not allocate the replacement rules DFA; text is loaded without replacements.");
+        ReplacementRulesFree(rules);
+        return false;
+    }
+    log_rules_message_format(appCtx, "Replacement rules: %d rules, %d DFA states, %d byte classes.",
+                             rules->rule_count, rules->state_count, rules->class_count);
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef REPLACEMENT_RULES_H
+#define REPLACEMENT_RULES_H
+
+#include "app_context.h" // For ReplacementRules, ReplacementRule
+#include <stdbool.h>
+
+#define REPLACEMENT_NO_MATCH (-1)
+#define REPLACEMENT_NEED_MORE_INPUT (-2)
+
+// Compiles the built-in rules plus those of the rules file (if it exists; may be NULL) into
+// appCtx->replacement_rules. A file rule with the same "from" as an earlier rule replaces it.
+// Returns false only if the DFA could not be allocated, in which case no replacements are made.
+bool ReplacementRulesLoad(AppContext *appCtx, const char *rules_file_path);
+void ReplacementRulesFree(ReplacementRules *rules);
+
+// Longest rule whose "from" starts at p: its index, REPLACEMENT_NO_MATCH, or REPLACEMENT_NEED_MORE_INPUT
+// if the input ends while a longer match is still possible and more input may follow.
+int ReplacementRulesMatch(const ReplacementRules *rules, const char *p, const char *end, bool input_is_final);
+
+#endif // REPLACEMENT_RULES_H
@@ -4,6 +4,7 @@
 #include <time.h>   // For time, strftime, localtime
 #include <string.h> // For strerror
 #include <errno.h>  // For errno
+#include <stdlib.h> // For realloc, free, qsort
 #include "file_paths.h" // <--- ADDED FOR fopen_unicode_path
 // It's good practice to include app_context.h if using its members for logging,
 // but log_stats_message_format is static and takes appCtx as a param.
@@ -23,49 +24,95 @@ static void log_stats_message_format(AppContext *appCtx, const char* format, ...
 }
 
 
-void CalculateAndPrintAppStats(AppContext *appCtx,
-                               const char* actual_stats_f_path) {
+void RecordKeystrokeForLatency(AppContext *appCtx, Uint32 event_timestamp_ms) {
     if (!appCtx) return;
-
-    if (!appCtx->typing_started) {
-        printf("No typing done. No stats to display.\n");
-        log_stats_message_format(appCtx, "CalculateAndPrintAppStats: No typing done.");
-        return;
+    InputLatencyStats *latency_stats = &appCtx->input_latency;
+    // When full, later keystrokes are shown by the same frame as the earliest ones anyway
+    if (latency_stats->pending_count < INPUT_LATENCY_PENDING_MAX) {
+        latency_stats->pending_timestamps[latency_stats->pending_count++] = event_timestamp_ms;
     }
+}
 
-    Uint32 end_time_ms_val = appCtx->is_paused ? appCtx->time_at_pause_ms : SDL_GetTicks();
-    float time_taken_seconds = (float)(end_time_ms_val - appCtx->start_time_ms) / 1000.0f;
+void RecordFramePresented(AppContext *appCtx) {
+    if (!appCtx || appCtx->input_latency.pending_count == 0) return;
+    InputLatencyStats *latency_stats = &appCtx->input_latency;
+    Uint32 present_time_ms = SDL_GetTicks();
 
-    if (time_taken_seconds <= 0.001f && appCtx->total_keystrokes_for_accuracy == 0) {
-        printf("Time taken is too short or no characters typed for meaningful stats.\n");
-        log_stats_message_format(appCtx, "CalculateAndPrintAppStats: Time too short or no keystrokes.");
-        return;
+    size_t needed_capacity = latency_stats->sample_count + (size_t)latency_stats->pending_count;
+    if (needed_capacity > latency_stats->sample_capacity) {
+        size_t new_capacity = latency_stats->sample_capacity ? latency_stats->sample_capacity * 2 : 1024;
+        while (new_capacity < needed_capacity) new_capacity *= 2;
+        Uint32 *new_samples = (Uint32*)realloc(latency_stats->samples_ms, new_capacity * sizeof(Uint32));
+        if (!new_samples) { latency_stats->pending_count = 0; return; } // Drop these samples, keep typing
+        latency_stats->samples_ms = new_samples;
+        latency_stats->sample_capacity = new_capacity;
     }
-    if (time_taken_seconds <= 0.001f) time_taken_seconds = 0.001f;
+    for (int i = 0; i < latency_stats->pending_count; i++) {
+        latency_stats->samples_ms[latency_stats->sample_count++] = present_time_ms - latency_stats->pending_timestamps[i];
+    }
+    latency_stats->pending_count = 0;
+}
+
+void InputLatencyStatsFree(InputLatencyStats *latency_stats) {
+    if (!latency_stats) return;
+    free(latency_stats->samples_ms);
+    memset(latency_stats, 0, sizeof(InputLatencyStats));
+}
 
-    size_t final_correct_keystrokes = (appCtx->total_keystrokes_for_accuracy >= appCtx->total_errors_committed_for_accuracy) ?
-                                     (appCtx->total_keystrokes_for_accuracy - appCtx->total_errors_committed_for_accuracy) : 0;
+static int compare_uint32_ascending(const void *a, const void *b) {
+    Uint32 value_a = *(const Uint32*)a, value_b = *(const Uint32*)b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+// Nearest-rank percentile of sorted samples
+static Uint32 latency_percentile(const Uint32 *sorted_samples, size_t sample_count, int percentile) {
+    size_t rank = (sample_count * (size_t)percentile + 99) / 100;
+    if (rank == 0) rank = 1;
+    return sorted_samples[rank - 1];
+}
+
+static void print_input_latency_stats(AppContext *appCtx) {
+    InputLatencyStats *latency_stats = &appCtx->input_latency;
+    if (latency_stats->sample_count == 0) return;
+
+    qsort(latency_stats->samples_ms, latency_stats->sample_count, sizeof(Uint32), compare_uint32_ascending);
+    Uint32 p50 = latency_percentile(latency_stats->samples_ms, latency_stats->sample_count, 50);
+    Uint32 p95 = latency_percentile(latency_stats->samples_ms, latency_stats->sample_count, 95);
+    Uint32 p99 = latency_percentile(latency_stats->samples_ms, latency_stats->sample_count, 99);
+
+    printf("Input-to-Present Latency (%zu keystrokes, %s): p50 %u ms, p95 %u ms, p99 %u ms\n",
+           latency_stats->sample_count, LOW_LATENCY_MODE ? "low-latency mode" : "VSYNC", p50, p95, p99);
+    log_stats_message_format(appCtx, "Input latency: %zu samples, p50 %u ms, p95 %u ms, p99 %u ms, max %u ms",
+                             latency_stats->sample_count, p50, p95, p99,
+                             latency_stats->samples_ms[latency_stats->sample_count - 1]);
+}
+
+
+// WPM (5 characters per word, errors not counted) and keystroke accuracy of a session
+static void compute_session_stats(unsigned long long total_keystrokes, unsigned long long total_errors, float time_taken_seconds,
+                                  size_t *out_correct_keystrokes, float *out_wpm, float *out_accuracy) {
+    size_t final_correct_keystrokes = (total_keystrokes >= total_errors) ? (size_t)(total_keystrokes - total_errors) : 0;
 
     float net_words = (float)final_correct_keystrokes / 5.0f;
     float wpm = (time_taken_seconds > 0.0001f) ? (net_words / (time_taken_seconds / 60.0f)) : 0.0f;
     if (wpm < 0.0f) wpm = 0.0f;
 
     float accuracy = 0.0f;
-    if (appCtx->total_keystrokes_for_accuracy > 0) {
-        accuracy = ((float)final_correct_keystrokes / (float)appCtx->total_keystrokes_for_accuracy) * 100.0f;
+    if (total_keystrokes > 0) {
+        accuracy = ((float)final_correct_keystrokes / (float)total_keystrokes) * 100.0f;
     }
     if (accuracy < 0.0f) accuracy = 0.0f;
-    if (accuracy > 100.0f && appCtx->total_keystrokes_for_accuracy > 0) accuracy = 100.0f;
+    if (accuracy > 100.0f && total_keystrokes > 0) accuracy = 100.0f;
 
-    printf("\n--- Typing Stats (Final) ---\n");
-    printf("Time Taken: %.2f seconds\n", time_taken_seconds);
-    printf("WPM (Net): %.2f\n", wpm);
-    printf("Correct Keystrokes: %zu\n", final_correct_keystrokes);
-    printf("Total Keystrokes (Accuracy Basis): %llu\n", appCtx->total_keystrokes_for_accuracy);
-    printf("Committed Errors: %llu\n", appCtx->total_errors_committed_for_accuracy);
-    printf("Accuracy (Keystroke-based): %.2f%%\n", accuracy);
-    printf("--------------------\n");
+    *out_correct_keystrokes = final_correct_keystrokes;
+    *out_wpm = wpm;
+    *out_accuracy = accuracy;
+}
 
+// Appends one session line to stats.txt; note (if not NULL) is added at the end of the line
+static void append_stats_line(AppContext *appCtx, const char* actual_stats_f_path, float wpm, float accuracy, float time_taken_seconds,
+                              size_t final_correct_keystrokes, unsigned long long total_keystrokes, unsigned long long total_errors,
+                              const char *note) {
     if (actual_stats_f_path && actual_stats_f_path[0] != '\0') {
         FILE *stats_file_handle = fopen_unicode_path(actual_stats_f_path, "a"); // USE UNICODE PATH
         if (stats_file_handle) {
@@ -75,9 +122,9 @@ void CalculateAndPrintAppStats(AppContext *appCtx,
                 strcpy(time_str, "TimestampError");
             }
 
-            fprintf(stats_file_handle, "%s | WPM: %.2f | Accuracy: %.2f%% | Time: %.1fs | Correct Ks: %zu | Total Ks: %llu | Errors: %llu\n",
+            fprintf(stats_file_handle, "%s | WPM: %.2f | Accuracy: %.2f%% | Time: %.1fs | Correct Ks: %zu | Total Ks: %llu | Errors: %llu%s%s\n",
                     time_str, wpm, accuracy, time_taken_seconds,
-                    final_correct_keystrokes, appCtx->total_keystrokes_for_accuracy, appCtx->total_errors_committed_for_accuracy);
+                    final_correct_keystrokes, total_keystrokes, total_errors, note ? " | " : "", note ? note : "");
             fclose(stats_file_handle);
             log_stats_message_format(appCtx, "Stats successfully appended to '%s'", actual_stats_f_path);
         } else {
@@ -88,4 +135,65 @@ void CalculateAndPrintAppStats(AppContext *appCtx,
     } else {
         log_stats_message_format(appCtx, "Warning: Stats file path is empty. Cannot save stats to file.");
     }
-}
\ No newline at end of file
+}
+
+
+void CalculateAndPrintAppStats(AppContext *appCtx,
+                               const char* actual_stats_f_path) {
+    if (!appCtx) return;
+
+    if (!appCtx->typing_started) {
+        printf("No typing done. No stats to display.\n");
+        log_stats_message_format(appCtx, "CalculateAndPrintAppStats: No typing done.");
+        return;
+    }
+
+    Uint32 end_time_ms_val = appCtx->is_paused ? appCtx->time_at_pause_ms : SDL_GetTicks();
+    float time_taken_seconds = (float)(end_time_ms_val - appCtx->start_time_ms) / 1000.0f;
+
+    if (time_taken_seconds <= 0.001f && appCtx->total_keystrokes_for_accuracy == 0) {
+        printf("Time taken is too short or no characters typed for meaningful stats.\n");
+        log_stats_message_format(appCtx, "CalculateAndPrintAppStats: Time too short or no keystrokes.");
+        return;
+    }
+    if (time_taken_seconds <= 0.001f) time_taken_seconds = 0.001f;
+
+    size_t final_correct_keystrokes = 0;
+    float wpm = 0.0f, accuracy = 0.0f;
+    compute_session_stats(appCtx->total_keystrokes_for_accuracy, appCtx->total_errors_committed_for_accuracy, time_taken_seconds,
+                          &final_correct_keystrokes, &wpm, &accuracy);
+
+    printf("\n--- Typing Stats (Final) ---\n");
+    printf("Time Taken: %.2f seconds\n", time_taken_seconds);
+    printf("WPM (Net): %.2f\n", wpm);
+    printf("Correct Keystrokes: %zu\n", final_correct_keystrokes);
+    printf("Total Keystrokes (Accuracy Basis): %llu\n", appCtx->total_keystrokes_for_accuracy);
+    printf("Committed Errors: %llu\n", appCtx->total_errors_committed_for_accuracy);
+    printf("Accuracy (Keystroke-based): %.2f%%\n", accuracy);
+    if (appCtx->text_summary.word_count > 0 && appCtx->text_load_finished) {
+        printf("Text Progress: %zu of %zu words (%.1f%%)\n", appCtx->typed_input_stats.word_count, appCtx->text_summary.word_count,
+               100.0 * (double)appCtx->typed_input_stats.byte_count / (double)(appCtx->text_summary.byte_count ? appCtx->text_summary.byte_count : 1));
+    } else if (appCtx->text_summary.word_count > 0) { // Exiting does not wait for the rest of a large text
+        printf("Text Progress: %zu words (of more than %zu; the text was still loading)\n", appCtx->typed_input_stats.word_count, appCtx->text_summary.word_count);
+    }
+    print_input_latency_stats(appCtx);
+    printf("--------------------\n");
+
+    append_stats_line(appCtx, actual_stats_f_path, wpm, accuracy, time_taken_seconds,
+                      final_correct_keystrokes, appCtx->total_keystrokes_for_accuracy, appCtx->total_errors_committed_for_accuracy, NULL);
+}
+
+void RecordRecoveredSessionStats(AppContext *appCtx, const char* actual_stats_f_path,
+                                 unsigned long long total_keystrokes, unsigned long long total_errors, Uint32 elapsed_ms) {
+    if (!appCtx || total_keystrokes == 0) return;
+    float time_taken_seconds = elapsed_ms > 1 ? (float)elapsed_ms / 1000.0f : 0.001f;
+
+    size_t final_correct_keystrokes = 0;
+    float wpm = 0.0f, accuracy = 0.0f;
+    compute_session_stats(total_keystrokes, total_errors, time_taken_seconds, &final_correct_keystrokes, &wpm, &accuracy);
+
+    printf("The previous session did not end normally; its stats up to the last checkpoint were recorded (WPM %.2f, accuracy %.2f%%).\n", wpm, accuracy);
+    log_stats_message_format(appCtx, "Recovered session: %llu keystrokes, %llu errors, %u ms.", total_keystrokes, total_errors, elapsed_ms);
+    append_stats_line(appCtx, actual_stats_f_path, wpm, accuracy, time_taken_seconds,
+                      final_correct_keystrokes, total_keystrokes, total_errors, "Recovered");
+}
@@ -5,5 +5,13 @@
 
 void CalculateAndPrintAppStats(AppContext *appCtx,
                                const char* actual_stats_f_path); // Path to the statistics file is needed
+// Appends a session that ended without CalculateAndPrintAppStats (a crash), from its last progress checkpoint
+void RecordRecoveredSessionStats(AppContext *appCtx, const char* actual_stats_f_path,
+                                 unsigned long long total_keystrokes, unsigned long long total_errors, Uint32 elapsed_ms);
+
+// Input latency: a keystroke is recorded when handled and becomes a sample at the next present
+void RecordKeystrokeForLatency(AppContext *appCtx, Uint32 event_timestamp_ms);
+void RecordFramePresented(AppContext *appCtx);
+void InputLatencyStatsFree(InputLatencyStats *latency_stats);
 
 #endif // STATS_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include "text_import.h"
+#include "utf8_utils.h" // For ValidateUTF8, decode_utf8, encode_utf8
+#include "config.h"     // For TEXT_IMPORT_SAMPLE_BYTES
+#include <string.h>     // For memcpy
+
+// Single-byte code pages are converted through a 256-entry table of UTF-8 sequences that is written 4 bytes
+// at a time whatever the sequence length; UTF-16 is decoded unit by unit. Both copy (or narrow) blocks of
+// plain ASCII in one step, 16 input bytes at a time with SSE2 or NEON, and with SSSE3 blocks whose characters
+// are all below U+0800 (Latin, Greek, Cyrillic... mixed with ASCII) are encoded 8 at a time with one shuffle.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXT_IMPORT_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TEXT_IMPORT_NEON 1
+#endif
+
+// A single-byte code page: codepoints of bytes 0x80..0xFF (0 = no character, the byte is dropped), of which
+// those from linear_start up are byte + linear_offset (its letters)
+typedef struct {
+    const Uint16 *high_codepoints;
+    Uint8 linear_start;
+    Uint16 linear_offset;
+} SingleByteCodePage;
+
+static const Uint16 windows_1251_high[128] = {
+    0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021, 0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+    0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x0000, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+    0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7, 0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+    0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7, 0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417, 0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427, 0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437, 0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447, 0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,
+};
+static const Uint16 windows_1252_high[128] = {
+    0x20AC, 0x0000, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x0000, 0x017D, 0x0000,
+    0x0000, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x0000, 0x017E, 0x0178,
+    0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6, 0x00A7, 0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,
+    0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x00B4, 0x00B5, 0x00B6, 0x00B7, 0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF,
+    0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7, 0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,
+    0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7, 0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,
+    0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7, 0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,
+    0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7, 0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF,
+};
+
+static const SingleByteCodePage windows_1251 = {windows_1251_high, 0xC0, 0x350};
+static const SingleByteCodePage windows_1252 = {windows_1252_high, 0xA0, 0};
+
+const char* TextEncodingName(TextEncoding encoding) {
+    switch (encoding) {
+        case TEXT_ENCODING_UTF8: return "UTF-8";
+        case TEXT_ENCODING_UTF16LE: return "UTF-16LE";
+        case TEXT_ENCODING_UTF16BE: return "UTF-16BE";
+        case TEXT_ENCODING_WINDOWS_1251: return "Windows-1251";
+        case TEXT_ENCODING_WINDOWS_1252: return "Windows-1252";
+    }
+    return "unknown";
+}
+
+// --- Detection ---
+
+static bool is_ascii_letter(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+// Length of text without a UTF-8 sequence cut off at its end (the lead byte and up to 2 continuation bytes of
+// a longer character), for text that stops where more of the file follows
+static size_t without_cut_sequence(const char *text, size_t text_len) {
+    const unsigned char *bytes = (const unsigned char*)text;
+    size_t lead = text_len;
+    while (lead > 0 && text_len - lead < 3 && (bytes[lead - 1] & 0xC0) == 0x80) lead--; // Back over continuation bytes
+    if (lead == 0) return text_len;
+    unsigned char c = bytes[lead - 1];
+    size_t sequence_len = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    return (text_len - (lead - 1) < sequence_len) ? lead - 1 : text_len;
+}
+
+TextEncoding DetectTextEncoding(const char *text, size_t text_len, bool sample_is_prefix, size_t *out_bom_len) {
+    const unsigned char *bytes = (const unsigned char*)text;
+    if (out_bom_len) *out_bom_len = 0;
+    if (!text) return TEXT_ENCODING_UTF8;
+
+    // Byte order marks
+    size_t bom_len = 0;
+    TextEncoding bom_encoding = TEXT_ENCODING_UTF8;
+    if (text_len >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) { bom_len = 3; }
+    else if (text_len >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) { bom_len = 2; bom_encoding = TEXT_ENCODING_UTF16LE; }
+    else if (text_len >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) { bom_len = 2; bom_encoding = TEXT_ENCODING_UTF16BE; }
+    if (bom_len > 0) {
+        if (out_bom_len) *out_bom_len = bom_len;
+        return bom_encoding;
+    }
+
+    // UTF-16 without a BOM: the high byte of ASCII and of most punctuation is 0, the low byte rarely is.
+    // Checked before UTF-8 because ASCII-only UTF-16 (zeros included) is valid UTF-8 too.
+    size_t sample_len = text_len < TEXT_IMPORT_SAMPLE_BYTES ? text_len : TEXT_IMPORT_SAMPLE_BYTES;
+    size_t unit_count = sample_len / 2, even_zeros = 0, odd_zeros = 0;
+    for (size_t i = 0; i + 1 < sample_len; i += 2) {
+        even_zeros += (bytes[i] == 0);
+        odd_zeros += (bytes[i + 1] == 0);
+    }
+    if (odd_zeros > unit_count / 8 && even_zeros * 16 <= odd_zeros) return TEXT_ENCODING_UTF16LE;
+    if (even_zeros > unit_count / 8 && odd_zeros * 16 <= even_zeros) return TEXT_ENCODING_UTF16BE;
+
+    if (ValidateUTF8(text, sample_is_prefix ? without_cut_sequence(text, text_len) : text_len)) return TEXT_ENCODING_UTF8;
+
+    // Mostly well-formed UTF-8 with a few damaged bytes stays UTF-8 (the preprocessor drops the bad bytes)
+    size_t multibyte_count = 0, invalid_count = 0;
+    size_t utf8_sample_len = (sample_is_prefix || sample_len < text_len) ? without_cut_sequence(text, sample_len) : sample_len;
+    const char *p = text, *sample_end = text + utf8_sample_len;
+    while (p < sample_end) {
+        if ((unsigned char)*p < 0x80) { p++; continue; }
+        if (decode_utf8(&p, sample_end) > 0) { multibyte_count++; } // Advanced past the sequence
+        else { invalid_count++; p++; }
+    }
+    if (multibyte_count > invalid_count) return TEXT_ENCODING_UTF8;
+
+    // Letters are 0xC0..0xFF in both code pages. Cyrillic words are made of them entirely, while Western
+    // European text has them inside otherwise ASCII words ("café", "für").
+    size_t high_pairs = 0, mixed_pairs = 0;
+    for (size_t i = 1; i < sample_len; i++) {
+        if (bytes[i] < 0xC0) continue;
+        if (bytes[i - 1] >= 0xC0) high_pairs++;
+        else if (is_ascii_letter(bytes[i - 1])) mixed_pairs++;
+    }
+    return high_pairs > mixed_pairs ? TEXT_ENCODING_WINDOWS_1251 : TEXT_ENCODING_WINDOWS_1252;
+}
+
+// --- Transcoding ---
+
+// True if the 16 bytes at p are all ASCII
+static inline bool block_is_ascii(const char *p) {
+#if defined(TEXT_IMPORT_SSE2)
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p)) == 0;
+#elif defined(TEXT_IMPORT_NEON)
+    return vmaxvq_u8(vld1q_u8((const uint8_t*)p)) < 0x80;
+#else
+    Uint64 words[2];
+    memcpy(words, p, sizeof(words));
+    return ((words[0] | words[1]) & 0x8080808080808080ULL) == 0;
+#endif
+}
+
+#if defined(TEXT_IMPORT_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TEXT_IMPORT_SSSE3 1
+
+// pshufb patterns that pack 8 (lead, trail) byte pairs into UTF-8, keeping only the trail byte of ASCII
+// units; indexed by the mask of ASCII units, with the packed length alongside
+static Uint8 pack_shuffles[256][16];
+static Uint8 pack_lengths[256];
+static int pack_shuffles_state = -1; // -1 not checked yet, 0 no SSSE3, 1 tables ready
+
+static bool ssse3_packing_available(void) {
+    int state = __atomic_load_n(&pack_shuffles_state, __ATOMIC_ACQUIRE);
+    if (state < 0) { // Threads racing here build identical tables before publishing them
+        state = __builtin_cpu_supports("ssse3") ? 1 : 0;
+        for (int ascii_mask = 0; state && ascii_mask < 256; ascii_mask++) {
+            int packed_len = 0;
+            for (int unit = 0; unit < 8; unit++) {
+                if (!(ascii_mask & (1 << unit))) pack_shuffles[ascii_mask][packed_len++] = (Uint8)(2 * unit);
+                pack_shuffles[ascii_mask][packed_len++] = (Uint8)(2 * unit + 1);
+            }
+            for (int i = packed_len; i < 16; i++) pack_shuffles[ascii_mask][i] = 0x80; // Zero fill
+            pack_lengths[ascii_mask] = (Uint8)packed_len;
+        }
+        __atomic_store_n(&pack_shuffles_state, state, __ATOMIC_RELEASE);
+    }
+    return state == 1;
+}
+
+// Encodes 8 codepoints below U+0800 at out (storing 16 bytes) and returns the UTF-8 length
+__attribute__((target("ssse3")))
+static size_t pack_units_ssse3(__m128i units, char *out) {
+    __m128i ascii_units = _mm_cmplt_epi16(units, _mm_set1_epi16(0x80));
+    int ascii_mask = _mm_movemask_epi8(_mm_packs_epi16(ascii_units, ascii_units)) & 0xFF;
+    __m128i lead = _mm_or_si128(_mm_srli_epi16(units, 6), _mm_set1_epi16(0xC0));
+    __m128i trail = _mm_or_si128(_mm_and_si128(units, _mm_set1_epi16(0x3F)), _mm_set1_epi16(0x80));
+    trail = _mm_or_si128(_mm_and_si128(ascii_units, units), _mm_andnot_si128(ascii_units, trail)); // ASCII as is
+    __m128i pairs = _mm_or_si128(lead, _mm_slli_epi16(trail, 8)); // Lead byte first in memory
+    __m128i packed = _mm_shuffle_epi8(pairs, _mm_loadu_si128((const __m128i*)pack_shuffles[ascii_mask]));
+    _mm_storeu_si128((__m128i*)out, packed);
+    return pack_lengths[ascii_mask];
+}
+
+// 8 UTF-16 units at p, if all are below U+0800; returns the UTF-8 length written, or 0 if not applicable
+__attribute__((target("ssse3")))
+static size_t utf16_block_two_byte_ssse3(const char *p, bool big_endian, char *out) {
+    __m128i units = _mm_loadu_si128((const __m128i*)p);
+    if (big_endian) units = _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+    __m128i long_bits = _mm_and_si128(units, _mm_set1_epi16((short)0xF800));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(long_bits, _mm_setzero_si128())) != 0xFFFF) return 0;
+    return pack_units_ssse3(units, out);
+}
+
+// 16 single-byte characters at p, if none is in 0x80..linear_start-1; returns the UTF-8 length, or 0
+__attribute__((target("ssse3")))
+static size_t single_byte_block_ssse3(const char *p, const SingleByteCodePage *code_page, char *out) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+    // Signed: ASCII is non-negative, so only bytes 0x80..linear_start-1 compare below linear_start
+    if (_mm_movemask_epi8(_mm_cmplt_epi8(bytes, _mm_set1_epi8((char)code_page->linear_start))) != 0) return 0;
+    const __m128i offset = _mm_set1_epi16((short)code_page->linear_offset), last_ascii = _mm_set1_epi16(0x7F);
+    __m128i low_units = _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+    __m128i high_units = _mm_unpackhi_epi8(bytes, _mm_setzero_si128());
+    low_units = _mm_add_epi16(low_units, _mm_and_si128(_mm_cmpgt_epi16(low_units, last_ascii), offset));
+    high_units = _mm_add_epi16(high_units, _mm_and_si128(_mm_cmpgt_epi16(high_units, last_ascii), offset));
+    size_t out_len = pack_units_ssse3(low_units, out);
+    return out_len + pack_units_ssse3(high_units, out + out_len);
+}
+#endif
+
+static size_t transcode_single_byte(const SingleByteCodePage *code_page, const char *input, size_t input_len,
+                                    char *output, size_t *output_len) {
+#if defined(TEXT_IMPORT_SSSE3)
+    bool use_ssse3 = ssse3_packing_available();
+#endif
+    char utf8_bytes[256][4];
+    Uint8 utf8_lens[256];
+    for (int c = 0; c < 256; c++) {
+        Uint32 codepoint = c < 0x80 ? (Uint32)c : code_page->high_codepoints[c - 0x80];
+        memset(utf8_bytes[c], 0, sizeof(utf8_bytes[c]));
+        utf8_lens[c] = (c == 0 || codepoint != 0) ? (Uint8)encode_utf8(codepoint, utf8_bytes[c]) : 0;
+    }
+
+    const char *p = input, *end = input + input_len;
+    char *out = output + *output_len;
+    while (p < end) {
+        if (end - p >= 16 && block_is_ascii(p)) {
+            memcpy(out, p, 16);
+            out += 16;
+            p += 16;
+            continue;
+        }
+#if defined(TEXT_IMPORT_SSSE3)
+        size_t block_out_len;
+        if (use_ssse3 && end - p >= 16 && (block_out_len = single_byte_block_ssse3(p, code_page, out)) > 0) {
+            out += block_out_len;
+            p += 16;
+            continue;
+        }
+#endif
+        const char *block_end = (end - p >= 16) ? p + 16 : end;
+        for (; p < block_end; p++) { // Full 4-byte store, then advance by the real length
+            unsigned char c = (unsigned char)*p;
+            memcpy(out, utf8_bytes[c], 4);
+            out += utf8_lens[c];
+        }
+    }
+    *output_len = (size_t)(out - output);
+    return input_len;
+}
+
+static inline Uint32 read_utf16_unit(const char *p, bool big_endian) {
+    Uint32 first = (unsigned char)p[0], second = (unsigned char)p[1];
+    return big_endian ? (first << 8) | second : (second << 8) | first;
+}
+
+// Narrows the 8 UTF-16 units at p to 8 bytes at out if they are all ASCII; returns false otherwise
+static inline bool utf16_block_to_ascii(const char *p, bool big_endian, char *out) {
+#if defined(TEXT_IMPORT_SSE2)
+    __m128i units = _mm_loadu_si128((const __m128i*)p);
+    if (big_endian) units = _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+    __m128i non_ascii_bits = _mm_and_si128(units, _mm_set1_epi16((short)0xFF80));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(non_ascii_bits, _mm_setzero_si128())) != 0xFFFF) return false;
+    _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(units, units));
+    return true;
+#elif defined(TEXT_IMPORT_NEON)
+    uint8x16_t bytes = vld1q_u8((const uint8_t*)p);
+    if (big_endian) bytes = vrev16q_u8(bytes);
+    uint16x8_t units = vreinterpretq_u16_u8(bytes);
+    if (vmaxvq_u16(units) >= 0x80) return false;
+    vst1_u8((uint8_t*)out, vmovn_u16(units));
+    return true;
+#else
+    for (int i = 0; i < 8; i++) {
+        if (read_utf16_unit(p + 2 * i, big_endian) >= 0x80) return false;
+    }
+    for (int i = 0; i < 8; i++) out[i] = (char)read_utf16_unit(p + 2 * i, big_endian);
+    return true;
+#endif
+}
+
+static size_t transcode_utf16(const char *input, size_t input_len, bool big_endian, bool input_is_final,
+                              char *output, size_t *output_len) {
+    const char *p = input, *end = input + (input_len & ~(size_t)1); // Whole units only
+    char *out = output + *output_len;
+    bool needs_more_input = false;
+#if defined(TEXT_IMPORT_SSSE3)
+    bool use_ssse3 = ssse3_packing_available();
+#endif
+    while (p < end && !needs_more_input) {
+        if (end - p >= 16 && utf16_block_to_ascii(p, big_endian, out)) {
+            out += 8;
+            p += 16;
+            continue;
+        }
+#if defined(TEXT_IMPORT_SSSE3)
+        size_t block_out_len;
+        if (use_ssse3 && end - p >= 16 && (block_out_len = utf16_block_two_byte_ssse3(p, big_endian, out)) > 0) {
+            out += block_out_len;
+            p += 16;
+            continue;
+        }
+#endif
+        const char *block_end = (end - p >= 16) ? p + 16 : end;
+        while (p < block_end) {
+            Uint32 unit = read_utf16_unit(p, big_endian);
+            if (unit >= 0xD800 && unit <= 0xDBFF) { // High surrogate, needs the low one after it
+                if (end - p < 4) {
+                    if (!input_is_final) { needs_more_input = true; break; }
+                    p += 2; // Unpaired at the very end
+                    continue;
+                }
+                Uint32 low_unit = read_utf16_unit(p + 2, big_endian);
+                if (low_unit >= 0xDC00 && low_unit <= 0xDFFF) {
+                    out += encode_utf8(0x10000 + ((unit - 0xD800) << 10) + (low_unit - 0xDC00), out);
+                    p += 4;
+                } else {
+                    p += 2; // Unpaired, dropped
+                }
+                continue;
+            }
+            if (unit < 0x80) { // Inline paths for the common lengths (ASCII, Latin, Greek, Cyrillic...)
+                *out++ = (char)unit;
+            } else if (unit < 0x800) {
+                out[0] = (char)(0xC0 | (unit >> 6));
+                out[1] = (char)(0x80 | (unit & 0x3F));
+                out += 2;
+            } else if (unit < 0xDC00 || unit > 0xDFFF) { // Unpaired low surrogates are dropped
+                out += encode_utf8(unit, out);
+            }
+            p += 2;
+        }
+    }
+    *output_len = (size_t)(out - output);
+    return input_is_final ? input_len : (size_t)(p - input); // A final odd byte is dropped
+}
+
+size_t TranscodeMaxOutputLen(TextEncoding encoding, size_t input_len) {
+    switch (encoding) {
+        case TEXT_ENCODING_UTF16LE:
+        case TEXT_ENCODING_UTF16BE:
+            return input_len / 2 * 3 + 3; // A unit becomes at most 3 bytes, a surrogate pair 4
+        case TEXT_ENCODING_WINDOWS_1251:
+        case TEXT_ENCODING_WINDOWS_1252:
+            return input_len * 3 + 3; // Up to 3 bytes per byte (e.g. the euro sign), plus the 4-byte store
+        case TEXT_ENCODING_UTF8:
+        default:
+            return input_len + 3;
+    }
+}
+
+size_t TranscodeToUTF8(TextEncoding encoding, const char *input, size_t input_len, bool input_is_final,
+                       char *output, size_t *output_len) {
+    if (!input || !output || !output_len) return 0;
+    switch (encoding) {
+        case TEXT_ENCODING_UTF16LE: return transcode_utf16(input, input_len, false, input_is_final, output, output_len);
+        case TEXT_ENCODING_UTF16BE: return transcode_utf16(input, input_len, true, input_is_final, output, output_len);
+        case TEXT_ENCODING_WINDOWS_1251: return transcode_single_byte(&windows_1251, input, input_len, output, output_len);
+        case TEXT_ENCODING_WINDOWS_1252: return transcode_single_byte(&windows_1252, input, input_len, output, output_len);
+        case TEXT_ENCODING_UTF8:
+        default:
+            memcpy(output + *output_len, input, input_len);
+            *output_len += input_len;
+            return input_len;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef TEXT_IMPORT_H
+#define TEXT_IMPORT_H
+
+#include <stdbool.h>
+#include <stddef.h> // For size_t
+
+// Encodings a practice file can be imported from
+typedef enum {
+    TEXT_ENCODING_UTF8,
+    TEXT_ENCODING_UTF16LE,
+    TEXT_ENCODING_UTF16BE,
+    TEXT_ENCODING_WINDOWS_1251, // Cyrillic
+    TEXT_ENCODING_WINDOWS_1252, // Western European (a superset of the printable part of Latin-1)
+} TextEncoding;
+
+const char* TextEncodingName(TextEncoding encoding);
+
+// Guesses the encoding from a byte order mark, else from the first TEXT_IMPORT_SAMPLE_BYTES: zero bytes in
+// every other position mean UTF-16, valid UTF-8 stays UTF-8, and other 8-bit text is taken as Windows-1251
+// if its high letters mostly follow each other (whole Cyrillic words), else as Windows-1252.
+// With sample_is_prefix, text is the start of a longer file: a character cut at its end is not held against UTF-8.
+// *out_bom_len receives the length of the byte order mark to skip (0 if none).
+TextEncoding DetectTextEncoding(const char *text, size_t text_len, bool sample_is_prefix, size_t *out_bom_len);
+
+// Most UTF-8 bytes TranscodeToUTF8 can write for input_len bytes of input (including its 3 bytes of scratch room)
+size_t TranscodeMaxOutputLen(TextEncoding encoding, size_t input_len);
+// Converts input to UTF-8 at output[*output_len..], advancing *output_len, and returns the input bytes consumed.
+// Unless input_is_final, the end of UTF-16 input may be left over (an odd byte or the first half of a surrogate
+// pair) for the next call. Bytes with no mapping and unpaired surrogates are dropped.
+size_t TranscodeToUTF8(TextEncoding encoding, const char *input, size_t input_len, bool input_is_final,
+                       char *output, size_t *output_len);
+
+
+#endif // TEXT_IMPORT_H
@@ -0,0 +1,505 @@
+#include "text_loader.h"
+#include "line_index.h"        // For LineIndexTextExtended
+#include "block_table.h"       // For BlockTableTextExtended
+#include "text_stats.h"        // For TextStatsScan
+#include "replacement_rules.h" // For ReplacementRulesLoad
+#include "progress_checkpoint.h" // For ProgressResumeOffsets, ProgressTextHash
+#include "config.h"            // For TEXT_IMPORT_SAMPLE_BYTES, TEXT_LOAD_CHUNK_BYTES, TEXT_LOAD_MAX_CHUNK_BYTES, TEXT_LOAD_PUBLISH_BYTES, TEXT_IMPORT_STRIP_MARKUP
+#include <SDL2/SDL_events.h>   // For SDL_RegisterEvents, SDL_PushEvent
+#include <SDL2/SDL_timer.h>    // For SDL_GetTicks
+#include <string.h>            // For memcpy, memmove, strlen, strerror
+#include <stdlib.h>            // For malloc, calloc, realloc, free
+#include <errno.h>             // For errno
+#include <sys/stat.h>          // For fstat, S_ISREG
+#ifdef _WIN32
+#include <io.h>                // For _read, _fileno
+#else
+#include <unistd.h>            // For read
+#endif
+
+// The source goes through the same stages as a whole file would (TranscodeToUTF8, MarkupStripFeed,
+// PreprocessFeed), one piece at a time, into a text buffer owned by the loader. The main thread only ever
+// reads a published prefix of it, which ends just after a space or line break that has more text behind it:
+// later text can neither change those bytes nor how they wrap, so the line index built so far stays valid.
+// The text buffer of a regular file is sized for the whole text up front (pages are only used once written), so
+// it never moves. Otherwise it doubles when full: in place while the main thread has not picked it up yet, else
+// by copying it without holding the lock (published bytes never change); the old buffer is then retired and
+// freed by the main thread once it has switched to the new one.
+// Reads double as the text grows (up to TEXT_LOAD_MAX_CHUNK_BYTES), so the pieces of a large text are big
+// enough for PreprocessFeedParallel to split among threads.
+// When typing resumes from a checkpoint, the text before start_offset is loaded (to check it and to keep the
+// preprocessor state right) but never handed over; published_len and the summary start from there.
+
+#define TEXT_LOADER_RAW_CARRY_BYTES 4 // Input TranscodeToUTF8 may leave for the next piece (3 bytes, rounded up)
+#define TEXT_LOADER_SLACK_BYTES (MARKUP_TAG_BYTES_MAX + 8) // Bytes the markup stripper can hold back and emit later
+#define TEXT_LOADER_EXIT_WAIT_MS 500 // How long TextLoaderFree waits for the thread to see the cancel request
+
+// Helper function for logging if appCtx->log_file_handle is available
+static void log_loader_message_format(AppContext *appCtx, const char* format, ...) {
+    if (appCtx && appCtx->log_file_handle && format) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(appCtx->log_file_handle, format, args);
+        va_end(args);
+        fprintf(appCtx->log_file_handle, "\n");
+        fflush(appCtx->log_file_handle);
+    }
+}
+
+// Most output bytes per input byte: a rule writes to_len bytes for every from_len it reads
+static size_t rules_growth_factor(const ReplacementRules *rules) {
+    size_t growth_factor = 1;
+    for (int rule_idx = 0; rules && rule_idx < rules->rule_count; rule_idx++) {
+        const ReplacementRule *rule = &rules->rules[rule_idx];
+        if (rule->from_len == 0) continue;
+        size_t rule_factor = ((size_t)rule->to_len + rule->from_len - 1) / rule->from_len;
+        if (rule_factor > growth_factor) growth_factor = rule_factor;
+    }
+    return growth_factor;
+}
+
+// Largest converted piece: a whole read plus the incomplete unit left over from the previous one
+static size_t text_loader_piece_capacity(const TextLoader *loader) {
+    return TranscodeMaxOutputLen(loader->encoding, loader->read_capacity + TEXT_LOADER_RAW_CARRY_BYTES) + TEXT_LOADER_SLACK_BYTES;
+}
+
+// Grows the input buffers for reads of read_len bytes; on failure the reads just stay smaller
+static bool text_loader_grow_reads(TextLoader *loader, size_t read_len) {
+    char *raw_buffer = (char*)realloc(loader->raw_buffer, read_len + TEXT_LOADER_RAW_CARRY_BYTES + TEXT_LOADER_SLACK_BYTES);
+    if (!raw_buffer) return false;
+    loader->raw_buffer = raw_buffer; // Keeps the carry in front
+    size_t old_read_capacity = loader->read_capacity;
+    loader->read_capacity = read_len;
+    size_t piece_capacity = text_loader_piece_capacity(loader);
+    char *utf8_buffer = loader->utf8_buffer ? (char*)realloc(loader->utf8_buffer, piece_capacity) : NULL;
+    if (utf8_buffer) loader->utf8_buffer = utf8_buffer;
+    char *stripped_buffer = loader->stripped_buffer ? (char*)realloc(loader->stripped_buffer, piece_capacity) : NULL;
+    if (stripped_buffer) loader->stripped_buffer = stripped_buffer;
+    if ((loader->utf8_buffer && !utf8_buffer) || (loader->stripped_buffer && !stripped_buffer)) {
+        loader->read_capacity = old_read_capacity;
+        return false;
+    }
+    return true;
+}
+
+// Wakes the main loop if it sleeps in SDL_WaitEvent, so it polls the loader
+static void text_loader_wake_main(TextLoader *loader) {
+    if (loader->wake_event_type == (Uint32)-1) return; // Not registered yet: nothing is waiting before the first frame
+    SDL_Event wake_event;
+    SDL_zero(wake_event);
+    wake_event.type = loader->wake_event_type;
+    SDL_PushEvent(&wake_event);
+}
+
+// Makes room for needed_len bytes of text (and a terminator)
+static bool text_loader_reserve(TextLoader *loader, size_t needed_len) {
+    if (needed_len <= loader->text_capacity) return true;
+    size_t new_capacity = loader->text_capacity * 2;
+    if (new_capacity < needed_len) new_capacity = needed_len;
+
+    // A buffer the main thread has not picked up yet is grown in place; the lock keeps TextLoaderPoll from
+    // taking it meanwhile (large blocks are remapped rather than copied, so this is short)
+    SDL_LockMutex(loader->mutex);
+    if (!loader->text_handed_over) {
+        char *grown_text = (char*)realloc(loader->text, new_capacity + 1);
+        if (grown_text) loader->text = grown_text;
+        SDL_UnlockMutex(loader->mutex);
+        if (!grown_text) {
+            log_loader_message_format(loader->appCtx, "Error: Failed to allocate %zu bytes for the loaded text: %s", new_capacity + 1, strerror(errno));
+            return false;
+        }
+        loader->text_capacity = new_capacity;
+        return true;
+    }
+    SDL_UnlockMutex(loader->mutex); // Handed over for good: only a new buffer resets the flag
+
+    char *new_text = (char*)malloc(new_capacity + 1);
+    if (!new_text) {
+        log_loader_message_format(loader->appCtx, "Error: Failed to allocate %zu bytes for the loaded text: %s", new_capacity + 1, strerror(errno));
+        return false;
+    }
+    if (loader->text_len > 0) memcpy(new_text, loader->text, loader->text_len); // Only this thread writes to the text
+
+    SDL_LockMutex(loader->mutex);
+    // The main thread may still read the buffer retired before; it lets go of it at its next poll
+    while (loader->retired_text && !SDL_AtomicGet(&loader->cancel_requested)) SDL_CondWait(loader->cond, loader->mutex);
+    if (loader->retired_text) { // Cancelled
+        SDL_UnlockMutex(loader->mutex);
+        free(new_text);
+        return false;
+    }
+    loader->retired_text = loader->text;
+    loader->text = new_text;
+    loader->text_handed_over = false;
+    SDL_UnlockMutex(loader->mutex);
+
+    loader->text_capacity = new_capacity;
+    text_loader_wake_main(loader);
+    return true;
+}
+
+// Appends up to max_len bytes of the source to raw_buffer; returns false at the end of the source, on a read error
+// or if loading was cancelled meanwhile. A read is the one wait TextLoaderFree gives up on: once it has, appCtx
+// (the log, the rules) may be gone, so after a cancelled read the thread must not touch it again.
+static bool text_loader_read(TextLoader *loader, size_t max_len) {
+    SDL_LockMutex(loader->mutex);
+    loader->thread_reading = true;
+    SDL_UnlockMutex(loader->mutex);
+    size_t read_len = fread(loader->raw_buffer + loader->raw_len, 1, max_len, loader->source);
+    int read_errno = errno;
+    SDL_LockMutex(loader->mutex);
+    loader->thread_reading = false;
+    SDL_UnlockMutex(loader->mutex);
+    if (SDL_AtomicGet(&loader->cancel_requested)) return false;
+
+    loader->raw_len += read_len;
+    loader->source_bytes_read += read_len;
+    if (read_len == max_len) return true;
+    if (ferror(loader->source)) log_loader_message_format(loader->appCtx, "Error reading the text after %zu bytes: %s", loader->source_bytes_read, strerror(read_errno));
+    return false;
+}
+
+// Main thread, first read of a pipe: appends what the source has ready (up to max_len bytes) to raw_buffer, so a slow
+// writer does not keep the window blank until a whole sample has arrived. Returns false at the end of the source
+// or on a read error. Nothing has been read through the FILE yet, so later freads go on from here.
+static bool text_loader_read_available(TextLoader *loader, size_t max_len) {
+    for (;;) {
+#ifdef _WIN32
+        int read_len = _read(_fileno(loader->source), loader->raw_buffer + loader->raw_len, (unsigned)max_len);
+#else
+        ssize_t read_len = read(fileno(loader->source), loader->raw_buffer + loader->raw_len, max_len);
+#endif
+        if (read_len > 0) {
+            loader->raw_len += (size_t)read_len;
+            loader->source_bytes_read += (size_t)read_len;
+            return true;
+        }
+        if (read_len == 0) return false;
+        if (errno == EINTR) continue;
+        log_loader_message_format(loader->appCtx, "Error reading the text: %s", strerror(errno));
+        return false;
+    }
+}
+
+// Converts, strips and preprocesses raw_buffer[0, raw_len) into the text. Input left over by the conversion
+// (the first half of a UTF-16 unit or surrogate pair) is moved to the front of raw_buffer for the next piece.
+static bool text_loader_process(TextLoader *loader, bool input_is_final) {
+    const char *piece = loader->raw_buffer;
+    size_t piece_len = loader->raw_len;
+    size_t consumed_len = loader->raw_len;
+    if (loader->encoding != TEXT_ENCODING_UTF8) {
+        piece_len = 0;
+        consumed_len = TranscodeToUTF8(loader->encoding, loader->raw_buffer, loader->raw_len, input_is_final, loader->utf8_buffer, &piece_len);
+        piece = loader->utf8_buffer;
+    }
+
+    if (!loader->markup_detected) { // Guessed once, from the sample
+        loader->markup_detected = true;
+        MarkupKind markup_kind = TEXT_IMPORT_STRIP_MARKUP ? DetectTextMarkup(piece, piece_len) : MARKUP_NONE;
+        MarkupStripInit(&loader->markup_state, markup_kind);
+        if (markup_kind != MARKUP_NONE) {
+            loader->preprocess_state.input_is_valid_utf8 = false; // Entities and kept markup are not checked
+            loader->stripped_buffer = (char*)malloc(text_loader_piece_capacity(loader));
+            if (!loader->stripped_buffer) {
+                log_loader_message_format(loader->appCtx, "Error: Failed to allocate the markup stripping buffer: %s", strerror(errno));
+                return false;
+            }
+            log_loader_message_format(loader->appCtx, "Text looks like %s; markup is stripped while loading.",
+                                      markup_kind == MARKUP_HTML ? "HTML" : "Markdown");
+        }
+    }
+    if (loader->markup_state.kind != MARKUP_NONE) {
+        size_t stripped_len = MarkupStripFeed(&loader->markup_state, piece, piece_len, loader->stripped_buffer, 0);
+        if (input_is_final) stripped_len = MarkupStripFinish(&loader->markup_state, loader->stripped_buffer, stripped_len);
+        piece = loader->stripped_buffer;
+        piece_len = stripped_len;
+    }
+
+    // A pending line break and the rule carry add to this piece's output
+    size_t max_output_len = (piece_len + REPLACEMENT_RULE_MAX_BYTES + 2) * loader->growth_factor;
+    if (!text_loader_reserve(loader, loader->text_len + max_output_len)) return false;
+    loader->text_len = PreprocessFeedParallel(loader->appCtx, &loader->preprocess_state, piece, piece_len, loader->text, loader->text_len);
+    if (input_is_final) loader->text_len = PreprocessFinish(&loader->preprocess_state, loader->text, loader->text_len);
+
+    loader->raw_len -= consumed_len;
+    if (loader->raw_len > 0) memmove(loader->raw_buffer, loader->raw_buffer + consumed_len, loader->raw_len);
+    return true;
+}
+
+// Hands [0, publish_len) of the text to the main thread
+static void text_loader_publish(TextLoader *loader, size_t publish_len, bool finished) {
+    size_t already_published_len = loader->start_offset + loader->summary.byte_count;
+    if (publish_len > already_published_len) {
+        TextStatsScan(loader->text + already_published_len, publish_len - already_published_len, &loader->summary, NULL, 0);
+    }
+    if (finished) loader->text[publish_len] = '\0'; // Before that, the bytes behind publish_len are text still to come
+
+    SDL_LockMutex(loader->mutex);
+    loader->published_len = publish_len;
+    loader->published_summary = loader->summary;
+    loader->finished = finished;
+    SDL_CondBroadcast(loader->cond);
+    SDL_UnlockMutex(loader->mutex);
+    text_loader_wake_main(loader);
+}
+
+// Publishes the text whose layout is final once enough of it has piled up: the first bytes right away,
+// then at least TEXT_LOAD_PUBLISH_BYTES and half of what is already published (so large texts are
+// handed over a few dozen times in all)
+static void text_loader_publish_if_due(TextLoader *loader) {
+    size_t published_len = loader->start_offset + loader->summary.byte_count;
+    size_t due_len = loader->summary.byte_count / 2 > TEXT_LOAD_PUBLISH_BYTES ? loader->summary.byte_count / 2 : TEXT_LOAD_PUBLISH_BYTES;
+    if (loader->summary.byte_count > 0 && loader->text_len - published_len < due_len) return;
+
+    // Just after the last space or line break with a byte behind it (a trailing space may still be dropped)
+    size_t stable_len = loader->text_len;
+    while (stable_len > published_len + 1) {
+        stable_len--;
+        char c = loader->text[stable_len - 1];
+        if (c == ' ' || c == '\n') {
+            text_loader_publish(loader, stable_len, false);
+            return;
+        }
+    }
+}
+
+// Closes the source and publishes the rest of the text (all of it, or what was loaded before an error)
+static void text_loader_end(TextLoader *loader, bool load_ok) {
+    if (loader->source && !loader->source_is_stdin) fclose(loader->source);
+    loader->source = NULL;
+
+    if (!SDL_AtomicGet(&loader->cancel_requested)) {
+        if (!load_ok) { // The preprocessor could not finish; trim as it would have
+            while (loader->text_len > loader->start_offset + loader->summary.byte_count &&
+                   (loader->text[loader->text_len - 1] == ' ' || loader->text[loader->text_len - 1] == '\n')) loader->text_len--;
+            log_loader_message_format(loader->appCtx, "Error: Loading stopped after %zu bytes of the source; the rest of the text is left out.", loader->source_bytes_read);
+        }
+        text_loader_publish(loader, loader->text_len, true);
+        log_loader_message_format(loader->appCtx, "Text loaded: %zu source bytes; %zu bytes, %zu characters, %zu words, %zu lines.",
+                                  loader->source_bytes_read, loader->summary.byte_count, loader->summary.codepoint_count,
+                                  loader->summary.word_count, loader->summary.line_count);
+        if (loader->text_len == loader->start_offset) log_loader_message_format(loader->appCtx, "Warning: Text content after preprocessing is empty.");
+    }
+
+    SDL_LockMutex(loader->mutex);
+    loader->thread_exited = true;
+    SDL_CondBroadcast(loader->cond);
+    SDL_UnlockMutex(loader->mutex);
+}
+
+static int text_loader_thread(void *data) {
+    TextLoader *loader = (TextLoader*)data;
+    bool load_ok = true;
+    bool at_end = false;
+    while (load_ok && !at_end && !SDL_AtomicGet(&loader->cancel_requested)) {
+        // Twice as much per read once as much has been read twice over
+        if (loader->source_bytes_read >= 2 * loader->read_capacity && loader->read_capacity < TEXT_LOAD_MAX_CHUNK_BYTES) {
+            size_t read_len = 2 * loader->read_capacity < TEXT_LOAD_MAX_CHUNK_BYTES ? 2 * loader->read_capacity : TEXT_LOAD_MAX_CHUNK_BYTES;
+            if (!text_loader_grow_reads(loader, read_len)) {
+                log_loader_message_format(loader->appCtx, "Warning: Failed to grow the read buffers to %zu bytes; reading %zu bytes at a time.", read_len, loader->read_capacity);
+            }
+        }
+        at_end = !text_loader_read(loader, loader->read_capacity);
+        if (SDL_AtomicGet(&loader->cancel_requested)) break; // The rest is skipped, and so is every log message
+        load_ok = text_loader_process(loader, at_end);
+        if (load_ok && !at_end) text_loader_publish_if_due(loader);
+    }
+    text_loader_end(loader, load_ok);
+    return 0;
+}
+
+// Bytes from the current position to the end of source if it is a regular file, else 0 (a pipe has no size)
+static size_t text_loader_source_size(FILE *source) {
+#ifdef _WIN32
+    struct _stat64 file_status;
+    if (_fstat64(_fileno(source), &file_status) != 0 || !(file_status.st_mode & _S_IFREG)) return 0;
+#else
+    struct stat file_status;
+    if (fstat(fileno(source), &file_status) != 0 || !S_ISREG(file_status.st_mode)) return 0;
+#endif
+    long position = ftell(source);
+    if (position < 0 || file_status.st_size < position) return 0;
+    return (size_t)(file_status.st_size - position);
+}
+
+// Picks the first checkpoint position whose preceding text is unchanged, if any. The text up to it has been
+// processed, with more behind it (or it is all there), so the bytes before it are final.
+static void text_loader_choose_start(TextLoader *loader, const ProgressRecord *resume_from) {
+    size_t resume_offsets[2];
+    int resume_offset_count = ProgressResumeOffsets(resume_from, resume_offsets);
+    for (int offset_idx = 0; offset_idx < resume_offset_count; offset_idx++) {
+        size_t resume_offset = resume_offsets[offset_idx];
+        if (resume_offset >= loader->text_len) continue; // Nothing left to type there: start over
+        if (ProgressTextHash(loader->text, resume_offset) != resume_from->text_hash) continue;
+        loader->start_offset = resume_offset;
+        loader->published_len = resume_offset;
+        log_loader_message_format(loader->appCtx, "Resuming at byte %zu of the text.", resume_offset);
+        return;
+    }
+    if (resume_offset_count > 0) {
+        log_loader_message_format(loader->appCtx, "The text changed since the last session (or was typed to the end); starting from the beginning.");
+    }
+}
+
+TextLoader *TextLoaderStart(AppContext *appCtx, FILE *source, bool source_is_stdin, const char *fallback_text,
+                            const ProgressRecord *resume_from) {
+    TextLoader *loader = (TextLoader*)calloc(1, sizeof(TextLoader));
+    if (!loader) {
+        log_loader_message_format(appCtx, "Error: Failed to allocate the text loader: %s", strerror(errno));
+        if (source && !source_is_stdin) fclose(source);
+        return NULL;
+    }
+    loader->appCtx = appCtx;
+    loader->source = source;
+    loader->source_is_stdin = source_is_stdin;
+    loader->wake_event_type = (Uint32)-1;
+    loader->mutex = SDL_CreateMutex();
+    loader->cond = SDL_CreateCond();
+    loader->raw_buffer = (char*)malloc(TEXT_LOAD_CHUNK_BYTES + TEXT_LOADER_RAW_CARRY_BYTES + TEXT_LOADER_SLACK_BYTES);
+    loader->read_capacity = TEXT_LOAD_CHUNK_BYTES;
+    if (!loader->mutex || !loader->cond || !loader->raw_buffer) {
+        log_loader_message_format(appCtx, "Error: Failed to set up the text loader: %s", loader->raw_buffer ? SDL_GetError() : strerror(errno));
+        TextLoaderFree(loader);
+        return NULL;
+    }
+
+    // Built-in rules unless main loaded them (together with the rules file) already
+    if (appCtx && appCtx->replacement_rules.state_count == 0) ReplacementRulesLoad(appCtx, NULL);
+    PreprocessStateInit(&loader->preprocess_state);
+    loader->preprocess_state.rules = appCtx ? &appCtx->replacement_rules : NULL;
+    loader->growth_factor = rules_growth_factor(loader->preprocess_state.rules);
+
+    // The sample, from which the encoding and the markup are guessed, is loaded before the first frame
+    // (from a pipe, only what has arrived: the guesses then rest on a shorter sample)
+    bool at_end = true;
+    size_t sample_len = TEXT_IMPORT_SAMPLE_BYTES < TEXT_LOAD_CHUNK_BYTES ? TEXT_IMPORT_SAMPLE_BYTES : TEXT_LOAD_CHUNK_BYTES;
+    if (source) {
+        loader->source_size = text_loader_source_size(source);
+        at_end = loader->source_size > 0 ? !text_loader_read(loader, sample_len) : !text_loader_read_available(loader, sample_len);
+    }
+    if (loader->raw_len == 0 && fallback_text) {
+        log_loader_message_format(appCtx, "No text to read; using the placeholder text.");
+        size_t fallback_len = strlen(fallback_text);
+        if (fallback_len > TEXT_LOAD_CHUNK_BYTES) fallback_len = TEXT_LOAD_CHUNK_BYTES;
+        memcpy(loader->raw_buffer, fallback_text, fallback_len);
+        loader->raw_len = fallback_len;
+        at_end = true;
+    }
+
+    size_t bom_len = 0;
+    loader->encoding = DetectTextEncoding(loader->raw_buffer, loader->raw_len, !at_end, &bom_len);
+    if (bom_len > 0) {
+        loader->raw_len -= bom_len;
+        memmove(loader->raw_buffer, loader->raw_buffer + bom_len, loader->raw_len);
+    }
+    if (loader->encoding != TEXT_ENCODING_UTF8 || bom_len > 0) {
+        log_loader_message_format(appCtx, "Text is %s%s; it is converted to UTF-8 while loading.",
+                                  TextEncodingName(loader->encoding), bom_len > 0 ? " (with byte order mark)" : "");
+    }
+    if (loader->encoding != TEXT_ENCODING_UTF8) {
+        loader->utf8_buffer = (char*)malloc(text_loader_piece_capacity(loader));
+        loader->preprocess_state.input_is_valid_utf8 = true; // The conversion only writes valid sequences
+    }
+    // Room for the whole text of a file (each piece reserves for its rule carry and line break on top of the text
+    // before it, hence twice), or for a few reads of a pipe, after which the buffer doubles as needed
+    size_t initial_capacity = (TEXT_LOAD_CHUNK_BYTES + REPLACEMENT_RULE_MAX_BYTES + 2) * loader->growth_factor * 4;
+    if (loader->source_size > 0) {
+        initial_capacity = (TranscodeMaxOutputLen(loader->encoding, loader->source_size) + TEXT_LOADER_SLACK_BYTES +
+                            2 * (REPLACEMENT_RULE_MAX_BYTES + 2)) * loader->growth_factor;
+    }
+    if ((loader->encoding != TEXT_ENCODING_UTF8 && !loader->utf8_buffer) || !text_loader_reserve(loader, initial_capacity)) {
+        log_loader_message_format(appCtx, "Error: Failed to allocate the text loader buffers: %s", strerror(errno));
+        TextLoaderFree(loader);
+        return NULL;
+    }
+
+    bool load_ok = text_loader_process(loader, at_end);
+
+    // The text up to a checkpoint is loaded now too (two more bytes keep a trailing space from being trimmed later)
+    size_t resume_offsets[2];
+    int resume_offset_count = ProgressResumeOffsets(resume_from, resume_offsets);
+    size_t resume_load_len = 0;
+    for (int offset_idx = 0; offset_idx < resume_offset_count; offset_idx++) {
+        if (resume_offsets[offset_idx] > resume_load_len) resume_load_len = resume_offsets[offset_idx];
+    }
+    while (load_ok && !at_end && resume_offset_count > 0 && loader->text_len < resume_load_len + 2) {
+        at_end = !text_loader_read(loader, TEXT_LOAD_CHUNK_BYTES);
+        load_ok = text_loader_process(loader, at_end);
+    }
+    if (load_ok && resume_offset_count > 0) text_loader_choose_start(loader, resume_from);
+
+    if (!load_ok || at_end) { // The whole text fit in the sample (or up to the checkpoint)
+        text_loader_end(loader, load_ok);
+        return loader;
+    }
+    text_loader_publish_if_due(loader);
+
+    loader->wake_event_type = SDL_RegisterEvents(1);
+    loader->thread = SDL_CreateThread(text_loader_thread, "text_loader", loader);
+    if (!loader->thread) { // Load the rest right here instead
+        log_loader_message_format(appCtx, "Warning: SDL_CreateThread failed in TextLoaderStart: %s. Loading the whole text now.", SDL_GetError());
+        text_loader_thread(loader);
+    }
+    return loader;
+}
+
+bool TextLoaderPoll(AppContext *appCtx, TextLoader *loader, const char **text_to_type, size_t *final_text_len) {
+    if (!loader || !loader->mutex || !text_to_type || !final_text_len || loader->polled_final) return false;
+
+    SDL_LockMutex(loader->mutex);
+    bool text_changed = (*text_to_type != loader->text + loader->start_offset || *final_text_len != loader->published_len - loader->start_offset);
+    *text_to_type = loader->text + loader->start_offset;
+    *final_text_len = loader->published_len - loader->start_offset;
+    loader->text_handed_over = true;
+    if (appCtx) {
+        appCtx->text_summary = loader->published_summary;
+        appCtx->text_load_finished = loader->finished;
+        // Valid UTF-8 has a continuation byte in every non-ASCII character; a later part may still bring one
+        appCtx->text_is_ascii = (appCtx->text_summary.codepoint_count == appCtx->text_summary.byte_count);
+    }
+    if (loader->finished) loader->polled_final = true;
+    if (loader->retired_text) { // This thread has just stopped using it
+        free(loader->retired_text);
+        loader->retired_text = NULL;
+        SDL_CondBroadcast(loader->cond);
+    }
+    SDL_UnlockMutex(loader->mutex);
+
+    if (text_changed && appCtx) {
+        LineIndexTextExtended(&appCtx->line_index, *text_to_type, *final_text_len);
+        BlockTableTextExtended(&appCtx->block_table, *text_to_type, *final_text_len);
+        appCtx->needs_redraw = true;
+    }
+    return text_changed;
+}
+
+void TextLoaderFree(TextLoader *loader) {
+    if (!loader) return;
+    if (loader->thread) {
+        SDL_AtomicSet(&loader->cancel_requested, 1);
+        SDL_LockMutex(loader->mutex);
+        SDL_CondBroadcast(loader->cond); // In case it waits for a retired buffer to be freed
+        // Processing a piece always ends; only a read of a pipe that has not ended may block for good
+        Uint32 wait_start_ms = SDL_GetTicks();
+        while (!loader->thread_exited && (!loader->thread_reading || SDL_GetTicks() - wait_start_ms < TEXT_LOADER_EXIT_WAIT_MS)) {
+            SDL_CondWaitTimeout(loader->cond, loader->mutex, 50);
+        }
+        bool thread_exited = loader->thread_exited;
+        SDL_UnlockMutex(loader->mutex);
+        if (!thread_exited) { // Still reading: when the read returns, it sees the cancel request and ends without a word
+            log_loader_message_format(loader->appCtx, "Text loader is still waiting for input; leaving it to end with the process.");
+            SDL_DetachThread(loader->thread);
+            return; // The loader and its buffers are left to the thread, which uses them until it ends
+        }
+        SDL_WaitThread(loader->thread, NULL);
+    }
+    if (loader->source && !loader->source_is_stdin) fclose(loader->source);
+    free(loader->text);
+    free(loader->retired_text);
+    free(loader->raw_buffer);
+    free(loader->utf8_buffer);
+    free(loader->stripped_buffer);
+    if (loader->cond) SDL_DestroyCond(loader->cond);
+    if (loader->mutex) SDL_DestroyMutex(loader->mutex);
+    free(loader);
+}
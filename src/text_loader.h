@@ -0,0 +1,84 @@
+#ifndef TEXT_LOADER_H
+#define TEXT_LOADER_H
+
+#include "app_context.h"     // For AppContext, TextStats
+#include "text_import.h"     // For TextEncoding
+#include "markup_strip.h"    // For MarkupStripState
+#include "text_processing.h" // For PreprocessState
+#include "progress_checkpoint.h" // For ProgressRecord
+#include <SDL2/SDL_thread.h> // For SDL_Thread, SDL_mutex, SDL_cond
+#include <SDL2/SDL_atomic.h> // For SDL_atomic_t
+#include <stdbool.h>
+#include <stddef.h> // For size_t
+#include <stdio.h>  // For FILE*
+
+// Progressive loading of the practice text (see text_loader.c).
+// The start of the source is converted, stripped and preprocessed before the first frame; a background thread
+// does the rest and hands the main thread ever longer prefixes of the final text.
+typedef struct {
+    // Shared with the main thread, guarded by mutex
+    SDL_mutex *mutex;
+    SDL_cond *cond;           // Signaled when text is published, a buffer is retired or freed, or loading ends
+    char *text;               // Preprocessed text; [0, published_len) may be read by the main thread
+    size_t published_len;     // Always ends after a space or line break, so the blocks before it are final
+                              // (at least start_offset)
+    TextStats published_summary; // Counts of [0, published_len)
+    char *retired_text;       // Buffer replaced by a larger one, freed by the main thread in TextLoaderPoll
+    bool text_handed_over;    // The main thread has picked up the current text buffer (until then it may be realloc'd)
+    bool finished;            // The whole source is loaded and published_len is final
+    bool thread_exited;
+    bool thread_reading;      // Waiting for the source in fread; TextLoaderFree stops waiting for the thread only then
+    SDL_atomic_t cancel_requested;
+
+    // Set by TextLoaderStart, read-only afterwards
+    size_t start_offset;      // Where typing resumes: the main thread gets the text from here on (the bytes
+                              // before it stay in the buffer)
+
+    // Loader thread (or the main thread in TextLoaderStart)
+    AppContext *appCtx;
+    SDL_Thread *thread;
+    FILE *source;
+    bool source_is_stdin;     // Not closed
+    size_t source_size;       // Bytes to read if the source is a regular file (0 for a pipe), to size the text buffer
+    TextEncoding encoding;
+    MarkupStripState markup_state;
+    bool markup_detected;     // The markup kind has been guessed from the first converted piece
+    PreprocessState preprocess_state;
+    size_t growth_factor;     // Most output bytes per input byte the replacement rules can produce
+    char *raw_buffer;         // Bytes read, with an incomplete UTF-16 unit of the previous read in front
+    size_t raw_len;
+    size_t read_capacity;     // Bytes read at a time, which the buffers have room for
+    char *utf8_buffer;        // Converted input (not used for UTF-8 sources)
+    char *stripped_buffer;    // Input without its markup (used only if there is markup)
+    size_t text_len;          // Preprocessed bytes in text, published or not
+    size_t text_capacity;
+    TextStats summary;        // Counts of the text published so far, from start_offset
+    size_t source_bytes_read;
+    Uint32 wake_event_type;   // Pushed after each publish so a sleeping main loop picks the text up
+
+    // Main thread
+    bool polled_final;        // TextLoaderPoll has returned the final text
+} TextLoader;
+
+// Starts loading the practice text from source, which is taken over (closed once read, unless it is stdin).
+// The first TEXT_IMPORT_SAMPLE_BYTES (of a pipe, as much of them as has arrived) are read and processed right away,
+// the rest on a background thread.
+// If source is NULL or empty, fallback_text is loaded instead. Returns NULL if the loader could not be set up.
+// With resume_from (a progress checkpoint), the text up to its position is loaded right away too, and if the text
+// before it is unchanged, the main thread gets the text from there on (start_offset); otherwise from the start.
+// The loader is allocated here because its thread may outlive TextLoaderFree (see there).
+TextLoader *TextLoaderStart(AppContext *appCtx, FILE *source, bool source_is_stdin, const char *fallback_text,
+                            const ProgressRecord *resume_from);
+
+// Main thread, between frames: picks up text published since the last call into *text_to_type and
+// *final_text_len, updates appCtx->text_summary (and text_load_finished, text_is_ascii) and the line index, and
+// frees a replaced buffer.
+// Returns true if the text changed; the previous text pointer must not be used afterwards.
+bool TextLoaderPoll(AppContext *appCtx, TextLoader *loader, const char **text_to_type, size_t *final_text_len);
+
+// Stops loading and frees the loader, the text and all buffers. A thread stuck reading a pipe is left to end with
+// the process, together with the loader it uses; it does not touch appCtx again, so the caller may clean up the
+// rest of the app right after.
+void TextLoaderFree(TextLoader *loader);
+
+#endif // TEXT_LOADER_H
@@ -1,18 +1,15 @@
 #include "text_processing.h"
-#include "utf8_utils.h" // For decode_utf8
+#include "utf8_utils.h" // For decode_utf8, decode_utf8_unchecked, ScanAsciiRun, ScanBlockRun
+#include "replacement_rules.h" // For ReplacementRulesMatch
 #include "config.h"     // For FONT_SIZE, TAB_SIZE_IN_SPACES, TEXT_AREA_X
 #include <string.h>     // For memcpy, strerror
-#include <stdlib.h>     // For malloc, realloc, free
+#include <stdlib.h>     // For malloc, calloc, free
 #include <errno.h>      // For errno
 #include <math.h> // For roundf
+#include <SDL2/SDL_thread.h>  // For SDL_CreateThread, SDL_WaitThread
+#include <SDL2/SDL_cpuinfo.h> // For SDL_GetCPUCount
 
 // Helper function for logging if appCtx->log_file_handle is available
-static void log_message(AppContext *appCtx, const char* message) {
-    if (appCtx && appCtx->log_file_handle && message) {
-        fprintf(appCtx->log_file_handle, "%s\n", message);
-        fflush(appCtx->log_file_handle);
-    }
-}
 static void log_message_format(AppContext *appCtx, const char* format, ...) {
     if (appCtx && appCtx->log_file_handle && format) {
         va_list args;
@@ -25,224 +22,450 @@ static void log_message_format(AppContext *appCtx, const char* format, ...) {
 }
 
 
-char* PreprocessText(AppContext *appCtx, const char* raw_text_buffer, size_t raw_text_len, size_t* out_final_text_len) {
-    if (raw_text_buffer == NULL || out_final_text_len == NULL) {
-        if (out_final_text_len) *out_final_text_len = 0;
-        return NULL;
-    }
-    if (raw_text_len == 0) {
-        *out_final_text_len = 0;
-        char* empty_str = (char*)malloc(1);
-        if (empty_str) empty_str[0] = '\0';
-        else { log_message(appCtx, "Error: malloc failed for empty_str in PreprocessText"); }
-        return empty_str;
-    }
-
-    // First pass: normalize line breaks, replace some characters
-    size_t temp_buffer_capacity = raw_text_len * 2 + 10; // Margin for replacements
-    char *temp_buffer = (char*)malloc(temp_buffer_capacity);
-    if (!temp_buffer) {
-        log_message_format(appCtx, "Error: Failed to allocate temporary buffer in PreprocessText: %s", strerror(errno));
-        perror("Failed to allocate temporary buffer in PreprocessText");
-        *out_final_text_len = 0;
-        return NULL;
-    }
-
-    size_t temp_w_idx = 0; // Write index in temp_buffer
-    const char* p_read = raw_text_buffer;
-    const char* p_read_end = raw_text_buffer + raw_text_len;
-
-    while (p_read < p_read_end) {
-        // Check for buffer overflow before writing
-        if (temp_w_idx + 4 >= temp_buffer_capacity) { // +4 for the longest possible replacement (e.g., a UTF-8 character)
-            temp_buffer_capacity = temp_buffer_capacity * 2 + 4;
-            char *new_temp_buffer = (char *)realloc(temp_buffer, temp_buffer_capacity);
-            if (!new_temp_buffer) {
-                log_message_format(appCtx, "Error: Failed to reallocate temporary buffer (Pass 1): %s", strerror(errno));
-                perror("Failed to reallocate temporary buffer in PreprocessText (Pass 1)");
-                free(temp_buffer);
-                *out_final_text_len = 0;
-                return NULL;
+// --- Text preprocessing ---
+// One streaming pass normalizes characters (line breaks, invalid bytes, and the typographic replacement
+// rules: by default dashes, quotes and ellipses) and collapses whitespace (runs of spaces/tabs, single
+// line breaks -> space, 2+ line breaks -> one '\n'). Output only runs ahead of input where a rule's
+// replacement is longer than what it replaces (by default "--" -> 3-byte en dash), which is what lets
+// the output share the input's buffer with only that much spare room.
+
+void PreprocessStateInit(PreprocessState *state) {
+    if (!state) return;
+    memset(state, 0, sizeof(PreprocessState));
+    state->last_char_output_was_space = true; // As if there was a space before the text (no leading space)
+}
+
+// Whitespace collapsing for one normalized character; may drop a space already written before a line break
+static void preprocess_emit_char(PreprocessState *state, char *output, size_t *output_len,
+                                 const char *char_bytes, size_t char_len, Sint32 cp) {
+    size_t w_idx = *output_len;
+    if (cp == '\n') {
+        state->consecutive_newlines++;
+        return;
+    }
+    if (state->consecutive_newlines > 0) { // There were line breaks before this character
+        if (state->content_has_started) {
+            // Remove space before the line break if it was there
+            if (w_idx > 0 && output[w_idx - 1] == ' ') w_idx--;
+            if (state->consecutive_newlines >= 2) { // Two or more line breaks -> one line break (new paragraph)
+                if (w_idx == 0 || output[w_idx - 1] != '\n') output[w_idx++] = '\n';
+            } else if (w_idx > 0 && output[w_idx - 1] != ' ' && output[w_idx - 1] != '\n') { // One line break -> space
+                output[w_idx++] = ' ';
             }
-            temp_buffer = new_temp_buffer;
+        }
+        state->last_char_output_was_space = true; // After processing line breaks, assume there was a space
+        state->consecutive_newlines = 0;
+    }
+
+    if (cp == ' ' || cp == '\t') {
+        if (state->content_has_started && !state->last_char_output_was_space) output[w_idx++] = ' '; // One space for the run
+        state->last_char_output_was_space = true;
+    } else {
+        memmove(output + w_idx, char_bytes, char_len); // In place, the source may be just ahead of the output
+        w_idx += char_len;
+        state->last_char_output_was_space = false;
+        state->content_has_started = true;
+    }
+    *output_len = w_idx;
+}
+
+// True if [p, end) is the beginning of a multi-byte sequence that more input could still complete
+static bool is_truncated_utf8_sequence(const char *p, const char *end) {
+    unsigned char lead = (unsigned char)*p;
+    size_t sequence_len = (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 1;
+    if (sequence_len == 1 || (size_t)(end - p) >= sequence_len) return false;
+    for (const char *q = p + 1; q < end; q++) {
+        if (((unsigned char)*q & 0xC0) != 0x80) return false; // Already invalid, no need to wait
+    }
+    return true;
+}
+
+// Emits a rule's replacement character by character, so it takes part in whitespace collapsing
+static void preprocess_emit_replacement(PreprocessState *state, char *output, size_t *output_len, const ReplacementRule *rule) {
+    const char *to = rule->to, *to_end = rule->to + rule->to_len;
+    while (to < to_end) {
+        const char *char_start = to;
+        Sint32 cp = decode_utf8_unchecked(&to, to_end); // Validated when the rules were loaded
+        preprocess_emit_char(state, output, output_len, char_start, (size_t)(to - char_start), cp);
+    }
+}
+
+// Processes input until it ends or (unless input_is_final) until only an undecidable tail is left:
+// the possible start of a longer rule match or a truncated UTF-8 sequence. Returns the bytes consumed.
+static size_t preprocess_run(PreprocessState *state, const char *input, size_t input_len, bool input_is_final,
+                             char *output, size_t *output_len) {
+    const ReplacementRules *rules = (state->rules && state->rules->state_count > 0) ? state->rules : NULL;
+    char ascii_stop_byte = rules ? rules->ascii_stop_byte : ' ';
+    const char *p = input;
+    const char *end = input + input_len;
+
+    while (p < end) {
+        if (state->skip_next_lf) { // The previous character was '\r'
+            state->skip_next_lf = false;
+            if (*p == '\n') { p++; continue; }
         }
 
-        // Handling \r\n and \r
-        if (*p_read == '\r') {
-            p_read++;
-            if (p_read < p_read_end && *p_read == '\n') { // \r\n
-                p_read++;
+        // Plain ASCII with no pending line breaks is copied as is, and so is a single space or a byte that
+        // starts a rule but doesn't match one here; the per-character path below produces the same output.
+        if (state->consecutive_newlines == 0) {
+            const char *plain_start = p;
+            bool plain_ends_with_space = state->last_char_output_was_space;
+            while (p < end) {
+                size_t plain_run_len = ScanAsciiRun(p, end, ' ', ascii_stop_byte);
+                if (rules && rules->several_ascii_starts) { // Only one rule start byte is cut by the scan itself
+                    for (size_t i = 0; i < plain_run_len; i++) {
+                        if (rules->starts_rule[(unsigned char)p[i]]) { plain_run_len = i; break; }
+                    }
+                }
+                p += plain_run_len;
+                if (plain_run_len > 0) plain_ends_with_space = false;
+                if (p == end) break;
+                if (rules && rules->starts_rule[(unsigned char)*p] &&
+                    (p + 1 == end || ReplacementRulesMatch(rules, p, end, input_is_final) != REPLACEMENT_NO_MATCH)) {
+                    break; // A replacement (or not enough input to tell)
+                }
+                if (*p == ' ') {
+                    if (plain_ends_with_space || (!state->content_has_started && p == plain_start)) break;
+                    p++;
+                    plain_ends_with_space = true;
+                    continue;
+                }
+                if ((unsigned char)*p > ' ' && (unsigned char)*p < 0x80) { // A rule start byte that didn't match
+                    p++;
+                    plain_ends_with_space = false;
+                    continue;
+                }
+                break;
+            }
+            size_t plain_len = (size_t)(p - plain_start);
+            if (plain_len > 0) {
+                memmove(output + *output_len, plain_start, plain_len);
+                *output_len += plain_len;
+                state->last_char_output_was_space = plain_ends_with_space;
+                state->content_has_started = true;
+                continue;
             }
-            // Replace with a single \n
-            temp_buffer[temp_w_idx++] = '\n';
-            continue;
         }
 
-        // Replace "--" with en-dash (–) U+2013 (E2 80 93)
-        if (*p_read == '-' && (p_read + 1 < p_read_end) && *(p_read + 1) == '-') {
-            temp_buffer[temp_w_idx++] = (char)0xE2;
-            temp_buffer[temp_w_idx++] = (char)0x80;
-            temp_buffer[temp_w_idx++] = (char)0x93; // en-dash
-            p_read += 2;
+        // Handling \r\n and \r: replace with a single \n
+        if (*p == '\r') {
+            p++;
+            state->skip_next_lf = true; // The '\n' of "\r\n" may arrive with the next input
+            preprocess_emit_char(state, output, output_len, "\n", 1, '\n');
             continue;
         }
 
-        const char *char_start = p_read;
-        Sint32 cp = decode_utf8(&p_read, p_read_end);
-        size_t orig_len = (size_t)(p_read - char_start);
-
-        if (cp <= 0) { // Decoding error or end
-            if (orig_len == 0 && p_read < p_read_end) { // If decode_utf8 couldn't advance, do it manually
-                p_read++;
+        // Typographic replacements: longest matching rule
+        if (rules && rules->starts_rule[(unsigned char)*p]) {
+            int rule_idx = ReplacementRulesMatch(rules, p, end, input_is_final);
+            if (rule_idx == REPLACEMENT_NEED_MORE_INPUT) break; // Wait for the next bytes
+            if (rule_idx >= 0) {
+                p += rules->rules[rule_idx].from_len;
+                preprocess_emit_replacement(state, output, output_len, &rules->rules[rule_idx]);
+                continue;
             }
-            continue; // Skip invalid characters
         }
 
-        // Typographic replacements
-        if (cp == 0x2014) { /* em dash — */ temp_buffer[temp_w_idx++] = (char)0xE2; temp_buffer[temp_w_idx++] = (char)0x80; temp_buffer[temp_w_idx++] = (char)0x93; /* en dash – */ continue; } // Replace em with en dash for consistency
-        if (cp == 0x2026) { /* ellipsis … */ temp_buffer[temp_w_idx++] = '.'; temp_buffer[temp_w_idx++] = '.'; temp_buffer[temp_w_idx++] = '.'; continue; }
-        if (cp == 0x2018 || cp == 0x2019 || cp == 0x201C || cp == 0x201D) { /* ’ ‘ “ ” */ temp_buffer[temp_w_idx++] = '\''; continue; }
+        const char *char_start = p;
+        // Validated input has no malformed or (when final) truncated sequences left to reject
+        Sint32 cp = (state->input_is_valid_utf8 && input_is_final) ? decode_utf8_unchecked(&p, end) : decode_utf8(&p, end);
+        size_t orig_len = (size_t)(p - char_start);
 
-
-        // Copying the original character (or its UTF-8 sequence)
-        if (temp_w_idx + orig_len <= temp_buffer_capacity) {
-            memcpy(temp_buffer + temp_w_idx, char_start, orig_len);
-            temp_w_idx += orig_len;
-        } else {
-            log_message(appCtx, "Error: Buffer overflow in PreprocessText Pass 1, character copy.");
-            break; // Exit loop if buffer is full
+        if (cp <= 0) { // Decoding error or NUL
+            if (orig_len == 0) {
+                if (!input_is_final && is_truncated_utf8_sequence(char_start, end)) break; // Wait for the rest
+                p++; // decode_utf8 couldn't advance, do it manually
+            }
+            continue; // Skip invalid characters
         }
+        preprocess_emit_char(state, output, output_len, char_start, orig_len, cp); // Copying the original character
     }
-    temp_buffer[temp_w_idx] = '\0'; // Null-termination
-
-    // Second pass: remove extra spaces and line breaks
-    char *processed_text = (char*)malloc(temp_w_idx + 1); // Buffer for the final text
-    if (!processed_text) {
-        log_message_format(appCtx, "Error: Failed to allocate processed_text in PreprocessText (Pass 2): %s", strerror(errno));
-        perror("Failed to allocate processed_text in PreprocessText (Pass 2)");
-        free(temp_buffer);
-        *out_final_text_len = 0;
-        return NULL;
-    }
-
-    size_t final_pt_idx = 0; // Write index in processed_text
-    const char* p2_read = temp_buffer;
-    const char* p2_read_end = temp_buffer + temp_w_idx;
-
-    int consecutive_newlines = 0;
-    bool last_char_output_was_space = true; // Start as if there was a space before the text (to avoid adding a space at the beginning)
-    bool content_has_started = false; // Has significant content started already (not spaces at the beginning)
-
-    // Skip leading spaces/line breaks
-    const char* p2_scan_lead = p2_read;
-    while(p2_scan_lead < p2_read_end) {
-        const char* peek_ptr_ws = p2_scan_lead;
-        Sint32 cp_peek_ws = decode_utf8(&peek_ptr_ws, p2_read_end);
-        if (cp_peek_ws == ' ' || cp_peek_ws == '\n' || cp_peek_ws == '\t') {
-            p2_scan_lead = peek_ptr_ws;
-        } else {
-            break;
+    return (size_t)(p - input);
+}
+
+size_t PreprocessFeed(PreprocessState *state, const char *input, size_t input_len, bool input_is_final,
+                      char *output, size_t output_len) {
+    if (!state || !output || (!input && input_len > 0)) return output_len;
+    if (!input) input = ""; // No input, only input_is_final: still resolves the carry
+
+    // Finish the tail held back from the previous input together with the first bytes of this one
+    if (state->carry_len > 0) {
+        char joined[2 * sizeof(state->carry)];
+        size_t take_len = sizeof(joined) - state->carry_len;
+        if (take_len > input_len) take_len = input_len;
+        memcpy(joined, state->carry, state->carry_len);
+        memcpy(joined + state->carry_len, input, take_len);
+        size_t joined_len = state->carry_len + take_len;
+        size_t consumed = preprocess_run(state, joined, joined_len, input_is_final && take_len == input_len, output, &output_len);
+        // Only the last few bytes can be held back, so this either resolves the carry or takes all of the input
+        if (consumed < state->carry_len || take_len == input_len) {
+            state->carry_len = joined_len - consumed;
+            memmove(state->carry, joined + consumed, state->carry_len);
+            return output_len;
         }
+        input += consumed - state->carry_len;
+        input_len -= consumed - state->carry_len;
+        state->carry_len = 0;
+    }
+
+    size_t consumed = preprocess_run(state, input, input_len, input_is_final, output, &output_len);
+    state->carry_len = input_len - consumed; // Shorter than the longest rule, or a truncated UTF-8 sequence
+    memcpy(state->carry, input + consumed, state->carry_len);
+    return output_len;
+}
+
+size_t PreprocessFinish(PreprocessState *state, char *output, size_t output_len) {
+    if (!state || !output) return output_len;
+    if (state->carry_len > 0) { // Input ended with a possible rule match or a truncated sequence
+        char carry[sizeof(state->carry)];
+        size_t carry_len = state->carry_len;
+        memcpy(carry, state->carry, carry_len);
+        state->carry_len = 0;
+        preprocess_run(state, carry, carry_len, true, output, &output_len);
     }
-    p2_read = p2_scan_lead;
 
+    // Handling line breaks at the end of the text
+    if (state->consecutive_newlines > 0 && state->content_has_started) {
+        if (output_len > 0 && output[output_len - 1] == ' ') output_len--; // Remove space before the final line break
+        // If there was one line break at the end, it's ignored (like trailing spaces below)
+        state->consecutive_newlines = 0;
+    }
 
-    while(p2_read < p2_read_end) {
-        const char* char_start_pass2_original = p2_read;
-        Sint32 cp2 = decode_utf8(&p2_read, p2_read_end);
-        size_t char_len_pass2 = (size_t)(p2_read - char_start_pass2_original);
+    // Remove trailing spaces and line breaks
+    while (output_len > 0 && (output[output_len - 1] == ' ' || output[output_len - 1] == '\n')) output_len--;
+    return output_len;
+}
 
-        if(cp2 <= 0) { // Skip invalid or null characters
-            if (char_len_pass2 == 0 && p2_read < p2_read_end) p2_read++; // Manual advancement if decode_utf8 failed
+// Upper bound on how much the rules can make the text grow: the growth of the longest match at every
+// position, overlapping or not, so it holds however the preprocessor ends up aligning its matches
+static size_t count_rule_growth(const ReplacementRules *rules, const char *text, size_t text_len) {
+    if (!rules || rules->state_count == 0) return 0;
+    int growing_start_count = 0;
+    unsigned char growing_start_byte = 0;
+    for (int c = 0; c < 256; c++) {
+        if (rules->starts_growing_rule[c]) { growing_start_byte = (unsigned char)c; growing_start_count++; }
+    }
+    if (growing_start_count == 0) return 0;
+
+    size_t growth_len = 0;
+    const char *p = text, *end = text + text_len;
+    while (p < end) {
+        if (growing_start_count == 1) { // Typically only '-' of "--"
+            p = (const char*)memchr(p, growing_start_byte, (size_t)(end - p));
+            if (!p) break;
+        } else if (!rules->starts_growing_rule[(unsigned char)*p]) {
+            p++;
             continue;
         }
+        int rule_idx = ReplacementRulesMatch(rules, p, end, true);
+        if (rule_idx >= 0 && rules->rules[rule_idx].to_len > rules->rules[rule_idx].from_len) {
+            growth_len += (size_t)(rules->rules[rule_idx].to_len - rules->rules[rule_idx].from_len);
+        }
+        p++;
+    }
+    return growth_len;
+}
 
-        if (cp2 == '\n') {
-            consecutive_newlines++;
-        } else { // Not a line break
-            if (consecutive_newlines > 0) { // There were line breaks before this character
-                if (content_has_started) {
-                    // Remove space before the line break if it was there
-                    if (final_pt_idx > 0 && processed_text[final_pt_idx - 1] == ' ') {
-                        final_pt_idx--;
-                    }
-                    if (consecutive_newlines >= 2) { // Two or more line breaks -> one line break (new paragraph)
-                         if (final_pt_idx == 0 || (final_pt_idx > 0 && processed_text[final_pt_idx - 1] != '\n')) { // Avoid double line breaks
-                            if (final_pt_idx < temp_w_idx) processed_text[final_pt_idx++] = '\n'; else break;
-                         }
-                    } else { // One line break -> space (if text doesn't end with a space/line break)
-                        if (final_pt_idx > 0 && processed_text[final_pt_idx - 1] != ' ' && processed_text[final_pt_idx - 1] != '\n') {
-                            if (final_pt_idx < temp_w_idx) processed_text[final_pt_idx++] = ' '; else break;
-                        } else if (final_pt_idx == 0 && content_has_started ) { // If this is the first content character after line breaks
-                            // do not add a space at the beginning
-                        }
-                    }
-                }
-                last_char_output_was_space = true; // After processing line breaks, assume there was a space
-            }
-            consecutive_newlines = 0;
+// A piece of the input that is preprocessed on its own thread; see split_at_paragraph_breaks
+typedef struct {
+    const char *input;
+    size_t input_len;
+    PreprocessState state;       // The caller's for the first piece, a fresh one for the others
+    bool more_input_follows;     // First and last piece: the text goes on, so they are not finished
+    char *output;                // Where its output goes
+    size_t output_len;           // Starts at the length of what is already there
+} PreprocessChunk;
+
+// Cutting right after two line breaks ("\n\n", "\n\r\n" or "\r\n\r\n") leaves no carry (no rule matches a line
+// break) and a pending paragraph break, so the next piece can start from a fresh state: its leading whitespace
+// would have been absorbed by that break anyway, and the break itself comes back as the single '\n' placed
+// between non-empty outputs.
+static bool is_paragraph_cut(const char *text, size_t cut) {
+    if (cut < 2 || text[cut - 1] != '\n') return false;
+    return text[cut - 2] == '\n' || (cut >= 3 && text[cut - 2] == '\r' && text[cut - 3] == '\n');
+}
 
-            if (cp2 == ' ' || cp2 == '\t') { // Current character is a space or tab
-                if (content_has_started && !last_char_output_was_space) { // Add one space if the previous one was not a space
-                    if (final_pt_idx < temp_w_idx) processed_text[final_pt_idx++] = ' '; else break;
-                }
-                last_char_output_was_space = true;
-            } else { // Current character is not a space/tab/line break
-                // Copy the character
-                if (final_pt_idx + char_len_pass2 <= temp_w_idx) { // Check for overflow
-                    memcpy(processed_text + final_pt_idx, char_start_pass2_original, char_len_pass2);
-                    final_pt_idx += char_len_pass2;
-                } else break;
-                last_char_output_was_space = false;
-                content_has_started = true; // Mark that text has started
-            }
+static int split_at_paragraph_breaks(const char *text, size_t text_len, int max_chunks, PreprocessChunk *chunks) {
+    int chunk_count = 0;
+    size_t chunk_start = 0;
+    for (int chunk_idx = 1; chunk_idx < max_chunks; chunk_idx++) {
+        size_t cut = text_len / (size_t)max_chunks * (size_t)chunk_idx;
+        if (cut <= chunk_start) continue;
+        // First paragraph break at or after the even split point
+        const char *newline = text + cut - 1;
+        while ((newline = (const char*)memchr(newline, '\n', (size_t)(text + text_len - newline))) != NULL &&
+               !is_paragraph_cut(text, (size_t)(newline - text) + 1)) {
+            newline++;
         }
+        if (!newline) break; // No break left; the rest is one chunk
+        cut = (size_t)(newline - text) + 1;
+        if (cut >= text_len) break;
+        chunks[chunk_count++] = (PreprocessChunk){.input = text + chunk_start, .input_len = cut - chunk_start};
+        chunk_start = cut;
     }
+    chunks[chunk_count++] = (PreprocessChunk){.input = text + chunk_start, .input_len = text_len - chunk_start};
+    return chunk_count;
+}
 
-    // Handling line breaks at the end of the text
-    if (consecutive_newlines > 0 && content_has_started) {
-        if (final_pt_idx > 0 && processed_text[final_pt_idx - 1] == ' ') final_pt_idx--; // Remove space before the final line break
-        if (consecutive_newlines >= 2) { // If the text ended with >=2 line breaks
-             if (final_pt_idx == 0 || (final_pt_idx > 0 && processed_text[final_pt_idx - 1] != '\n')) {
-                if (final_pt_idx < temp_w_idx) processed_text[final_pt_idx++] = '\n';
-             }
+static void preprocess_chunk(PreprocessChunk *chunk) {
+    chunk->output_len = PreprocessFeed(&chunk->state, chunk->input, chunk->input_len, !chunk->more_input_follows,
+                                       chunk->output, chunk->output_len);
+    if (!chunk->more_input_follows) chunk->output_len = PreprocessFinish(&chunk->state, chunk->output, chunk->output_len);
+}
+
+static int preprocess_chunk_thread(void *data) {
+    preprocess_chunk((PreprocessChunk*)data);
+    return 0;
+}
+
+// Number of pieces to process in parallel: one per CPU, but none smaller than PREPROCESS_PARALLEL_MIN_BYTES
+static int preprocess_chunk_budget(size_t text_len) {
+    int cpu_count = SDL_GetCPUCount();
+    if (cpu_count < PREPROCESS_MIN_THREADS) cpu_count = PREPROCESS_MIN_THREADS;
+    size_t by_size = text_len / PREPROCESS_PARALLEL_MIN_BYTES;
+    int budget = cpu_count < PREPROCESS_MAX_CHUNKS ? cpu_count : PREPROCESS_MAX_CHUNKS;
+    if ((size_t)budget > by_size) budget = (int)by_size;
+    return budget > 1 ? budget : 1;
+}
+
+size_t PreprocessFeedParallel(AppContext *appCtx, PreprocessState *state, const char *input, size_t input_len,
+                              char *output, size_t output_len) {
+    PreprocessChunk chunks[PREPROCESS_MAX_CHUNKS];
+    int chunk_count = 1;
+    if (state && input && output) chunk_count = split_at_paragraph_breaks(input, input_len, preprocess_chunk_budget(input_len), chunks);
+    if (chunk_count < 2) return PreprocessFeed(state, input, input_len, false, output, output_len);
+
+    // The first piece continues the output in place; the others are written to a scratch buffer (each at most
+    // as long as its input plus the growth of the replacements in it) and copied behind it afterwards
+    size_t scratch_len = 0;
+    for (int chunk_idx = 1; chunk_idx < chunk_count; chunk_idx++) {
+        scratch_len += chunks[chunk_idx].input_len + count_rule_growth(state->rules, chunks[chunk_idx].input, chunks[chunk_idx].input_len);
+    }
+    char *scratch = (char*)malloc(scratch_len);
+    if (!scratch) {
+        log_message_format(appCtx, "Warning: Failed to allocate %zu bytes to preprocess in parallel; using one thread: %s", scratch_len, strerror(errno));
+        return PreprocessFeed(state, input, input_len, false, output, output_len);
+    }
+    chunks[0].state = *state;
+    chunks[0].more_input_follows = true;
+    chunks[0].output = output;
+    chunks[0].output_len = output_len;
+    size_t scratch_used_len = 0;
+    for (int chunk_idx = 1; chunk_idx < chunk_count; chunk_idx++) {
+        PreprocessChunk *chunk = &chunks[chunk_idx];
+        PreprocessStateInit(&chunk->state);
+        chunk->state.input_is_valid_utf8 = state->input_is_valid_utf8; // Pieces are cut after '\n', so each one is valid too
+        chunk->state.rules = state->rules;
+        chunk->more_input_follows = (chunk_idx == chunk_count - 1);
+        chunk->output = scratch + scratch_used_len;
+        scratch_used_len += chunk->input_len + count_rule_growth(state->rules, chunk->input, chunk->input_len);
+    }
+
+    // Chunk 0 runs on this thread; a chunk whose thread can't be started runs here afterwards
+    SDL_Thread *chunk_threads[PREPROCESS_MAX_CHUNKS] = {NULL};
+    for (int chunk_idx = 1; chunk_idx < chunk_count; chunk_idx++) {
+        chunk_threads[chunk_idx] = SDL_CreateThread(preprocess_chunk_thread, "preprocess", &chunks[chunk_idx]);
+        if (!chunk_threads[chunk_idx]) log_message_format(appCtx, "Warning: SDL_CreateThread failed in PreprocessFeedParallel: %s", SDL_GetError());
+    }
+    preprocess_chunk(&chunks[0]);
+    for (int chunk_idx = 1; chunk_idx < chunk_count; chunk_idx++) {
+        if (chunk_threads[chunk_idx]) SDL_WaitThread(chunk_threads[chunk_idx], NULL);
+        else preprocess_chunk(&chunks[chunk_idx]);
+    }
+
+    // Stitch the outputs together, with one '\n' for each paragraph break that separated them, written as
+    // preprocess_emit_char would have: in place of a space before it, and only once
+    output_len = chunks[0].output_len;
+    bool content_has_started = chunks[0].state.content_has_started;
+    for (int chunk_idx = 1; chunk_idx < chunk_count; chunk_idx++) {
+        PreprocessChunk *chunk = &chunks[chunk_idx];
+        if (chunk->output_len == 0) continue;
+        if (content_has_started) {
+            if (output_len > 0 && output[output_len - 1] == ' ') output_len--;
+            if (output_len == 0 || output[output_len - 1] != '\n') output[output_len++] = '\n';
         }
-        // If there was one line break at the end, it's ignored (like trailing spaces below)
+        memcpy(output + output_len, chunk->output, chunk->output_len);
+        output_len += chunk->output_len;
+        content_has_started = true;
     }
+    free(scratch);
+
+    // The last piece leaves the state for the next input. If it was all whitespace, the paragraph break
+    // before it is still pending behind the text so far.
+    *state = chunks[chunk_count - 1].state;
+    if (content_has_started && !state->content_has_started) {
+        state->content_has_started = true;
+        if (state->consecutive_newlines < 2) state->consecutive_newlines = 2;
+    }
+    return output_len;
+}
 
-    // Remove trailing spaces and line breaks
-    while (final_pt_idx > 0 && (processed_text[final_pt_idx-1] == ' ' || processed_text[final_pt_idx-1] == '\n')) {
-        final_pt_idx--;
-    }
-    processed_text[final_pt_idx] = '\0';
-    *out_final_text_len = final_pt_idx;
-
-    free(temp_buffer); // Free the temporary buffer
-
-    // Optimize the size of the final buffer
-    char* final_text = (char*)realloc(processed_text, final_pt_idx + 1);
-    if (!final_text && final_pt_idx > 0) { // If realloc failed, but there is data
-        log_message_format(appCtx, "Warning: realloc failed for final_text, returning original buffer. Length: %zu", final_pt_idx);
-        return processed_text; // Return the previous buffer
-    }
-    if (!final_text && final_pt_idx == 0 && processed_text != NULL) { // If realloc failed and the text is empty
-        free(processed_text); // processed_text definitely exists if we are here
-        final_text = (char*)malloc(1); // Create an empty string
-        if(final_text) final_text[0] = '\0';
-        else { log_message(appCtx, "Error: malloc for empty final_text failed after realloc failure."); }
-        return final_text;
-    }
-    // If final_text == NULL and processed_text was also NULL (unlikely, but possible if malloc for processed_text failed)
-    // or if realloc returned NULL for an empty string (final_pt_idx == 0)
-    // Return final_text (which can be NULL, or a pointer to a new buffer, or the same processed_text)
-    return final_text ? final_text : processed_text; // realloc might return the same pointer
+#define GLYPH_METRICS_FAILED -1 // Advance of a cache entry for a codepoint TTF_GlyphMetrics32 has no metrics for
+
+static size_t glyph_metrics_slot_for(Uint32 codepoint, size_t capacity) {
+    // Fibonacci hashing spreads consecutive codepoints (one script block) across the table
+    return (size_t)((codepoint * 2654435769u) & (Uint32)(capacity - 1));
+}
+
+static const GlyphMetrics* glyph_metrics_cache_lookup(GlyphMetricsCache *cache, Uint32 codepoint) {
+    if (cache->capacity == 0) return NULL;
+    size_t slot = glyph_metrics_slot_for(codepoint, cache->capacity);
+    while (cache->codepoints[slot] != 0) {
+        if (cache->codepoints[slot] == codepoint) return &cache->metrics[slot];
+        slot = (slot + 1) & (cache->capacity - 1);
+    }
+    return NULL;
+}
+
+static bool glyph_metrics_cache_grow(GlyphMetricsCache *cache) {
+    size_t new_capacity = cache->capacity ? cache->capacity * 2 : GLYPH_METRICS_CACHE_INITIAL_CAPACITY;
+    Uint32 *new_codepoints = (Uint32*)calloc(new_capacity, sizeof(Uint32));
+    GlyphMetrics *new_metrics = (GlyphMetrics*)malloc(new_capacity * sizeof(GlyphMetrics));
+    if (!new_codepoints || !new_metrics) {
+        free(new_codepoints);
+        free(new_metrics);
+        return false;
+    }
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (cache->codepoints[i] == 0) continue;
+        size_t slot = glyph_metrics_slot_for(cache->codepoints[i], new_capacity);
+        while (new_codepoints[slot] != 0) slot = (slot + 1) & (new_capacity - 1);
+        new_codepoints[slot] = cache->codepoints[i];
+        new_metrics[slot] = cache->metrics[i];
+    }
+    free(cache->codepoints);
+    free(cache->metrics);
+    cache->codepoints = new_codepoints;
+    cache->metrics = new_metrics;
+    cache->capacity = new_capacity;
+    return true;
+}
+
+static void glyph_metrics_cache_insert(GlyphMetricsCache *cache, Uint32 codepoint, GlyphMetrics metrics) {
+    // Keep the load factor under 70% so probe chains stay short
+    if ((cache->count + 1) * 10 > cache->capacity * 7) {
+        if (!glyph_metrics_cache_grow(cache)) return; // Not cached; the next call just asks the font again
+    }
+    size_t slot = glyph_metrics_slot_for(codepoint, cache->capacity);
+    while (cache->codepoints[slot] != 0 && cache->codepoints[slot] != codepoint) slot = (slot + 1) & (cache->capacity - 1);
+    if (cache->codepoints[slot] == 0) cache->count++;
+    cache->codepoints[slot] = codepoint;
+    cache->metrics[slot] = metrics;
 }
 
+void GlyphMetricsCacheFree(GlyphMetricsCache *cache) {
+    if (!cache) return;
+    free(cache->codepoints);
+    free(cache->metrics);
+    memset(cache, 0, sizeof(GlyphMetricsCache));
+}
 
 int get_codepoint_advance_and_metrics_func(AppContext *appCtx, Uint32 codepoint, int fallback_adv_logical, int *out_char_w_logical, int *out_char_h_logical) {
     int final_adv_logical;
     int char_w_val_logical = 0;
     int char_h_val_logical = 0;
+    bool metrics_from_font = false; // Values came from TTF_GlyphMetrics32 and can be cached
+    bool metrics_failed = false;    // The cache knows TTF_GlyphMetrics32 fails for this codepoint
 
     if (!appCtx || !appCtx->font) {
         if (out_char_w_logical) *out_char_w_logical = fallback_adv_logical > 0 ? fallback_adv_logical : 1;
@@ -256,9 +479,10 @@ int get_codepoint_advance_and_metrics_func(AppContext *appCtx, Uint32 codepoint,
 
 
     if (codepoint < 128 && codepoint >= 32) { // ASCII from cache
-        final_adv_logical = appCtx->glyph_adv_cache[codepoint];
-        char_w_val_logical = appCtx->glyph_w_cache[COL_TEXT][codepoint];
-        char_h_val_logical = appCtx->glyph_h_cache[COL_TEXT][codepoint];
+        const GlyphMetrics *ascii_metrics = &appCtx->glyph_metrics[codepoint];
+        final_adv_logical = ascii_metrics->advance;
+        char_w_val_logical = ascii_metrics->w;
+        char_h_val_logical = ascii_metrics->h;
     } else {
         if (codepoint == '\t') {
             // For tabulation, the width is calculated dynamically in get_next_text_block_func.
@@ -271,12 +495,29 @@ int get_codepoint_advance_and_metrics_func(AppContext *appCtx, Uint32 codepoint,
             char_w_val_logical = 0;
             char_h_val_logical = base_logical_h;
         } else { // Other non-cached characters
+            if (codepoint >= 32) { // Printable: try the metrics cache before asking the font
+                const GlyphMetrics *cached_metrics = glyph_metrics_cache_lookup(&appCtx->glyph_metrics_cache, codepoint);
+                if (cached_metrics && cached_metrics->advance != GLYPH_METRICS_FAILED) {
+                    appCtx->glyph_metrics_cache.hits++;
+                    if (out_char_w_logical) *out_char_w_logical = cached_metrics->w;
+                    if (out_char_h_logical) *out_char_h_logical = cached_metrics->h;
+                    return cached_metrics->advance;
+                }
+                if (cached_metrics) appCtx->glyph_metrics_cache.hits++; // Known to fail: the font is not asked again
+                else appCtx->glyph_metrics_cache.misses++;
+                metrics_failed = (cached_metrics != NULL);
+            }
+
             int scaled_adv_px_otf, scaled_min_x_otf, scaled_max_x_otf, scaled_min_y_otf, scaled_max_y_otf;
             // TTF_GlyphMetrics32 returns values in pixels for the loaded (DPI-aware) font
-            if (TTF_GlyphMetrics32(appCtx->font, codepoint, &scaled_min_x_otf, &scaled_max_x_otf, &scaled_min_y_otf, &scaled_max_y_otf, &scaled_adv_px_otf) != 0) {
+            if (metrics_failed || TTF_GlyphMetrics32(appCtx->font, codepoint, &scaled_min_x_otf, &scaled_max_x_otf, &scaled_min_y_otf, &scaled_max_y_otf, &scaled_adv_px_otf) != 0) {
                 final_adv_logical = fallback_adv_logical;
                 char_w_val_logical = fallback_adv_logical; // Use fallback as logical
                 char_h_val_logical = base_logical_h;     // Use base logical height
+                if (codepoint >= 32 && !metrics_failed) {
+                    // Only the failure is cached: the fallback depends on the caller
+                    glyph_metrics_cache_insert(&appCtx->glyph_metrics_cache, codepoint, (GlyphMetrics){GLYPH_METRICS_FAILED, 0, 0});
+                }
             } else {
                 final_adv_logical = (appCtx->scale_x_factor > 0.01f) ? (int)roundf((float)scaled_adv_px_otf / appCtx->scale_x_factor) : scaled_adv_px_otf;
 
@@ -289,6 +530,7 @@ int get_codepoint_advance_and_metrics_func(AppContext *appCtx, Uint32 codepoint,
 
                 // For character height, it's generally safer to use the logical line height.
                 char_h_val_logical = base_logical_h;
+                metrics_from_font = true;
             }
         }
     }
@@ -300,6 +542,10 @@ int get_codepoint_advance_and_metrics_func(AppContext *appCtx, Uint32 codepoint,
         if (char_h_val_logical <= 0) char_h_val_logical = base_logical_h;
     }
 
+    if (metrics_from_font && codepoint >= 32) {
+        glyph_metrics_cache_insert(&appCtx->glyph_metrics_cache, codepoint,
+                                   (GlyphMetrics){final_adv_logical, char_w_val_logical, char_h_val_logical});
+    }
 
     if (out_char_w_logical) *out_char_w_logical = char_w_val_logical;
     if (out_char_h_logical) *out_char_h_logical = char_h_val_logical;
@@ -308,6 +554,109 @@ int get_codepoint_advance_and_metrics_func(AppContext *appCtx, Uint32 codepoint,
 }
 
 
+static Uint32 word_width_hash(const char *word, size_t word_len) {
+    Uint32 hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < word_len; i++) {
+        hash ^= (unsigned char)word[i];
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1; // 0 marks an empty slot
+}
+
+static bool word_width_cache_grow(WordWidthCache *cache) {
+    size_t new_capacity = cache->capacity ? cache->capacity * 2 : WORD_WIDTH_CACHE_INITIAL_CAPACITY;
+    if (new_capacity > WORD_WIDTH_CACHE_MAX_CAPACITY) return false;
+    WordWidthEntry *new_entries = (WordWidthEntry*)calloc(new_capacity, sizeof(WordWidthEntry));
+    if (!new_entries) return false;
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i].hash == 0) continue;
+        size_t slot = cache->entries[i].hash & (new_capacity - 1);
+        while (new_entries[slot].hash != 0) slot = (slot + 1) & (new_capacity - 1);
+        new_entries[slot] = cache->entries[i];
+    }
+    free(cache->entries);
+    cache->entries = new_entries;
+    cache->capacity = new_capacity;
+    return true;
+}
+
+// Sum of the advances of the characters of a word; printable ASCII is read straight from the metrics cache
+static int measure_word_width(AppContext *appCtx, const char *word, const char *word_end) {
+    int width = 0;
+    while (word < word_end) {
+        unsigned char c = (unsigned char)*word;
+        if (c >= 32 && c < 128 && appCtx->glyph_metrics[c].advance > 0) {
+            width += appCtx->glyph_metrics[c].advance;
+            word++;
+            continue;
+        }
+        Sint32 cp = decode_utf8_unchecked(&word, word_end);
+        if (cp <= 0) break;
+        width += get_codepoint_advance_and_metrics_func(appCtx, (Uint32)cp, appCtx->space_advance_width, NULL, NULL);
+    }
+    return width;
+}
+
+// Width of a word, from the word width cache if the same bytes were measured before
+static int cached_word_width(AppContext *appCtx, const char *word, size_t word_len) {
+    if (word_len > WORD_WIDTH_CACHE_MAX_WORD_BYTES) return measure_word_width(appCtx, word, word + word_len);
+
+    WordWidthCache *cache = &appCtx->word_width_cache;
+    Uint32 hash = word_width_hash(word, word_len);
+    size_t slot = 0;
+    if (cache->capacity > 0) {
+        slot = hash & (cache->capacity - 1);
+        while (cache->entries[slot].hash != 0) {
+            const WordWidthEntry *entry = &cache->entries[slot];
+            if (entry->hash == hash && entry->len == word_len && memcmp(entry->bytes, word, word_len) == 0) {
+                cache->hits++;
+                return entry->width;
+            }
+            slot = (slot + 1) & (cache->capacity - 1);
+        }
+    }
+    cache->misses++;
+    int width = measure_word_width(appCtx, word, word + word_len);
+
+    // Keep the load factor under 70% so probe chains stay short; once the cache is full, words are just measured
+    if ((cache->count + 1) * 10 > cache->capacity * 7) {
+        if (!word_width_cache_grow(cache)) return width;
+        slot = hash & (cache->capacity - 1);
+        while (cache->entries[slot].hash != 0) slot = (slot + 1) & (cache->capacity - 1);
+    }
+    WordWidthEntry *entry = &cache->entries[slot];
+    entry->hash = hash;
+    entry->width = width;
+    entry->len = (Uint8)word_len;
+    memcpy(entry->bytes, word, word_len);
+    cache->count++;
+    return width;
+}
+
+// Width of a word in a fixed-width font: its character count times the advance when all of its glyphs have that
+// advance (printable ASCII was checked by InitializeApp; other characters are looked up here, once per block)
+static int monospace_word_width(AppContext *appCtx, const char *word, size_t word_len, bool *out_is_monospace) {
+    size_t ascii_len = ScanAsciiRun(word, word + word_len, ' ', ' ');
+    int width = (int)ascii_len * appCtx->monospace_advance;
+    bool is_monospace = true;
+    const char *p_char = word + ascii_len;
+    while (p_char < word + word_len) {
+        Sint32 cp = decode_utf8_unchecked(&p_char, word + word_len);
+        if (cp <= 0) break;
+        int advance = get_codepoint_advance_and_metrics_func(appCtx, (Uint32)cp, appCtx->space_advance_width, NULL, NULL);
+        if (advance != appCtx->monospace_advance) is_monospace = false;
+        width += advance;
+    }
+    *out_is_monospace = is_monospace;
+    return width;
+}
+
+void WordWidthCacheFree(WordWidthCache *cache) {
+    if (!cache) return;
+    free(cache->entries);
+    memset(cache, 0, sizeof(WordWidthCache));
+}
+
 TextBlockInfo get_next_text_block_func(AppContext *appCtx, const char **text_parser_ptr_ref, const char *text_end, int current_pen_x_for_tab_calc) {
     TextBlockInfo block = {0};
     if (!text_parser_ptr_ref || !*text_parser_ptr_ref || *text_parser_ptr_ref >= text_end || !appCtx || !appCtx->font) {
@@ -318,7 +667,7 @@ TextBlockInfo get_next_text_block_func(AppContext *appCtx, const char **text_par
     const char *p_initial_for_block = *text_parser_ptr_ref; // Initial position for this call
     const char *temp_scanner = *text_parser_ptr_ref; // Temporary scanner for the first character
 
-    Sint32 first_cp_in_block = decode_utf8(&temp_scanner, text_end);
+    Sint32 first_cp_in_block = decode_utf8_unchecked(&temp_scanner, text_end);
 
     if (first_cp_in_block <= 0) { // Error or end of line at the very beginning
         // Advance the main pointer if temp_scanner advanced or if it's just an invalid byte
@@ -334,11 +683,11 @@ TextBlockInfo get_next_text_block_func(AppContext *appCtx, const char **text_par
     // Handling special characters
     if (first_cp_in_block == '\n') {
         block.is_newline = true;
-        decode_utf8(text_parser_ptr_ref, text_end); // Advance the main pointer
+        decode_utf8_unchecked(text_parser_ptr_ref, text_end); // Advance the main pointer
         block.pixel_width = 0;
     } else if (first_cp_in_block == '\t') {
         block.is_tab = true;
-        decode_utf8(text_parser_ptr_ref, text_end); // Advance the main pointer
+        decode_utf8_unchecked(text_parser_ptr_ref, text_end); // Advance the main pointer
         if (appCtx->tab_width_pixels > 0) {
             int offset_in_line = current_pen_x_for_tab_calc - TEXT_AREA_X;
             block.pixel_width = appCtx->tab_width_pixels - (offset_in_line % appCtx->tab_width_pixels);
@@ -349,29 +698,22 @@ TextBlockInfo get_next_text_block_func(AppContext *appCtx, const char **text_par
              // Fallback logic if tab_width_pixels is not initialized (unlikely)
             block.pixel_width = appCtx->space_advance_width * TAB_SIZE_IN_SPACES;
         }
-    } else {
-        // Handling words or sequences of spaces
-        bool first_char_was_space = (first_cp_in_block == ' ');
-        block.is_word = !first_char_was_space; // If not a space, then it's a word
-
-        // *text_parser_ptr_ref is still at the beginning of the block here. Start advancing it.
-        while(*text_parser_ptr_ref < text_end) {
-            const char* peek_ptr = *text_parser_ptr_ref; // "Peek" ahead
-            Sint32 cp = decode_utf8(&peek_ptr, text_end);
-
-            if (cp <= 0 || cp == '\n' || cp == '\t') { // End of block on error, \n or \t
-                break;
-            }
-
-            bool current_char_is_space = (cp == ' ');
-            if (current_char_is_space != first_char_was_space) { // Change of character type (word/space)
-                break;
-            }
-
-            // If all is well, advance the main pointer and add the width
-            *text_parser_ptr_ref = peek_ptr;
-            block.pixel_width += get_codepoint_advance_and_metrics_func(appCtx, (Uint32)cp, appCtx->space_advance_width, NULL, NULL);
+    } else if (first_cp_in_block != ' ') {
+        // Handling words: found with a vector scan for the bytes that end them
+        block.is_word = true;
+        size_t word_len = ScanBlockRun(block.start_ptr, text_end, false);
+        if (appCtx->monospace_advance > 0) {
+            block.pixel_width = monospace_word_width(appCtx, block.start_ptr, word_len, &block.is_monospace);
+        } else {
+            block.pixel_width = cached_word_width(appCtx, block.start_ptr, word_len);
         }
+        *text_parser_ptr_ref = block.start_ptr + word_len;
+    } else {
+        // Handling sequences of spaces
+        size_t space_count = ScanBlockRun(block.start_ptr, text_end, true);
+        block.pixel_width = (int)space_count * get_codepoint_advance_and_metrics_func(appCtx, ' ', appCtx->space_advance_width, NULL, NULL);
+        *text_parser_ptr_ref = block.start_ptr + space_count;
+        block.is_monospace = appCtx->monospace_advance > 0;
     }
     block.num_bytes = (size_t)(*text_parser_ptr_ref - block.start_ptr);
     return block;
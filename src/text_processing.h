@@ -2,6 +2,8 @@
 #define TEXT_PROCESSING_H
 
 #include "app_context.h" // Needed for AppContext
+#include "utf8_utils.h"  // For decode_utf8_unchecked
+#include "config.h"      // For FONT_SIZE
 #include <stdbool.h>
 #include <stddef.h> // For size_t
 
@@ -13,12 +15,73 @@ typedef struct {
     bool is_word;          // Is the block a word
     bool is_newline;       // Is the block a newline character
     bool is_tab;           // Is the block a tab character
+    bool is_monospace;     // Every character advances by appCtx->monospace_advance (fixed-width font)
 } TextBlockInfo;
 
-char* PreprocessText(AppContext *appCtx, const char* raw_text_buffer, size_t raw_text_len, size_t* out_final_text_len);
+// State of the streaming preprocessor between pieces of input
+typedef struct {
+    int consecutive_newlines;        // Line breaks seen since the last output character
+    bool last_char_output_was_space; // Collapses runs of spaces/tabs to one space
+    bool content_has_started;        // Leading whitespace is dropped
+    bool input_is_valid_utf8;        // Set by the caller if the input passed ValidateUTF8 (skips decoder checks)
+    bool skip_next_lf;               // The previous input ended with '\r' (a following '\n' belongs to it)
+    const ReplacementRules *rules;   // Typographic replacements to apply, or NULL for none
+    char carry[REPLACEMENT_RULE_MAX_BYTES]; // Undecidable tail of the previous input: a possible rule match or a truncated UTF-8 sequence
+    size_t carry_len;
+} PreprocessState;
+
+void PreprocessStateInit(PreprocessState *state);
+// Appends the preprocessed form of input to output[output_len..] and returns the new output length.
+// Output only runs ahead of the input read so far by the growth of the rules applied (to_len - from_len,
+// by default one byte per "--"), so output may alias the input as long as it starts that many bytes earlier.
+// Set state->rules after PreprocessStateInit to apply replacements.
+size_t PreprocessFeed(PreprocessState *state, const char *input, size_t input_len, bool input_is_final,
+                      char *output, size_t output_len);
+// Flushes the carry and trims trailing whitespace; returns the final length (no terminator is written)
+size_t PreprocessFinish(PreprocessState *state, char *output, size_t output_len);
+
+// Same as PreprocessFeed with more input to follow, but a large input is cut at paragraph breaks into pieces
+// that are preprocessed on their own threads (one per CPU, none smaller than PREPROCESS_PARALLEL_MIN_BYTES).
+// The output is the same, but here it must not overlap the input.
+size_t PreprocessFeedParallel(AppContext *appCtx, PreprocessState *state, const char *input, size_t input_len,
+                              char *output, size_t output_len);
+
+// Releases the non-ASCII glyph metrics cache (e.g. on cleanup or when the font changes)
+void GlyphMetricsCacheFree(GlyphMetricsCache *cache);
+// Releases the word width cache (e.g. on cleanup or when the font changes)
+void WordWidthCacheFree(WordWidthCache *cache);
 
 int get_codepoint_advance_and_metrics_func(AppContext *appCtx, Uint32 codepoint, int fallback_adv, int *out_char_w, int *out_char_h);
 
+// Per-character loops of layout and rendering are written once with a constant ascii_text parameter and called
+// with true when appCtx->text_is_ascii, false otherwise; forced inlining gives each call its own specialized copy
+#if defined(__GNUC__) || defined(__clang__)
+#define TEXT_LOOP_SPECIALIZED static inline __attribute__((always_inline))
+#else
+#define TEXT_LOOP_SPECIALIZED static inline
+#endif
+
+// Next character of the text for such a loop: in ASCII text the byte itself, otherwise decoded (0 at the end)
+TEXT_LOOP_SPECIALIZED Sint32 next_text_char(const char **p, const char *end, bool ascii_text) {
+    if (ascii_text) return *p < end ? (unsigned char)*(*p)++ : 0;
+    return decode_utf8_unchecked(p, end);
+}
+
+// Same as get_codepoint_advance_and_metrics_func with the space advance as fallback; in ASCII text a printable
+// character is read straight from appCtx->glyph_metrics, with the same minimums
+TEXT_LOOP_SPECIALIZED int text_char_advance_and_metrics(AppContext *appCtx, Sint32 codepoint, int *out_char_w, int *out_char_h,
+                                                        bool ascii_text) {
+    if (ascii_text && codepoint >= 32 && codepoint < 128 && appCtx->font) {
+        const GlyphMetrics *ascii_metrics = &appCtx->glyph_metrics[codepoint];
+        int advance = ascii_metrics->advance;
+        if (advance <= 0) advance = appCtx->space_advance_width > 0 ? appCtx->space_advance_width : 1;
+        if (out_char_w) *out_char_w = ascii_metrics->w > 0 ? ascii_metrics->w : advance;
+        if (out_char_h) *out_char_h = ascii_metrics->h > 0 ? ascii_metrics->h : (appCtx->line_h > 0 ? appCtx->line_h : (FONT_SIZE > 0 ? FONT_SIZE : 1));
+        return advance;
+    }
+    return get_codepoint_advance_and_metrics_func(appCtx, (Uint32)codepoint, appCtx->space_advance_width, out_char_w, out_char_h);
+}
+
 TextBlockInfo get_next_text_block_func(AppContext *appCtx, const char **text_parser_ptr_ref, const char *text_end, int current_pen_x_for_tab_calc);
 
 #endif // TEXT_PROCESSING_H
\ No newline at end of file
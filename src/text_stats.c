@@ -0,0 +1,142 @@
+#include "text_stats.h"
+#include <string.h> // For memcpy, memset
+
+// Every 64-byte block is turned into three bitmasks (bit i = byte i): non-continuation bytes, separators
+// (' ', '\n', '\t') and newlines. Counting is then a few popcounts per block: codepoints are the set bits
+// of the first mask, and a word starts at every non-separator byte whose predecessor is a separator.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TEXT_STATS_POPCOUNT(mask) ((size_t)__builtin_popcountll((unsigned long long)(mask)))
+#define TEXT_STATS_CTZ(mask) ((size_t)__builtin_ctzll((unsigned long long)(mask)))
+#else
+static size_t text_stats_popcount(Uint64 mask) {
+    size_t bit_count = 0;
+    while (mask) { mask &= mask - 1; bit_count++; }
+    return bit_count;
+}
+static size_t text_stats_ctz(Uint64 mask) {
+    size_t bit_index = 0;
+    while (!(mask & 1)) { mask >>= 1; bit_index++; }
+    return bit_index;
+}
+#define TEXT_STATS_POPCOUNT(mask) text_stats_popcount(mask)
+#define TEXT_STATS_CTZ(mask) text_stats_ctz(mask)
+#endif
+
+typedef struct {
+    Uint64 non_continuation;
+    Uint64 separators;
+    Uint64 newlines;
+} BlockMasks;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+static BlockMasks block_masks(const char *block) {
+    const __m128i last_continuation = _mm_set1_epi8((char)0xBF); // Signed: continuation bytes are -128..-65
+    const __m128i space = _mm_set1_epi8(' '), newline = _mm_set1_epi8('\n'), tab = _mm_set1_epi8('\t');
+    BlockMasks masks = {0, 0, 0};
+    for (int part = 0; part < 4; part++) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(block + part * 16));
+        __m128i is_newline = _mm_cmpeq_epi8(bytes, newline);
+        __m128i is_separator = _mm_or_si128(is_newline, _mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab)));
+        int shift = part * 16;
+        masks.non_continuation |= (Uint64)(Uint32)_mm_movemask_epi8(_mm_cmpgt_epi8(bytes, last_continuation)) << shift;
+        masks.separators |= (Uint64)(Uint32)_mm_movemask_epi8(is_separator) << shift;
+        masks.newlines |= (Uint64)(Uint32)_mm_movemask_epi8(is_newline) << shift;
+    }
+    return masks;
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+
+// One bit per byte of four 16-byte compare results, by weighting the lanes and adding them pairwise
+static Uint64 neon_bitmask_64(uint8x16_t m0, uint8x16_t m1, uint8x16_t m2, uint8x16_t m3) {
+    const uint8x16_t bit_weights = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t sum01 = vpaddq_u8(vandq_u8(m0, bit_weights), vandq_u8(m1, bit_weights));
+    uint8x16_t sum23 = vpaddq_u8(vandq_u8(m2, bit_weights), vandq_u8(m3, bit_weights));
+    uint8x16_t sum = vpaddq_u8(sum01, sum23);
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+}
+
+static BlockMasks block_masks(const char *block) {
+    uint8x16_t non_continuation[4], separators[4], newlines[4];
+    for (int part = 0; part < 4; part++) {
+        uint8x16_t bytes = vld1q_u8((const uint8_t*)block + part * 16);
+        newlines[part] = vceqq_u8(bytes, vdupq_n_u8('\n'));
+        separators[part] = vorrq_u8(newlines[part], vorrq_u8(vceqq_u8(bytes, vdupq_n_u8(' ')), vceqq_u8(bytes, vdupq_n_u8('\t'))));
+        non_continuation[part] = vcgtq_s8(vreinterpretq_s8_u8(bytes), vdupq_n_s8((int8_t)0xBF));
+    }
+    BlockMasks masks;
+    masks.non_continuation = neon_bitmask_64(non_continuation[0], non_continuation[1], non_continuation[2], non_continuation[3]);
+    masks.separators = neon_bitmask_64(separators[0], separators[1], separators[2], separators[3]);
+    masks.newlines = neon_bitmask_64(newlines[0], newlines[1], newlines[2], newlines[3]);
+    return masks;
+}
+
+#else
+static BlockMasks block_masks(const char *block) {
+    BlockMasks masks = {0, 0, 0};
+    for (int i = 0; i < 64; i++) {
+        unsigned char c = (unsigned char)block[i];
+        masks.non_continuation |= (Uint64)((c & 0xC0) != 0x80) << i;
+        masks.separators |= (Uint64)(c == ' ' || c == '\n' || c == '\t') << i;
+        masks.newlines |= (Uint64)(c == '\n') << i;
+    }
+    return masks;
+}
+#endif
+
+void TextStatsScan(const char *text, size_t text_len, TextStats *stats,
+                   size_t *newline_offsets, size_t newline_offsets_capacity) {
+    if (!stats || !text || text_len == 0) return;
+    Uint64 prev_was_separator = stats->ends_in_word ? 0 : 1; // Bit 0 carried into the next block
+    char tail_block[64];
+
+    for (size_t block_start = 0; block_start < text_len; block_start += 64) {
+        size_t block_len = text_len - block_start;
+        const char *block = text + block_start;
+        Uint64 valid_bits = ~0ULL;
+        if (block_len < 64) { // Pad the tail; the padding bits are masked out below
+            memset(tail_block, 0, sizeof(tail_block));
+            memcpy(tail_block, block, block_len);
+            block = tail_block;
+            valid_bits = (1ULL << block_len) - 1;
+        }
+
+        BlockMasks masks = block_masks(block);
+        Uint64 separators = masks.separators & valid_bits;
+        Uint64 word_starts = ~masks.separators & valid_bits & ((masks.separators << 1) | prev_was_separator);
+        Uint64 newlines = masks.newlines & valid_bits;
+
+        stats->codepoint_count += TEXT_STATS_POPCOUNT(masks.non_continuation & valid_bits);
+        stats->word_count += TEXT_STATS_POPCOUNT(word_starts);
+        if (newlines) {
+            if (newline_offsets) {
+                for (Uint64 pending = newlines; pending; pending &= pending - 1) {
+                    if (stats->newline_count < newline_offsets_capacity) {
+                        newline_offsets[stats->newline_count] = stats->byte_count + block_start + TEXT_STATS_CTZ(pending);
+                    }
+                    stats->newline_count++;
+                }
+            } else {
+                stats->newline_count += TEXT_STATS_POPCOUNT(newlines);
+            }
+        }
+        prev_was_separator = (block_len < 64) ? (separators >> (block_len - 1)) & 1 : separators >> 63;
+    }
+
+    stats->byte_count += text_len;
+    stats->ends_in_word = !prev_was_separator;
+    stats->line_count = stats->newline_count + 1;
+}
+
+void TextStatsSyncPrefix(TextStats *stats, const char *buffer, size_t buffer_len) {
+    if (!stats) return;
+    if (buffer_len < stats->byte_count) memset(stats, 0, sizeof(TextStats));
+    if (buffer && buffer_len > stats->byte_count) {
+        TextStatsScan(buffer + stats->byte_count, buffer_len - stats->byte_count, stats, NULL, 0);
+    }
+}
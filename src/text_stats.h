@@ -0,0 +1,17 @@
+#ifndef TEXT_STATS_H
+#define TEXT_STATS_H
+
+#include "app_context.h" // For TextStats
+#include <stddef.h>      // For size_t
+
+// Adds the counts of [text, text + text_len) to *stats in one pass; a zeroed TextStats starts a new span.
+// If newline_offsets is given, the offset of each '\n' (counted from the start of the whole span) is stored
+// at newline_offsets[index of that newline] while the index is below newline_offsets_capacity.
+void TextStatsScan(const char *text, size_t text_len, TextStats *stats,
+                   size_t *newline_offsets, size_t newline_offsets_capacity);
+
+// Brings stats of a growing buffer up to buffer_len by scanning only the new bytes; if the buffer got
+// shorter the counts are rebuilt from the start.
+void TextStatsSyncPrefix(TextStats *stats, const char *buffer, size_t buffer_len);
+
+#endif // TEXT_STATS_H
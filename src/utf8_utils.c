@@ -1,65 +1,484 @@
 #include "utf8_utils.h"
+#include "text_stats.h" // For TextStatsScan
+#include <string.h>  // For memcpy
+#include <stdbool.h> // For bool
+
+// --- Strict decoding ---
+// Table-driven DFA after Bjoern Hoehrmann's "Flexible and Economical UTF-8 Decoder". The first 256 entries map
+// each byte to a character class, the rest map (state + class) to the next state. Overlong forms, surrogates
+// (U+D800..U+DFFF) and values above U+10FFFF all lead to UTF8_DFA_REJECT.
+#define UTF8_DFA_ACCEPT 0
+#define UTF8_DFA_REJECT 12
+
+static const Uint8 utf8_dfa_table[364] = {
+    // Byte classes: 00..7F
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    // 80..BF (continuation bytes, split by the ranges lead bytes restrict them to)
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+    7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7, 7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
+    // C0..FF (lead bytes; C0, C1 and F5..FF can never appear)
+    8,8,2,2,2,2,2,2,2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,
+    10,3,3,3,3,3,3,3,3,3,3,3,3,4,3,3, 11,6,6,6,5,8,8,8,8,8,8,8,8,8,8,8,
+    // Transitions
+    0,12,24,36,60,96,84,12,12,12,48,72, 12,12,12,12,12,12,12,12,12,12,12,12,
+    12,0,12,12,12,12,12,0,12,0,12,12, 12,24,12,12,12,12,12,24,12,24,12,12,
+    12,12,12,12,12,12,12,24,12,12,12,12, 12,24,12,12,12,12,12,12,12,24,12,12,
+    12,12,12,12,12,12,12,36,12,36,12,12, 12,36,12,12,12,12,12,36,12,36,12,12,
+    12,36,12,12,12,12,12,12,12,12,12,12,
+};
+
+static inline Uint32 utf8_dfa_step(Uint32 state, Uint32 *codepoint, unsigned char byte) {
+    Uint32 byte_class = utf8_dfa_table[byte];
+    *codepoint = (state != UTF8_DFA_ACCEPT) ? (byte & 0x3Fu) | (*codepoint << 6) : (0xFFu >> byte_class) & byte;
+    return utf8_dfa_table[256 + state + byte_class];
+}
 
 Sint32 decode_utf8(const char **s_ptr, const char *s_end_const_char) {
     if (!s_ptr || !*s_ptr || *s_ptr >= s_end_const_char) return 0; // End of string or invalid pointer
     const unsigned char *s = (const unsigned char *)*s_ptr;
     const unsigned char *s_end = (const unsigned char *)s_end_const_char;
-    unsigned char c1 = *s;
-    Sint32 codepoint;
-    int len = 0;
-
-    if (c1 < 0x80) { // 1-byte character (0xxxxxxx)
-        codepoint = c1;
-        len = 1;
-    } else if ((c1 & 0xE0) == 0xC0) { // 2-byte character (110xxxxx 10xxxxxx)
-        if (s + 1 >= s_end || (s[1] & 0xC0) != 0x80) return -1; // Invalid sequence
-        codepoint = ((Sint32)(c1 & 0x1F) << 6) | (Sint32)(s[1] & 0x3F);
-        len = 2;
-    } else if ((c1 & 0xF0) == 0xE0) { // 3-byte character (1110xxxx 10xxxxxx 10xxxxxx)
-        if (s + 2 >= s_end || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80) return -1;
-        codepoint = ((Sint32)(c1 & 0x0F) << 12) | ((Sint32)(s[1] & 0x3F) << 6) | (Sint32)(s[2] & 0x3F);
-        len = 3;
-    } else if ((c1 & 0xF8) == 0xF0) { // 4-byte character (11110xxx 10xxxxxx 10xxxxxx 10xxxxxx)
-        if (s + 3 >= s_end || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80) return -1;
-        codepoint = ((Sint32)(c1 & 0x07) << 18) | ((Sint32)(s[1] & 0x3F) << 12) | ((Sint32)(s[2] & 0x3F) << 6) | (Sint32)(s[3] & 0x3F);
-        len = 4;
-    } else { // Invalid starting byte
-        return -1;
-    }
-
-    (*s_ptr) += len; // Move the pointer to the next character
-    return codepoint;
+    if (*s < 0x80) { // 1-byte character, no table walk needed
+        (*s_ptr)++;
+        return *s;
+    }
+
+    Uint32 state = UTF8_DFA_ACCEPT, codepoint = 0;
+    for (const unsigned char *q = s; q < s_end; q++) {
+        state = utf8_dfa_step(state, &codepoint, *q);
+        if (state == UTF8_DFA_ACCEPT) {
+            *s_ptr = (const char *)(q + 1); // Move the pointer to the next character
+            return (Sint32)codepoint;
+        }
+        if (state == UTF8_DFA_REJECT) return -1; // Invalid sequence, pointer not advanced
+    }
+    return -1; // Sequence truncated by the end of the buffer
+}
+
+size_t encode_utf8(Uint32 codepoint, char *out) {
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
 }
 
 size_t CountUTF8Chars(const char* text, size_t text_byte_len) {
-    size_t char_count = 0;
-    const char* p = text;
-    const char* end = text + text_byte_len;
+    TextStats stats = {0};
+    TextStatsScan(text, text_byte_len, &stats, NULL, 0); // Counts non-continuation bytes 64 at a time
+    return stats.codepoint_count;
+}
+
+// --- ASCII run scanning ---
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ASCII_SCAN_CTZ(mask) ((size_t)__builtin_ctzll((unsigned long long)(mask)))
+#else
+static size_t ascii_scan_ctz(Uint64 mask) {
+    size_t bit_index = 0;
+    while (!(mask & 1)) { mask >>= 1; bit_index++; }
+    return bit_index;
+}
+#define ASCII_SCAN_CTZ(mask) ascii_scan_ctz(mask)
+#endif
+
+static bool is_ascii_run_byte(unsigned char c, char stop_a, char stop_b) {
+    return c >= 0x20 && c < 0x80 && c != (unsigned char)stop_a && c != (unsigned char)stop_b;
+}
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASCII_SCAN_SSE2 1
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ASCII_SCAN_AVX2 1
+
+// Compiled for AVX2 regardless of the global flags; only called after a runtime CPU check
+__attribute__((target("avx2")))
+static size_t scan_ascii_run_avx2(const char *p, const char *end, char stop_a, char stop_b) {
+    const char *start = p;
+    const __m256i stop_a_vec = _mm256_set1_epi8(stop_a), stop_b_vec = _mm256_set1_epi8(stop_b);
+    const __m256i first_printable = _mm256_set1_epi8(0x20);
+    while (end - p >= 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)p);
+        // Signed compare: control bytes and bytes >= 0x80 (negative) are both below 0x20
+        __m256i hits = _mm256_or_si256(_mm256_cmpgt_epi8(first_printable, bytes),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(bytes, stop_a_vec), _mm256_cmpeq_epi8(bytes, stop_b_vec)));
+        Uint32 mask = (Uint32)_mm256_movemask_epi8(hits);
+        if (mask) return (size_t)(p - start) + ASCII_SCAN_CTZ(mask);
+        p += 32;
+    }
+    return (size_t)(p - start);
+}
+#endif
+
+static size_t scan_ascii_run_sse2(const char *p, const char *end, char stop_a, char stop_b) {
+    const char *start = p;
+    const __m128i stop_a_vec = _mm_set1_epi8(stop_a), stop_b_vec = _mm_set1_epi8(stop_b);
+    const __m128i first_printable = _mm_set1_epi8(0x20);
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+        __m128i hits = _mm_or_si128(_mm_cmplt_epi8(bytes, first_printable), // Signed: also catches bytes >= 0x80
+                                    _mm_or_si128(_mm_cmpeq_epi8(bytes, stop_a_vec), _mm_cmpeq_epi8(bytes, stop_b_vec)));
+        Uint32 mask = (Uint32)_mm_movemask_epi8(hits);
+        if (mask) return (size_t)(p - start) + ASCII_SCAN_CTZ(mask);
+        p += 16;
+    }
+    return (size_t)(p - start);
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ASCII_SCAN_NEON 1
+
+static size_t scan_ascii_run_neon(const char *p, const char *end, char stop_a, char stop_b) {
+    const char *start = p;
+    const uint8x16_t stop_a_vec = vdupq_n_u8((uint8_t)stop_a), stop_b_vec = vdupq_n_u8((uint8_t)stop_b);
+    const int8x16_t first_printable = vdupq_n_s8(0x20);
+    while (end - p >= 16) {
+        uint8x16_t bytes = vld1q_u8((const uint8_t*)p);
+        uint8x16_t hits = vorrq_u8(vceqq_u8(bytes, stop_a_vec), vceqq_u8(bytes, stop_b_vec));
+        hits = vorrq_u8(hits, vcltq_s8(vreinterpretq_s8_u8(bytes), first_printable)); // Signed: also catches bytes >= 0x80
+        // Narrow to 4 bits per byte so the first hit is found with one count-trailing-zeros
+        Uint64 mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+        if (mask) return (size_t)(p - start) + ASCII_SCAN_CTZ(mask) / 4;
+        p += 16;
+    }
+    return (size_t)(p - start);
+}
+#endif
+
+// Portable fallback: 8 bytes per step, testing for a zero byte in (word ^ stop), for bytes below 0x20
+// and for high bits. The tests may flag the wrong byte of a word, but never miss one.
+static size_t scan_ascii_run_swar(const char *p, const char *end, char stop_a, char stop_b) {
+    const char *start = p;
+    const Uint64 ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+    const Uint64 stop_a_word = ones * (unsigned char)stop_a, stop_b_word = ones * (unsigned char)stop_b;
+    while (end - p >= 8) {
+        Uint64 word;
+        memcpy(&word, p, sizeof(word));
+        Uint64 xa = word ^ stop_a_word, xb = word ^ stop_b_word;
+        Uint64 any_hit = (word & highs) | ((word - ones * 0x20) & ~word & highs) |
+                         ((xa - ones) & ~xa & highs) | ((xb - ones) & ~xb & highs);
+        if (any_hit) break; // The scalar tail below finds the exact byte
+        p += 8;
+    }
+    return (size_t)(p - start);
+}
+
+size_t ScanAsciiRun(const char *p, const char *end, char stop_a, char stop_b) {
+    if (!p || !end || p >= end) return 0;
+    size_t run_len;
+#if defined(ASCII_SCAN_AVX2)
+    static int cpu_has_avx2 = -1; // Same result from every thread, so the unsynchronized store is harmless
+    if (cpu_has_avx2 < 0) cpu_has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    // Most runs are a word or two long and end within the first SSE2 blocks; AVX2 only pays off beyond that
+    const char *sse2_first_end = (end - p > 64) ? p + 64 : end;
+    run_len = scan_ascii_run_sse2(p, sse2_first_end, stop_a, stop_b);
+    if (cpu_has_avx2 && run_len == 64) run_len += scan_ascii_run_avx2(p + run_len, end, stop_a, stop_b);
+    run_len += scan_ascii_run_sse2(p + run_len, end, stop_a, stop_b);
+#elif defined(ASCII_SCAN_SSE2)
+    run_len = scan_ascii_run_sse2(p, end, stop_a, stop_b);
+#elif defined(ASCII_SCAN_NEON)
+    run_len = scan_ascii_run_neon(p, end, stop_a, stop_b);
+#else
+    run_len = 0;
+#endif
+    // The vector loops stop at a hit or before a partial block; finish word- and byte-wise from there
+    if (p + run_len < end && is_ascii_run_byte((unsigned char)p[run_len], stop_a, stop_b)) {
+        run_len += scan_ascii_run_swar(p + run_len, end, stop_a, stop_b);
+        while (p + run_len < end && is_ascii_run_byte((unsigned char)p[run_len], stop_a, stop_b)) run_len++;
+    }
+    return run_len;
+}
+
+// --- Layout block scanning ---
+// A word ends at ' ', '\n', '\t' or '\0', all ASCII, so bytes of multi-byte characters never end it and
+// need no decoding; a run of spaces ends at any other byte.
+
+static bool is_block_run_byte(unsigned char c, bool in_spaces) {
+    if (in_spaces) return c == ' ';
+    return c != ' ' && c != '\n' && c != '\t' && c != '\0';
+}
+
+#if defined(ASCII_SCAN_AVX2)
+__attribute__((target("avx2")))
+static size_t scan_block_run_avx2(const char *p, const char *end, bool in_spaces) {
+    const char *start = p;
+    const __m256i space = _mm256_set1_epi8(' '), newline = _mm256_set1_epi8('\n'), tab = _mm256_set1_epi8('\t');
+    const __m256i zero = _mm256_setzero_si256();
+    while (end - p >= 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)p);
+        __m256i spaces = _mm256_cmpeq_epi8(bytes, space);
+        Uint32 mask;
+        if (in_spaces) {
+            mask = ~(Uint32)_mm256_movemask_epi8(spaces);
+        } else {
+            __m256i breaks = _mm256_or_si256(_mm256_or_si256(spaces, _mm256_cmpeq_epi8(bytes, newline)),
+                                             _mm256_or_si256(_mm256_cmpeq_epi8(bytes, tab), _mm256_cmpeq_epi8(bytes, zero)));
+            mask = (Uint32)_mm256_movemask_epi8(breaks);
+        }
+        if (mask) return (size_t)(p - start) + ASCII_SCAN_CTZ(mask);
+        p += 32;
+    }
+    return (size_t)(p - start);
+}
+#endif
+
+#if defined(ASCII_SCAN_SSE2)
+// Bit i is set if byte i of the 16 at p ends the block
+static inline Uint32 block_break_mask_sse2(const char *p, bool in_spaces) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+    __m128i spaces = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    if (in_spaces) return ~(Uint32)_mm_movemask_epi8(spaces) & 0xFFFFu;
+    __m128i breaks = _mm_or_si128(_mm_or_si128(spaces, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))),
+                                  _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(bytes, _mm_setzero_si128())));
+    return (Uint32)_mm_movemask_epi8(breaks);
+}
+
+static size_t scan_block_run_sse2(const char *p, const char *end, bool in_spaces) {
+    const char *start = p;
+    while (end - p >= 16) {
+        Uint32 mask = block_break_mask_sse2(p, in_spaces);
+        if (mask) return (size_t)(p - start) + ASCII_SCAN_CTZ(mask);
+        p += 16;
+    }
+    return (size_t)(p - start);
+}
+
+#elif defined(ASCII_SCAN_NEON)
+static size_t scan_block_run_neon(const char *p, const char *end, bool in_spaces) {
+    const char *start = p;
+    const uint8x16_t space = vdupq_n_u8(' '), newline = vdupq_n_u8('\n'), tab = vdupq_n_u8('\t');
+    while (end - p >= 16) {
+        uint8x16_t bytes = vld1q_u8((const uint8_t*)p);
+        uint8x16_t spaces = vceqq_u8(bytes, space);
+        uint8x16_t hits = in_spaces ? vmvnq_u8(spaces)
+                                    : vorrq_u8(vorrq_u8(spaces, vceqq_u8(bytes, newline)),
+                                               vorrq_u8(vceqq_u8(bytes, tab), vceqzq_u8(bytes)));
+        Uint64 mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+        if (mask) return (size_t)(p - start) + ASCII_SCAN_CTZ(mask) / 4;
+        p += 16;
+    }
+    return (size_t)(p - start);
+}
+#endif
+
+size_t ScanBlockRun(const char *p, const char *end, bool in_spaces) {
+    if (!p || !end || p >= end) return 0;
+    size_t run_len;
+#if defined(ASCII_SCAN_SSE2)
+    // Nearly every block ends within its first 16 bytes: a single compare, before any loop
+    if (end - p >= 16) {
+        Uint32 mask = block_break_mask_sse2(p, in_spaces);
+        if (mask) return ASCII_SCAN_CTZ(mask);
+    }
+#endif
+#if defined(ASCII_SCAN_AVX2)
+    static int cpu_has_avx2 = -1; // Same result from every thread, so the unsynchronized store is harmless
+    if (cpu_has_avx2 < 0) cpu_has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    run_len = (end - p >= 16) ? 16 : 0;
+    if (cpu_has_avx2) run_len += scan_block_run_avx2(p + run_len, end, in_spaces);
+    run_len += scan_block_run_sse2(p + run_len, end, in_spaces);
+#elif defined(ASCII_SCAN_SSE2)
+    run_len = (end - p >= 16) ? 16 : 0;
+    run_len += scan_block_run_sse2(p + run_len, end, in_spaces);
+#elif defined(ASCII_SCAN_NEON)
+    run_len = scan_block_run_neon(p, end, in_spaces);
+#else
+    run_len = 0;
+#endif
+    // The vector loops stop at a hit or before a partial block; finish byte-wise from there
+    while (p + run_len < end && is_block_run_byte((unsigned char)p[run_len], in_spaces)) run_len++;
+    return run_len;
+}
+
+// --- Whole-buffer validation ---
+
+static bool validate_utf8_dfa(const unsigned char *p, const unsigned char *end, Uint32 state) {
+    Uint32 codepoint = 0;
     while (p < end) {
-        const char* char_start_before_decode = p;
-        Sint32 cp = decode_utf8(&p, end);
-
-        if (p > char_start_before_decode) { // If the decoder advanced the pointer
-             if (cp > 0) { // Valid codepoint
-                char_count++;
-             } else if (cp == 0 && p < end) { // Null-terminator within the string (count as a character)
-                char_count++;
-             } else if (cp == -1) { // Decoding error (count as one "erroneous" character)
-                 char_count++;
-             } else if (cp == 0 && p == end) { // Reached the end after successfully decoding the last character (not 0)
-                 break; // If the last character was successfully decoded and it wasn't \0, it's already counted
-             }
-        } else { // Decoder couldn't advance the pointer (unlikely if cp != -1, but for safety)
-            // If we are here, it means p hasn't changed, possibly end of string or an error decode_utf8 couldn't handle
-            // If p < end, it's likely an incorrect byte that decode_utf8 didn't process as part of a multi-byte sequence.
-            // Skip one byte to avoid an infinite loop, and count it as one character.
-            if (p < end) {
-                p++;
-                char_count++;
-            } else {
-                break; // Reached end of string
+        if (state == UTF8_DFA_ACCEPT) { // Skip ASCII a word at a time between sequences
+            while (end - p >= 8) {
+                Uint64 word;
+                memcpy(&word, p, sizeof(word));
+                if (word & 0x8080808080808080ULL) break;
+                p += 8;
             }
+            if (p == end) break;
+        }
+        state = utf8_dfa_step(state, &codepoint, *p++);
+        if (state == UTF8_DFA_REJECT) return false;
+    }
+    return state == UTF8_DFA_ACCEPT;
+}
+
+// The vector validators classify every byte pair with three 16-entry nibble lookups (the lookup algorithm of
+// Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"): the error bits of the first
+// byte's high nibble, its low nibble and the second byte's high nibble are ANDed, and whatever survives is
+// an error, except that continuation bytes 2 and 3 of a sequence are expected to leave the TWO_CONTS bit.
+#define UTF8_TOO_SHORT      (1 << 0) // Lead byte not followed by enough continuation bytes
+#define UTF8_TOO_LONG       (1 << 1) // ASCII followed by a continuation byte
+#define UTF8_OVERLONG_3     (1 << 2)
+#define UTF8_TOO_LARGE      (1 << 3) // Above U+10FFFF
+#define UTF8_SURROGATE      (1 << 4)
+#define UTF8_OVERLONG_2     (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4     (1 << 6)
+#define UTF8_TWO_CONTS      (1 << 7) // Two continuation bytes in a row
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+static const Uint8 utf8_first_high_nibble_errors[16] = {
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+};
+static const Uint8 utf8_first_low_nibble_errors[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY, UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+};
+static const Uint8 utf8_second_high_nibble_errors[16] = {
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+};
+
+#if defined(ASCII_SCAN_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define UTF8_VALIDATE_SSSE3 1
+
+__attribute__((target("ssse3")))
+static __m128i utf8_block_errors_ssse3(__m128i input, __m128i prev_input) {
+    const __m128i low_nibble_mask = _mm_set1_epi8(0x0F);
+    const __m128i first_high_table = _mm_loadu_si128((const __m128i*)utf8_first_high_nibble_errors);
+    const __m128i first_low_table = _mm_loadu_si128((const __m128i*)utf8_first_low_nibble_errors);
+    const __m128i second_high_table = _mm_loadu_si128((const __m128i*)utf8_second_high_nibble_errors);
+
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15); // Byte before each byte
+    __m128i special_cases = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(first_high_table, _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble_mask)),
+                      _mm_shuffle_epi8(first_low_table, _mm_and_si128(prev1, low_nibble_mask))),
+        _mm_shuffle_epi8(second_high_table, _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble_mask)));
+
+    // Bytes 2 and 3 after a 3- or 4-byte lead must be continuations, which the lookups flag as TWO_CONTS
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14), prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i must_be_continuation = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80))),
+                                                _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80))));
+    return _mm_xor_si128(_mm_and_si128(must_be_continuation, _mm_set1_epi8((char)0x80)), special_cases);
+}
+
+__attribute__((target("ssse3")))
+static bool validate_utf8_ssse3(const unsigned char *p, const unsigned char *end) {
+    __m128i errors = _mm_setzero_si128(), prev_input = _mm_setzero_si128();
+    bool prev_was_ascii = true;
+    unsigned char tail_block[16] = {0};
+    for (;;) {
+        __m128i input;
+        if (end - p >= 16) {
+            input = _mm_loadu_si128((const __m128i*)p);
+            p += 16;
+        } else { // Zero padding: a sequence cut off by the end shows up as TOO_SHORT before the padding
+            memcpy(tail_block, p, (size_t)(end - p));
+            input = _mm_loadu_si128((const __m128i*)tail_block);
+            p = end;
+        }
+        bool is_ascii = _mm_movemask_epi8(input) == 0;
+        if (!(is_ascii && prev_was_ascii)) errors = _mm_or_si128(errors, utf8_block_errors_ssse3(input, prev_input));
+        prev_input = input;
+        prev_was_ascii = is_ascii;
+        if (p == end) break;
+    }
+    // One more zero block checks the lead bytes at the very end
+    if (!prev_was_ascii) errors = _mm_or_si128(errors, utf8_block_errors_ssse3(_mm_setzero_si128(), prev_input));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128())) == 0xFFFF;
+}
+
+#elif defined(ASCII_SCAN_NEON)
+#define UTF8_VALIDATE_NEON 1
+
+static uint8x16_t utf8_block_errors_neon(uint8x16_t input, uint8x16_t prev_input) {
+    const uint8x16_t first_high_table = vld1q_u8(utf8_first_high_nibble_errors);
+    const uint8x16_t first_low_table = vld1q_u8(utf8_first_low_nibble_errors);
+    const uint8x16_t second_high_table = vld1q_u8(utf8_second_high_nibble_errors);
+
+    uint8x16_t prev1 = vextq_u8(prev_input, input, 15); // Byte before each byte
+    uint8x16_t special_cases = vandq_u8(vandq_u8(vqtbl1q_u8(first_high_table, vshrq_n_u8(prev1, 4)),
+                                                 vqtbl1q_u8(first_low_table, vandq_u8(prev1, vdupq_n_u8(0x0F)))),
+                                        vqtbl1q_u8(second_high_table, vshrq_n_u8(input, 4)));
+
+    // Bytes 2 and 3 after a 3- or 4-byte lead must be continuations, which the lookups flag as TWO_CONTS
+    uint8x16_t prev2 = vextq_u8(prev_input, input, 14), prev3 = vextq_u8(prev_input, input, 13);
+    uint8x16_t must_be_continuation = vorrq_u8(vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80)), vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80)));
+    return veorq_u8(vandq_u8(must_be_continuation, vdupq_n_u8(0x80)), special_cases);
+}
+
+static bool validate_utf8_neon(const unsigned char *p, const unsigned char *end) {
+    uint8x16_t errors = vdupq_n_u8(0), prev_input = vdupq_n_u8(0);
+    bool prev_was_ascii = true;
+    unsigned char tail_block[16] = {0};
+    for (;;) {
+        uint8x16_t input;
+        if (end - p >= 16) {
+            input = vld1q_u8(p);
+            p += 16;
+        } else { // Zero padding: a sequence cut off by the end shows up as TOO_SHORT before the padding
+            memcpy(tail_block, p, (size_t)(end - p));
+            input = vld1q_u8(tail_block);
+            p = end;
         }
+        bool is_ascii = vmaxvq_u8(input) < 0x80;
+        if (!(is_ascii && prev_was_ascii)) errors = vorrq_u8(errors, utf8_block_errors_neon(input, prev_input));
+        prev_input = input;
+        prev_was_ascii = is_ascii;
+        if (p == end) break;
     }
-    return char_count;
-}
\ No newline at end of file
+    // One more zero block checks the lead bytes at the very end
+    if (!prev_was_ascii) errors = vorrq_u8(errors, utf8_block_errors_neon(vdupq_n_u8(0), prev_input));
+    return vmaxvq_u8(errors) == 0;
+}
+#endif
+
+bool ValidateUTF8(const char *text, size_t text_len) {
+    if (!text) return text_len == 0;
+    const unsigned char *p = (const unsigned char *)text, *end = p + text_len;
+#if defined(UTF8_VALIDATE_SSSE3)
+    static int cpu_has_ssse3 = -1; // Same result from every thread, so the unsynchronized store is harmless
+    if (cpu_has_ssse3 < 0) cpu_has_ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    if (cpu_has_ssse3) return validate_utf8_ssse3(p, end);
+#elif defined(UTF8_VALIDATE_NEON)
+    return validate_utf8_neon(p, end);
+#endif
+    return validate_utf8_dfa(p, end, UTF8_DFA_ACCEPT);
+}
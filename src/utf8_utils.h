@@ -2,8 +2,41 @@
 #define UTF8_UTILS_H
 
 #include <SDL2/SDL_stdinc.h> // For Sint32, size_t
+#include <stdbool.h>
 
+// Decodes one character and advances *s_ptr past it. Returns 0 at the end, or -1 without advancing for a
+// malformed sequence: invalid bytes, truncated, overlong, a surrogate or above U+10FFFF.
 Sint32 decode_utf8(const char **s_ptr, const char *s_end_const_char);
+
+// Same as decode_utf8 for text known to be valid UTF-8 (e.g. after the preprocessor, which drops
+// every malformed sequence); there is no validation, only the end check.
+static inline Sint32 decode_utf8_unchecked(const char **s_ptr, const char *s_end_const_char) {
+    const unsigned char *s = (const unsigned char *)*s_ptr;
+    if (s >= (const unsigned char *)s_end_const_char) return 0;
+    if (s[0] < 0x80) { *s_ptr += 1; return s[0]; }
+    if (s[0] < 0xE0) { *s_ptr += 2; return ((Sint32)(s[0] & 0x1F) << 6) | (Sint32)(s[1] & 0x3F); }
+    if (s[0] < 0xF0) { *s_ptr += 3; return ((Sint32)(s[0] & 0x0F) << 12) | ((Sint32)(s[1] & 0x3F) << 6) | (Sint32)(s[2] & 0x3F); }
+    *s_ptr += 4;
+    return ((Sint32)(s[0] & 0x07) << 18) | ((Sint32)(s[1] & 0x3F) << 12) | ((Sint32)(s[2] & 0x3F) << 6) | (Sint32)(s[3] & 0x3F);
+}
+
+// Writes the UTF-8 form of a codepoint (at most U+10FFFF) to out and returns its length (1..4)
+size_t encode_utf8(Uint32 codepoint, char *out);
+
+// True if the whole buffer is valid UTF-8 by the rules of decode_utf8. Uses SSSE3 or NEON lookups 16 bytes
+// at a time where available (pure ASCII blocks are only tested for the high bit), else the decoder's DFA.
+bool ValidateUTF8(const char *text, size_t text_len);
+// Characters in a valid UTF-8 string (bytes other than continuation bytes)
 size_t CountUTF8Chars(const char* text, size_t text_byte_len);
 
+// Length of the leading run of [p, end) made of printable ASCII bytes (0x20..0x7F) other than the two
+// stop bytes; control bytes and bytes >= 0x80 always end the run. Scans 16/32 bytes at a time with
+// SSE2/AVX2 or NEON where available.
+size_t ScanAsciiRun(const char *p, const char *end, char stop_a, char stop_b);
+
+// Length of the layout block at the start of [p, end): with in_spaces, the leading run of ' '; otherwise the
+// word, which ends at ' ', '\n', '\t' or '\0' (bytes of multi-byte characters never end it). Scans 16/32 bytes
+// at a time with SSE2/AVX2 or NEON where available.
+size_t ScanBlockRun(const char *p, const char *end, bool in_spaces);
+
 #endif // UTF8_UTILS_H
\ No newline at end of file
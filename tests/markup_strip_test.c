@@ -0,0 +1,93 @@
+// Checks of the streaming markup stripper (see markup_strip.c): '<' that starts no tag in Markdown, fenced code
+// and tags left open at the end of the input
+#include "markup_strip.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failure_count = 0;
+
+// Strips input fed in pieces of piece_len bytes (the whole input if 0)
+static char* strip_text(MarkupKind kind, const char *input, size_t piece_len) {
+    size_t input_len = strlen(input);
+    char *output = (char*)malloc(input_len + MARKUP_TAG_BYTES_MAX + 1);
+    if (!output) return NULL;
+    MarkupStripState state;
+    MarkupStripInit(&state, kind);
+    size_t output_len = 0;
+    if (piece_len == 0) piece_len = input_len;
+    for (size_t fed = 0; fed < input_len; fed += piece_len) {
+        size_t len = input_len - fed < piece_len ? input_len - fed : piece_len;
+        output_len = MarkupStripFeed(&state, input + fed, len, output, output_len);
+    }
+    output_len = MarkupStripFinish(&state, output, output_len);
+    output[output_len] = '\0';
+    return output;
+}
+
+// The same output whole, byte by byte and in 7-byte pieces
+static void expect_stripped(const char *name, MarkupKind kind, const char *input, const char *expected) {
+    const size_t piece_lens[] = {0, 1, 7};
+    for (size_t i = 0; i < sizeof(piece_lens) / sizeof(piece_lens[0]); i++) {
+        char *output = strip_text(kind, input, piece_lens[i]);
+        if (!output || strcmp(output, expected) != 0) {
+            fprintf(stderr, "FAIL %s (pieces of %zu bytes)\n  expected: \"%s\"\n  got:      \"%s\"\n",
+                    name, piece_lens[i], expected, output ? output : "(out of memory)");
+            failure_count++;
+        }
+        free(output);
+    }
+}
+
+int main(void) {
+    const char *readme =
+        "# Sum\n"
+        "\n"
+        "Add the numbers while i<n:\n"
+        "\n"
+        "```c\n"
+        "for (i = 0; i<n; i++) sum += i;\n"
+        "if (a<b && b>c) *p = a_b;\n"
+        "```\n"
+        "\n"
+        "Then a<b holds, and <b>this</b> is **bold**.\n"
+        "\n"
+        "## Links\n"
+        "\n"
+        "See [the docs](https://example.com/docs).\n";
+    const char *readme_text =
+        "Sum\n"
+        "\n"
+        "Add the numbers while i<n:\n"
+        "\n"
+        "\n"
+        "for (i = 0; i<n; i++) sum += i;\n"
+        "if (a<b && b>c) *p = a_b;\n"
+        "\n"
+        "\n"
+        "Then a<b holds, and this is bold.\n"
+        "\n"
+        "Links\n"
+        "\n"
+        "See the docs.\n";
+    expect_stripped("README with code", MARKUP_MARKDOWN, readme, readme_text);
+
+    expect_stripped("comparison outside a fence", MARKUP_MARKDOWN, "while i<n and a<b: go\n", "while i<n and a<b: go\n");
+    expect_stripped("comparison with '>' later on the line", MARKUP_MARKDOWN, "x<y and y>z\n", "x<y and y>z\n");
+    expect_stripped("apostrophe after '<'", MARKUP_MARKDOWN, "if a<b it's fine\nnext line\n", "if a<b it's fine\nnext line\n");
+    expect_stripped("markup after a non-tag", MARKUP_MARKDOWN, "i<n is **true**\n", "i<n is true\n");
+    expect_stripped("inline tags", MARKUP_MARKDOWN, "a <span class=\"x\">b</span> <br/>c\n", "a b \nc\n");
+    expect_stripped("fenced code kept as it is", MARKUP_MARKDOWN, "~~~\n<b>x</b> &amp; **y**\n```\n~~~\nz\n",
+                    "\n<b>x</b> &amp; **y**\n```\n\nz\n");
+    expect_stripped("unclosed fence", MARKUP_MARKDOWN, "```\ni<n\n``", "\ni<n\n``");
+    expect_stripped("unclosed tag at the end (Markdown)", MARKUP_MARKDOWN, "end: a <b", "end: a <b");
+    expect_stripped("unclosed tag at the end (HTML)", MARKUP_HTML, "<p>end: a <b class=\"x", "\n\nend: a <b class=\"x");
+    expect_stripped("HTML tag across lines", MARKUP_HTML, "<p\nclass='a'>x</p>", "\n\nx\n\n");
+
+    if (failure_count > 0) {
+        fprintf(stderr, "%d markup strip check(s) failed\n", failure_count);
+        return EXIT_FAILURE;
+    }
+    printf("markup strip checks passed\n");
+    return EXIT_SUCCESS;
+}
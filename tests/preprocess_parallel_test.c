@@ -0,0 +1,100 @@
+// Compares PreprocessFeedParallel with the serial PreprocessFeed on random texts fed in random pieces. The test is
+// built with a low PREPROCESS_PARALLEL_MIN_BYTES, so that texts of a few hundred bytes are cut into several chunks.
+#include "text_processing.h"
+#include "replacement_rules.h"
+#include "file_paths.h" // For fopen_unicode_path
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_TEXT_COUNT 3000
+#define TEST_TEXT_MAX_BYTES 4096
+
+static AppContext app_context; // Only the replacement rules are used
+
+// Only the built-in rules are loaded, so no rules file is ever opened (file_paths.c is not linked in)
+FILE* fopen_unicode_path(const char *utf8_path, const char *mode) {
+    (void)utf8_path;
+    (void)mode;
+    return NULL;
+}
+
+// Paragraph breaks in all their forms, whitespace around them, rule matches cut in every way, and UTF-8
+static const char *const valid_fragments[] = {
+    "word", "a", "Ünïcödé", "текст", "😀", " ", "  ", "\t", " \t ",
+    "\n", "\n\n", "\n\n\n", "\r\n", "\r\n\r\n", "\n\r\n", "\r", "\r\r", " \n\n ", "\n \n", "\t\n\n\t",
+    "--", "-", "---", "...", "..", ".", "\"", "'", "\"quoted\"", "it's",
+};
+// Malformed and cut sequences, which the preprocessor drops
+static const char *const invalid_fragments[] = {"\xff", "\xe2\x80", "\xc3", "\x80\x80", "\xf0\x9f\x98"};
+
+static unsigned long long random_state;
+
+static unsigned random_below(unsigned bound) {
+    random_state = random_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)(random_state >> 33) % bound;
+}
+
+static size_t random_text(char *text, bool valid_utf8) {
+    size_t text_len = 0;
+    size_t target_len = random_below(TEST_TEXT_MAX_BYTES);
+    size_t valid_count = sizeof(valid_fragments) / sizeof(valid_fragments[0]);
+    size_t invalid_count = sizeof(invalid_fragments) / sizeof(invalid_fragments[0]);
+    while (text_len < target_len) {
+        const char *fragment = (!valid_utf8 && random_below(20) == 0) ? invalid_fragments[random_below((unsigned)invalid_count)]
+                                                                      : valid_fragments[random_below((unsigned)valid_count)];
+        size_t fragment_len = strlen(fragment);
+        if (text_len + fragment_len > TEST_TEXT_MAX_BYTES) break;
+        memcpy(text + text_len, fragment, fragment_len);
+        text_len += fragment_len;
+    }
+    return text_len;
+}
+
+// Preprocesses text fed in pieces of piece_len bytes, with PreprocessFeedParallel or PreprocessFeed
+static size_t preprocess_text(const char *text, size_t text_len, size_t piece_len, bool valid_utf8, bool parallel, char *output) {
+    PreprocessState state;
+    PreprocessStateInit(&state);
+    state.input_is_valid_utf8 = valid_utf8;
+    state.rules = &app_context.replacement_rules;
+    size_t output_len = 0;
+    for (size_t fed = 0; fed < text_len; fed += piece_len) {
+        size_t len = text_len - fed < piece_len ? text_len - fed : piece_len;
+        output_len = parallel ? PreprocessFeedParallel(&app_context, &state, text + fed, len, output, output_len)
+                              : PreprocessFeed(&state, text + fed, len, false, output, output_len);
+    }
+    return PreprocessFinish(&state, output, output_len);
+}
+
+int main(void) {
+    if (!ReplacementRulesLoad(&app_context, NULL)) {
+        fprintf(stderr, "could not load the built-in replacement rules\n");
+        return EXIT_FAILURE;
+    }
+    static char text[TEST_TEXT_MAX_BYTES];
+    static char serial_output[TEST_TEXT_MAX_BYTES * 3];
+    static char parallel_output[TEST_TEXT_MAX_BYTES * 3];
+
+    int failure_count = 0;
+    for (unsigned seed = 1; seed <= TEST_TEXT_COUNT; seed++) {
+        random_state = seed;
+        bool valid_utf8 = (seed % 2 == 0); // As for transcoded text, which skips the decoder checks
+        size_t text_len = random_text(text, valid_utf8);
+        size_t piece_len = random_below(2) ? text_len + 1 : 1 + random_below(TEST_TEXT_MAX_BYTES / 2); // Whole or in pieces
+        size_t serial_len = preprocess_text(text, text_len, piece_len, valid_utf8, false, serial_output);
+        size_t parallel_len = preprocess_text(text, text_len, piece_len, valid_utf8, true, parallel_output);
+        if (serial_len != parallel_len || memcmp(serial_output, parallel_output, serial_len) != 0) {
+            fprintf(stderr, "FAIL seed %u: %zu bytes in pieces of %zu: serial output %zu bytes, parallel %zu bytes\n",
+                    seed, text_len, piece_len, serial_len, parallel_len);
+            failure_count++;
+        }
+    }
+    ReplacementRulesFree(&app_context.replacement_rules);
+
+    if (failure_count > 0) {
+        fprintf(stderr, "%d of %d random texts preprocessed differently in parallel\n", failure_count, TEST_TEXT_COUNT);
+        return EXIT_FAILURE;
+    }
+    printf("parallel preprocessing matched the serial output on %d random texts\n", TEST_TEXT_COUNT);
+    return EXIT_SUCCESS;
+}